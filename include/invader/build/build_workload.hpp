@@ -5,9 +5,11 @@
 
 #include <vector>
 #include <optional>
+#include <unordered_map>
 #include <string>
 #include <filesystem>
 #include <chrono>
+#include <memory>
 #include "../hek/map.hpp"
 #include "../resource/resource_map.hpp"
 #include "../tag/parser/parser.hpp"
@@ -16,6 +18,17 @@
 namespace Invader {
     class BuildWorkload : public ErrorHandler {
     public:
+        /**
+         * Compiled tags kept in memory so later builds in the same process can reuse them
+         */
+        struct BuildCacheMemory {
+            /** Cache records, keyed by record key */
+            std::unordered_map<std::uint64_t, std::vector<std::byte>> records;
+
+            /** Record key of the most recently compiled version of each tag, keyed by tag path and class */
+            std::unordered_map<std::string, std::uint64_t> latest_records;
+        };
+
         struct BuildParameters {
             /**
             * Select how much is output
@@ -57,17 +70,17 @@ namespace Invader {
             /**
              * Bitmap data
              */
-            std::optional<std::vector<Resource>> bitmap_data;
+            std::optional<ResourceMap> bitmap_data;
             
             /**
              * Sound data
              */
-            std::optional<std::vector<Resource>> sound_data;
+            std::optional<ResourceMap> sound_data;
             
             /**
              * Loc data
              */
-            std::optional<std::vector<Resource>> loc_data;
+            std::optional<ResourceMap> loc_data;
             
             /**
              * How verbose to make the output
@@ -84,6 +97,52 @@ namespace Invader {
              */
             bool optimize_space = false;
             
+            /**
+             * Number of threads to use for reading and parsing tags (tags are still compiled in order) and for compressing
+             */
+            std::size_t max_threads = 1;
+            
+            /**
+             * Use long distance matching when compressing with Zstandard?
+             */
+            bool long_distance_matching = false;
+            
+            /**
+             * If nonzero, compress native maps in independent frames of this many bytes
+             */
+            std::size_t frame_size = 0;
+            
+            /**
+             * Directory to store compiled tags in so they can be reused by later builds, if any
+             */
+            std::optional<std::filesystem::path> cache_directory;
+            
+            /**
+             * Compiled tags to keep in memory between builds, if any
+             */
+            BuildCacheMemory *cache_memory = nullptr;
+            
+            /**
+            * Select how build stats are output
+            */
+            enum BuildStatsFormat {
+                /** Output a table */
+                BUILD_STATS_FORMAT_TEXT,
+                
+                /** Output a JSON object */
+                BUILD_STATS_FORMAT_JSON
+            };
+            
+            /**
+             * Output time and memory usage for each phase of the build and each tag class after building, if set
+             */
+            std::optional<BuildStatsFormat> stats;
+            
+            /**
+             * Save the build stats to this file instead of printing them, if set
+             */
+            std::optional<std::filesystem::path> stats_output;
+            
             /**
              * Control how cache files are built. Changing these may result in an incompatible cache file
              */
@@ -176,6 +235,14 @@ namespace Invader {
          */
         static std::vector<std::byte> compile_map(const BuildParameters &parameters);
 
+        /**
+         * Compile a map and write it straight to a file instead of returning it, using less memory
+         * @param parameters build parameters to use
+         * @param output     path to write the map to; it is written to a temporary file which is then renamed to this
+         * @return           size of the map when uncompressed
+         */
+        static std::size_t compile_map(const BuildParameters &parameters, const std::filesystem::path &output);
+
         /**
          * Compile a single tag
          * @param tag               tag to use
@@ -292,7 +359,7 @@ namespace Invader {
             std::string path;
 
             /** Class of the tag */
-            TagClassInt tag_class_int;
+            TagClassInt tag_class_int = TagClassInt::TAG_CLASS_NULL;
 
             /** Original tag class, if applicable */
             std::optional<TagClassInt> alias;
@@ -349,6 +416,57 @@ namespace Invader {
         /** Part count */
         std::size_t part_count = 0;
         
+        /** Step of compiling a tag, used for build stats */
+        enum CompileStep {
+            /** Anything not covered by another step */
+            COMPILE_STEP_COMPILE,
+            
+            /** Parsing the tag file */
+            COMPILE_STEP_PARSE,
+            
+            /** Running pre_compile on the tag's structs */
+            COMPILE_STEP_PRE_COMPILE,
+            
+            /** Running post_compile on the tag's structs */
+            COMPILE_STEP_POST_COMPILE,
+            
+            COMPILE_STEP_COUNT
+        };
+        
+        /**
+         * Adds the time it exists for to a step of compiling a tag if build stats are enabled; time spent in steps started
+         * while it exists is not counted
+         */
+        class CompileStepTimer {
+        public:
+            CompileStepTimer(BuildWorkload &workload, std::size_t tag_index, CompileStep step) : workload(workload) {
+                if(workload.stats) {
+                    this->begin(tag_index, step);
+                }
+            }
+            ~CompileStepTimer() {
+                if(this->workload.stats) {
+                    this->end();
+                }
+            }
+            CompileStepTimer(const CompileStepTimer &) = delete;
+            CompileStepTimer &operator=(const CompileStepTimer &) = delete;
+        private:
+            BuildWorkload &workload;
+            void begin(std::size_t tag_index, CompileStep step);
+            void end();
+        };
+        
+        /**
+         * Time a step of compiling a tag until the returned timer is destroyed
+         * @param tag_index index of the tag
+         * @param step      step being done
+         * @return          timer
+         */
+        CompileStepTimer time_compile_step(std::size_t tag_index, CompileStep step) {
+            return CompileStepTimer(*this, tag_index, step);
+        }
+        
         /** 
          * Get the build parameters
          * @return build parameters
@@ -374,11 +492,55 @@ namespace Invader {
          */
         void compile_tag_data_recursively(const std::byte *tag_data, std::size_t tag_data_size, std::size_t tag_index, std::optional<TagClassInt> tag_class_int = std::nullopt);
         
+        BuildWorkload(BuildWorkload &&) = default;
         ~BuildWorkload() override = default;
 
     private:
         BuildWorkload();
 
+        struct TagPrefetchQueue;
+        struct BuildCache;
+        struct BuildStats;
+        
+        struct TagIndexKeyHash {
+            std::size_t operator()(const std::pair<std::string, TagClassInt> &key) const noexcept {
+                return std::hash<std::string>()(key.first) * 31 + static_cast<std::size_t>(key.second);
+            }
+        };
+        
+        /** Indices of the tags with each (path, class) pair, including aliases, sorted from lowest to highest */
+        std::unordered_map<std::pair<std::string, TagClassInt>, std::vector<std::size_t>, TagIndexKeyHash> tag_indices;
+        
+        /**
+         * Find the tag with the given path and class (or alias)
+         * @param tag_path      path of the tag
+         * @param tag_class_int class of the tag
+         * @return              index of the tag if found
+         */
+        std::optional<std::size_t> find_tag(const std::string &tag_path, TagClassInt tag_class_int) const;
+        
+        /**
+         * Add the tag to the tag index table; this must be called when a tag is added or its path/class changes
+         * @param tag_index index of the tag
+         */
+        void index_tag(std::size_t tag_index);
+        
+        /**
+         * Remove the tag from the tag index table; this must be called before changing a tag's path/class
+         * @param tag_index index of the tag
+         */
+        void unindex_tag(std::size_t tag_index);
+        
+        /**
+         * Find the file for the tag in the given tags directories
+         * @param tag_path         path of the tag
+         * @param tag_class_int    class of the tag; if it is an object reference, this is set to the class that was found
+         * @param tags_directories tags directories to search
+         * @param formatted_path   set to the path of the tag with its extension
+         * @return                 path to the file if found
+         */
+        static std::optional<std::filesystem::path> find_tag_file(const char *tag_path, TagClassInt &tag_class_int, const std::vector<std::filesystem::path> &tags_directories, char (&formatted_path)[256]);
+        
         std::chrono::steady_clock::time_point start;
         const char *scenario;
         std::size_t scenario_index;
@@ -394,6 +556,8 @@ namespace Invader {
         void set_scenario_name(const char *name);
         std::size_t raw_bitmap_size = 0;
         std::size_t raw_sound_size = 0;
+        std::size_t deduped_raw_data_count = 0;
+        std::size_t deduped_raw_data_size = 0;
         void externalize_tags() noexcept;
         void delete_raw_data(std::size_t index);
         std::size_t stubbed_tag_count = 0;
@@ -401,6 +565,15 @@ namespace Invader {
         std::size_t raw_data_indices_offset;
         std::uint32_t tag_file_checksums = 0;
         const BuildParameters *parameters = nullptr;
+        void set_parameters(const BuildParameters &parameters);
+        const std::filesystem::path *output_file = nullptr;
+        std::size_t uncompressed_size = 0;
+        TagPrefetchQueue *prefetch_queue = nullptr;
+        BuildCache *build_cache = nullptr;
+        std::size_t cached_tag_count = 0;
+        std::size_t uncached_tag_count = 0;
+        BuildStats *stats = nullptr;
+        void compile_tag_data_recursively(const std::byte *tag_data, std::size_t tag_data_size, std::size_t tag_index, std::optional<TagClassInt> tag_class_int, std::unique_ptr<Parser::ParserStruct> parsed_tag_struct);
     };
 }
 
@@ -3,10 +3,40 @@
 #ifndef INVADER__COMPRESS__COMPRESSION_HPP
 #define INVADER__COMPRESS__COMPRESSION_HPP
 
+#include <cstddef>
 #include <vector>
 #include <optional>
+#include <utility>
 
 namespace Invader::Compression {
+    /**
+     * Options for compressing with Zstandard
+     */
+    struct ZstdOptions {
+        /**
+         * Number of worker threads to compress with. The output is the same for any nonzero number of threads. If this
+         * is 0, compression is done on the calling thread instead.
+         */
+        std::size_t threads = 0;
+
+        /**
+         * Use long distance matching, finding matches up to 128 MiB back at the cost of memory. The window is limited to
+         * what decompressors accept by default.
+         */
+        bool long_distance_matching = false;
+
+        /**
+         * Number of bytes each worker thread compresses at a time, or 0 to let Zstandard decide
+         */
+        std::size_t job_size = 0;
+
+        /**
+         * If nonzero, compress native maps as independent frames of this many bytes with an index of the frames, so
+         * parts of the map can be decompressed without decompressing the rest. This is ignored for other maps.
+         */
+        std::size_t frame_size = 0;
+    };
+
     /**
      * Compress the map data
      * @param data              data pointer
@@ -14,9 +44,34 @@ namespace Invader::Compression {
      * @param output            data output
      * @param output_size       output buffer size
      * @param compression_level compression level to use
+     * @param zstd_options      options for compressing with Zstandard (ignored for Xbox maps)
      * @return                  actual size of the output
      */
-    std::size_t compress_map_data(const std::byte *data, std::size_t data_size, std::byte *output, std::size_t output_size, int compression_level = 19);
+    std::size_t compress_map_data(const std::byte *data, std::size_t data_size, std::byte *output, std::size_t output_size, int compression_level = 19, const ZstdOptions &zstd_options = ZstdOptions());
+
+    /**
+     * Compress the map data, passing the output to a callback as it is made rather than holding all of it in memory
+     * @param data              data pointer
+     * @param data_size         size of the data
+     * @param write_callback    callback to write output at the given offset; the header may be written again at offset 0 once compression is done
+     * @param user_data         user data to pass to the callback
+     * @param compression_level compression level to use
+     * @param zstd_options      options for compressing with Zstandard (ignored for Xbox maps)
+     * @return                  actual size of the output
+     */
+    std::size_t compress_map_data(const std::byte *data, std::size_t data_size, bool (*write_callback)(const std::byte *data, std::size_t size, std::size_t offset, void *user_data), void *user_data, int compression_level = 19, const ZstdOptions &zstd_options = ZstdOptions());
+
+    /**
+     * Compress map data that is split into sections, passing the output to a callback as it is made. The sections are
+     * compressed as if they were one buffer, so they don't need to be copied into one first.
+     * @param sections          data and size of each section of the map, in order, starting with the header
+     * @param write_callback    callback to write output at the given offset; the header may be written again at offset 0 once compression is done
+     * @param user_data         user data to pass to the callback
+     * @param compression_level compression level to use
+     * @param zstd_options      options for compressing with Zstandard (ignored for Xbox maps)
+     * @return                  actual size of the output
+     */
+    std::size_t compress_map_data(const std::vector<std::pair<const std::byte *, std::size_t>> &sections, bool (*write_callback)(const std::byte *data, std::size_t size, std::size_t offset, void *user_data), void *user_data, int compression_level = 19, const ZstdOptions &zstd_options = ZstdOptions());
 
     /**
      * Decompress the map data
@@ -33,9 +88,10 @@ namespace Invader::Compression {
      * @param data              data pointer
      * @param data_size         size of the data
      * @param compression_level compression level to use
+     * @param zstd_options      options for compressing with Zstandard (ignored for Xbox maps)
      * @return                  vector of compressed data
      */
-    std::vector<std::byte> compress_map_data(const std::byte *data, std::size_t data_size, int compression_level = 19);
+    std::vector<std::byte> compress_map_data(const std::byte *data, std::size_t data_size, int compression_level = 19, const ZstdOptions &zstd_options = ZstdOptions());
 
     /**
      * Decompress the map data
@@ -45,6 +101,18 @@ namespace Invader::Compression {
      */
     std::vector<std::byte> decompress_map_data(const std::byte *data, std::size_t data_size);
 
+    /**
+     * Decompress part of a native map that was compressed in frames, leaving the rest of the output untouched. The
+     * header is decompressed if the range includes it, as is every frame that the range overlaps.
+     * @param data        data pointer
+     * @param data_size   size of the data
+     * @param output      data output; this must be large enough for the entire decompressed map
+     * @param output_size output buffer size
+     * @param offset      offset of the range in the decompressed map
+     * @param size        size of the range
+     */
+    void decompress_map_data_range(const std::byte *data, std::size_t data_size, std::byte *output, std::size_t output_size, std::size_t offset, std::size_t size);
+
     /**
      * Decompress one file to another file, using significantly less memory but also significantly more disk I/O
      * @param input  path to the compressed file
@@ -64,19 +132,55 @@ namespace Invader::Compression {
     
     /**
      * Compress the file using ceaflate
-     * @param input      input buffer
-     * @param input_size input buffer size
-     * @return           compressed data
+     * @param input             input buffer
+     * @param input_size        input buffer size
+     * @param compression_level compression level to use
+     * @param threads           number of threads to use, or 0 to use the CPU thread count (this does not affect the output)
+     * @return                  compressed data
+     */
+    std::vector<std::byte> ceaflate_compress(const std::byte *input, std::size_t input_size, int compression_level = 9, std::size_t threads = 0);
+
+    /**
+     * Compress the file using ceaflate, passing the output to a callback as it is made rather than holding all of it in memory
+     * @param input             input buffer
+     * @param input_size        input buffer size
+     * @param write_callback    callback to write output at the given offset; the chunk offsets are written again at offset 0 once compression is done
+     * @param user_data         user data to pass to the callback
+     * @param compression_level compression level to use
+     * @param threads           number of threads to use, or 0 to use the CPU thread count (this does not affect the output)
+     * @return                  actual size of the output
      */
-    std::vector<std::byte> ceaflate_compress(const std::byte *input, std::size_t input_size, int compression_level = 9);
+    std::size_t ceaflate_compress(const std::byte *input, std::size_t input_size, bool (*write_callback)(const std::byte *data, std::size_t size, std::size_t offset, void *user_data), void *user_data, int compression_level = 9, std::size_t threads = 0);
     
     /**
      * Decompress the file using ceaflate
      * @param input      input buffer
      * @param input_size input buffer size
+     * @param threads    number of threads to use, or 0 to use the CPU thread count
      * @return           decompressed data
      */
-    std::vector<std::byte> ceaflate_decompress(const std::byte *input, std::size_t input_size);
+    std::vector<std::byte> ceaflate_decompress(const std::byte *input, std::size_t input_size, std::size_t threads = 0);
+
+    /**
+     * Decompress some of the chunks of the file using ceaflate
+     * @param input       input buffer
+     * @param input_size  input buffer size
+     * @param first_chunk index of the first chunk to decompress
+     * @param chunk_count number of chunks to decompress
+     * @param output      where to put the first chunk; the rest follow it
+     * @param output_size output buffer size
+     * @param threads     number of threads to use, or 0 to use the CPU thread count (only a few chunks are inflated on one
+     *                    thread regardless)
+     */
+    void ceaflate_decompress_chunks(const std::byte *input, std::size_t input_size, std::size_t first_chunk, std::size_t chunk_count, std::byte *output, std::size_t output_size, std::size_t threads = 0);
+
+    /**
+     * Get where each chunk of the file starts once decompressed
+     * @param input      input buffer
+     * @param input_size input buffer size
+     * @return           offsets of each chunk, if valid, or std::nullopt if not
+     */
+    std::optional<std::vector<std::size_t>> ceaflate_chunk_offsets(const std::byte *input, std::size_t input_size);
     
     /**
      * Query the decompressed size of the file
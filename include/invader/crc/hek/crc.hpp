@@ -6,6 +6,8 @@
 #include <cstdint>
 #include <cstddef>
 #include <optional>
+#include <utility>
+#include <vector>
 
 namespace Invader {
     /**
@@ -20,6 +22,17 @@ namespace Invader {
      */
     std::uint32_t calculate_map_crc(const std::byte *data, std::size_t size, const std::uint32_t *new_crc = nullptr, std::uint32_t *new_random = nullptr, bool *check_dirty = nullptr, bool allow_compressed = false);
     
+    /**
+     * Calculate the CRC32 of a map from the parts of it that get CRC'd, which don't need to be in one buffer
+     * @param  regions            data and size of each part of the map that gets CRC'd (BSPs, model data, then tag data), in order
+     * @param  tag_file_checksums pointer to the tag file checksums value in the tag data, which is in one of the regions
+     * @param  new_crc            new CRC32 of the map
+     * @param  new_random         new random number of the map (if forging a CRC32)
+     * @param  max_threads        maximum number of threads to use, or 0 to use the CPU thread count
+     * @return                    CRC32 of the map
+     */
+    std::uint32_t calculate_map_crc(const std::vector<std::pair<const std::byte *, std::size_t>> &regions, const std::byte *tag_file_checksums, const std::uint32_t *new_crc = nullptr, std::uint32_t *new_random = nullptr, std::size_t max_threads = 0);
+    
     class Map;
     
     /**
@@ -28,9 +41,10 @@ namespace Invader {
      * @param  new_crc          new CRC32 of the map
      * @param  new_random       new random number of the map (if forging a CRC32)
      * @param  check_dirty      optionally set to false if the cache file is not dirty or true if it is
+     * @param  max_threads      maximum number of threads to use, or 0 to use the CPU thread count
      * @return                  CRC32 of the map
      */
-    std::uint32_t calculate_map_crc(Invader::Map &map, const std::uint32_t *new_crc = nullptr, std::uint32_t *new_random = nullptr, bool *check_dirty = nullptr);
+    std::uint32_t calculate_map_crc(Invader::Map &map, const std::uint32_t *new_crc = nullptr, std::uint32_t *new_random = nullptr, bool *check_dirty = nullptr, std::size_t max_threads = 0);
 }
 
 #endif
@@ -77,6 +77,11 @@ namespace Invader {
      */
     DEFINE_EXCEPTION(FailedToOpenFileException, "failed to open a file");
 
+    /**
+     * This is thrown when a file cannot be written to
+     */
+    DEFINE_EXCEPTION(FailedToSaveFileException, "failed to save a file");
+
     /**
      * This is thrown when some other tag related error occurs.
      */
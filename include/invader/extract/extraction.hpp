@@ -30,8 +30,9 @@ namespace Invader {
          * @param overwrite       overwrite tag files that exist
          * @param non_mp_globals  allow extraction of non-multiplayer globals
          * @param reporting_level reporting level to use
+         * @param max_threads     number of threads to extract tags on
          */
-        static void extract_map(const Map &map, const std::string &tags, const std::vector<std::string> &queries, bool recursive = false, bool overwrite = false, bool non_mp_globals = false, ReportingLevel reporting_level = ReportingLevel::REPORTING_LEVEL_ALL);
+        static void extract_map(const Map &map, const std::string &tags, const std::vector<std::string> &queries, bool recursive = false, bool overwrite = false, bool non_mp_globals = false, ReportingLevel reporting_level = ReportingLevel::REPORTING_LEVEL_ALL, std::size_t max_threads = 1);
         
     private:
         /**
@@ -47,9 +48,10 @@ namespace Invader {
          * @param recursive      also extract tags depended by a tag
          * @param overwrite      overwrite tag files that exist
          * @param non_mp_globals allow extraction of non-multiplayer globals
+         * @param max_threads    number of threads to extract tags on
          * @return               number of tags successfully extracted
          */
-        std::size_t perform_extraction(const std::vector<std::string> &queries, const std::filesystem::path &tags, bool recursive, bool overwrite, bool non_mp_globals);
+        std::size_t perform_extraction(const std::vector<std::string> &queries, const std::filesystem::path &tags, bool recursive, bool overwrite, bool non_mp_globals, std::size_t max_threads);
         
         /** Map reference */
         const Map &map;
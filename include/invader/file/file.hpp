@@ -25,6 +25,69 @@ namespace Invader::File {
      */
     std::optional<std::vector<std::byte>> open_file(const std::filesystem::path &path);
 
+    /**
+     * File mapped into memory. Pages are read from the file as they are accessed, and any changes made to the data
+     * are private to this process and are never written back to the file.
+     */
+    class MappedFile {
+    public:
+        /**
+         * Get the file data
+         * @return file data, or nullptr if the file is empty
+         */
+        std::byte *data() noexcept {
+            return this->file_data;
+        }
+
+        /**
+         * Get the file data
+         * @return file data, or nullptr if the file is empty
+         */
+        const std::byte *data() const noexcept {
+            return this->file_data;
+        }
+
+        /**
+         * Get the size of the file
+         * @return size of the file in bytes
+         */
+        std::size_t size() const noexcept {
+            return this->file_size;
+        }
+
+        MappedFile() noexcept = default;
+        MappedFile(MappedFile &&move) noexcept;
+        MappedFile &operator=(MappedFile &&move) noexcept;
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        ~MappedFile();
+
+    private:
+        friend std::optional<MappedFile> map_file(const std::filesystem::path &path);
+        friend std::optional<MappedFile> map_memory(std::size_t size);
+
+        std::byte *file_data = nullptr;
+        std::size_t file_size = 0;
+
+        void unmap() noexcept;
+    };
+
+    /**
+     * Attempt to map the file into memory. Unlike open_file, this does not read the file up front, and the data is
+     * held by the filesystem cache rather than allocated.
+     * @param path path to the file
+     * @return     the mapped file or std::nullopt if failed
+     */
+    std::optional<MappedFile> map_file(const std::filesystem::path &path);
+
+    /**
+     * Attempt to map zero-filled memory that isn't backed by a file. Pages are only allocated once they are written to,
+     * so this can hold large data that may only be partly filled in.
+     * @param size size of the memory in bytes
+     * @return     the mapped memory or std::nullopt if failed
+     */
+    std::optional<MappedFile> map_memory(std::size_t size);
+
     /**
      * Attempt to save the file
      * @param  path path to the file
@@ -85,7 +85,8 @@ namespace Invader::HEK {
     struct NativeCacheFileHeader {
         enum NativeCacheFileCompressionType : TagEnum {
             NATIVE_CACHE_FILE_COMPRESSION_UNCOMPRESSED = 0,
-            NATIVE_CACHE_FILE_COMPRESSION_ZSTD = 1
+            NATIVE_CACHE_FILE_COMPRESSION_ZSTD = 1,
+            NATIVE_CACHE_FILE_COMPRESSION_ZSTD_SEEKABLE = 2
         };
         
         LittleEndian<CacheFileLiteral> head_literal;
@@ -98,7 +99,10 @@ namespace Invader::HEK {
         LittleEndian<CacheFileType> map_type;
         LittleEndian<NativeCacheFileCompressionType> compression_type;
         LittleEndian<std::uint32_t> crc32;
-        PAD(0x18);
+        LittleEndian<std::uint32_t> frame_size;
+        LittleEndian<std::uint32_t> frame_count;
+        LittleEndian<std::uint64_t> frame_index_offset;
+        PAD(0x8);
         TagString timestamp;
         PAD(0x75C);
         LittleEndian<CacheFileLiteral> foot_literal;
@@ -107,6 +111,16 @@ namespace Invader::HEK {
     };
     static_assert(sizeof(NativeCacheFileHeader) == 0x800);
 
+    /**
+     * Frame of a seekable native map. Each frame is an independent zstd frame holding frame_size bytes of the map
+     * after the header, except for the last frame, which holds the remainder.
+     */
+    struct NativeCacheFileFrame {
+        LittleEndian<std::uint64_t> offset;
+        LittleEndian<std::uint64_t> size;
+    };
+    static_assert(sizeof(NativeCacheFileFrame) == 0x10);
+
     struct CacheFileDemoHeader {
         PAD(0x2);
         LittleEndian<CacheFileType> map_type;
@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef INVADER__JSON_HPP
+#define INVADER__JSON_HPP
+
+#include <string>
+
+namespace Invader {
+    /**
+     * Quote and escape the string for use as a JSON string. Strings are treated as Latin-1 (like tag paths and scenario
+     * names), so anything outside of printable ASCII is escaped as the same code point.
+     * @param string string to escape
+     * @return       JSON string, including quotes
+     */
+    std::string json_string(const std::string &string);
+}
+
+#endif
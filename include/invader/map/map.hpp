@@ -4,12 +4,18 @@
 #define INVADER__MAP__MAP_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <unordered_map>
 #include <cstddef>
 #include <memory>
 #include <optional>
+#include <mutex>
+#include <atomic>
+#include <filesystem>
 
 #include "../resource/resource_map.hpp"
+#include "../file/file.hpp"
 #include "../hek/map.hpp"
 #include "tag.hpp"
 
@@ -117,10 +123,27 @@ namespace Invader {
         }
         
         /**
-         * Calculate the map's CRC32
+         * Calculate the map's CRC32; this is only calculated the first time it is called (or again if it failed)
          * @return crc32
+         * @throws OutOfBoundsException or DecompressionFailureException if the data to check can't be read
          */
-        std::uint32_t get_crc32() const noexcept;
+        std::uint32_t get_crc32() const;
+
+        /**
+         * Set the maximum number of threads to use for calculating the map's CRC32
+         * @param max_threads maximum number of threads, or 0 to use the CPU thread count
+         */
+        void set_crc32_max_threads(std::size_t max_threads) noexcept {
+            this->crc32_max_threads = max_threads;
+        }
+
+        /**
+         * Set the maximum number of threads to use for decompressing MCC-compressed maps as their data is accessed
+         * @param max_threads maximum number of threads, or 0 to use the CPU thread count
+         */
+        void set_decompression_max_threads(std::size_t max_threads) noexcept {
+            this->decompression_max_threads = max_threads;
+        }
 
         /**
          * Get the tag data length
@@ -162,6 +185,53 @@ namespace Invader {
                                  std::vector<std::byte> &&loc_data = std::vector<std::byte>(),
                                  std::vector<std::byte> &&sounds_data = std::vector<std::byte>());
 
+        /**
+         * Create a Map by moving the given data and taking ownership of the given mapped bitmaps, loc, and sound files,
+         * which are read in place rather than copied. Compressed maps can be loaded this way.
+         * @param  data         map data vector
+         * @param  bitmaps_file mapped bitmaps file
+         * @param  loc_file     mapped loc file
+         * @param  sounds_file  mapped sounds file
+         * @return              map
+         */
+        static Map map_with_move(std::vector<std::byte> &&data,
+                                 File::MappedFile &&bitmaps_file,
+                                 File::MappedFile &&loc_file,
+                                 File::MappedFile &&sounds_file);
+
+        /**
+         * Create a Map by taking ownership of the given mapped map, bitmaps, loc, and sound files. Native maps that
+         * were compressed in frames and MCC-compressed maps are only decompressed as their data is accessed, so
+         * reading the header and tags does not require decompressing the whole map. Decompressed data is kept until
+         * the map is destroyed. Other compressed maps are decompressed entirely, and uncompressed maps are read in
+         * place. Tags are read from the tag array as they are accessed rather than when the map is loaded.
+         * @param  data         mapped map file
+         * @param  bitmaps_file mapped bitmaps file
+         * @param  loc_file     mapped loc file
+         * @param  sounds_file  mapped sounds file
+         * @return              map
+         */
+        static Map map_with_lazy_decompression(File::MappedFile &&data,
+                                               File::MappedFile &&bitmaps_file = File::MappedFile(),
+                                               File::MappedFile &&loc_file = File::MappedFile(),
+                                               File::MappedFile &&sounds_file = File::MappedFile());
+
+        /**
+         * Create a Map by mapping the given map and resource map files into memory, reading them in place like
+         * map_with_lazy_decompression(). Opening an uncompressed map only reads the header, and the pages of each
+         * file are shared with the filesystem cache (and any other process that maps the same file).
+         * @param  path         path to the map
+         * @param  bitmaps_path path to the bitmaps map, if any
+         * @param  loc_path     path to the loc map, if any
+         * @param  sounds_path  path to the sounds map, if any
+         * @return              map
+         * @throws              FailedToOpenFileException if a file could not be mapped
+         */
+        static Map map_with_mmap(const std::filesystem::path &path,
+                                 const std::optional<std::filesystem::path> &bitmaps_path = std::nullopt,
+                                 const std::optional<std::filesystem::path> &loc_path = std::nullopt,
+                                 const std::optional<std::filesystem::path> &sounds_path = std::nullopt);
+
         /**
          * Create a Map by using the pointers to the given data, bitmaps, loc, and sound data. The caller is
          * responsible for ensuring that these pointers are valid for the lifespan of the Map. Compressed maps cannot
@@ -185,7 +255,7 @@ namespace Invader {
         /**
          * Get the data at the specified offset
          * @param  offset       offset
-         * @param  minimum_size minimum number of bytes to guarantee
+         * @param  minimum_size minimum number of bytes to guarantee; if 0, everything after the offset is guaranteed
          * @return              pointer to the data
          * @throws              OutOfBoundsException if data is out of bounds
          */
@@ -194,7 +264,7 @@ namespace Invader {
         /**
          * Get the data at the specified offset
          * @param  offset       offset
-         * @param  minimum_size minimum number of bytes to guarantee
+         * @param  minimum_size minimum number of bytes to guarantee; if 0, everything after the offset is guaranteed
          * @return              pointer to the data
          * @throws              OutOfBoundsException if data is out of bounds
          */
@@ -264,7 +334,8 @@ namespace Invader {
         std::size_t get_tag_count() const noexcept;
 
         /**
-         * Get the tag at the specified index
+         * Get the tag at the specified index. If the map reads tags as they are accessed, this reads the tag the first
+         * time it is called, but anything that can fail when reading it is checked when the map is loaded instead.
          * @param index the tag index
          * @return      the tag
          * @throws      OutOfBoundsException if index is invalid
@@ -272,7 +343,8 @@ namespace Invader {
         Tag &get_tag(std::size_t index);
 
         /**
-         * Get the tag at the specified index
+         * Get the tag at the specified index. If the map reads tags as they are accessed, this reads the tag the first
+         * time it is called, but anything that can fail when reading it is checked when the map is loaded instead.
          * @param index the tag index
          * @return      the tag
          * @throws      OutOfBoundsException if index is invalid
@@ -280,13 +352,34 @@ namespace Invader {
         const Tag &get_tag(std::size_t index) const;
 
         /**
-         * Find the tag with the given path and class
+         * Get the path and class of the tag at the specified index. Unlike get_tag(), this doesn't read the rest of the
+         * tag if the map reads tags as they are accessed.
+         * @param index the tag index
+         * @return      the path and class of the tag
+         * @throws      OutOfBoundsException if index is invalid
+         */
+        std::pair<std::string, TagClassInt> get_tag_path_and_class(std::size_t index) const;
+
+        /**
+         * Find the tag with the given path and class. Tags are looked up with a hash table that is built the first
+         * time this is called.
          * @param tag_path      tag path to find
          * @param tag_class_int tag class to find
          * @return              the index of the first tag found or std::nullopt if not found
          */
         std::optional<std::size_t> find_tag(const char *tag_path, TagClassInt tag_class_int) const noexcept;
 
+        /**
+         * Find all tags whose path and extension (e.g. "weapons\pistol\pistol.weapon") match the given pattern, where
+         * ? matches any character, * matches any number of characters, and / and \ match any path separator. Tags are
+         * looked up with a sorted index that is built the first time this is called, so only tags that start with the
+         * part of the pattern before the first wildcard are checked.
+         * @param pattern pattern to match
+         * @return        indices of the tags found in order
+         * @throws        OutOfBoundsException if a tag can't be read
+         */
+        std::vector<std::size_t> find_tags(const char *pattern) const;
+
         /**
          * Get the scenario tag ID
          * @return The scenario tag ID
@@ -307,7 +400,7 @@ namespace Invader {
         
         /**
          * Do a basic check to ensure the map hasn't been improperly modified or corrupted
-         * @return true if the map is clean
+         * @return true if the map is clean, or false if it isn't or if it can't be read
          */
         bool is_clean() const noexcept;
 
@@ -316,6 +409,9 @@ namespace Invader {
         /** Map data if managed */
         std::vector<std::byte> data_m;
 
+        /** Map data if mapped */
+        File::MappedFile data_file_m;
+
         /** Map data */
         std::byte *data = nullptr;
 
@@ -326,6 +422,9 @@ namespace Invader {
         /** Bitmaps data if managed */
         std::vector<std::byte> bitmap_data_m;
 
+        /** Bitmaps file if mapped */
+        File::MappedFile bitmap_file_m;
+
         /** Bitmaps data */
         std::byte *bitmap_data = nullptr;
 
@@ -336,6 +435,9 @@ namespace Invader {
         /** Loc data if managed */
         std::vector<std::byte> loc_data_m;
 
+        /** Loc file if mapped */
+        File::MappedFile loc_file_m;
+
         /** Loc data */
         std::byte *loc_data = nullptr;
 
@@ -346,6 +448,9 @@ namespace Invader {
         /** Sounds data if managed */
         std::vector<std::byte> sound_data_m;
 
+        /** Sounds file if mapped */
+        File::MappedFile sound_file_m;
+
         /** Sounds data */
         std::byte *sound_data = nullptr;
 
@@ -366,6 +471,27 @@ namespace Invader {
         /** Tag array */
         std::vector<Tag> tags;
 
+        /** Read tags from the tag array as they are accessed instead of when the map is loaded */
+        bool populate_tags_lazily = false;
+
+        /** Tags that have been read; this is only set if tags are read as they are accessed */
+        std::unique_ptr<std::once_flag[]> populated_tags;
+
+        struct TagIndexKeyHash {
+            std::size_t operator()(const std::pair<std::string_view, TagClassInt> &key) const noexcept {
+                return std::hash<std::string_view>()(key.first) * 31 + static_cast<std::size_t>(key.second);
+            }
+        };
+
+        /** Lowest tag index for each (path, class) pair; this is built the first time find_tag() is called */
+        mutable std::unordered_map<std::pair<std::string_view, TagClassInt>, std::size_t, TagIndexKeyHash> tag_indices;
+
+        /** Path and extension of each tag (using \ for path separators) and its index, sorted by path and extension */
+        mutable std::vector<std::pair<std::string, std::size_t>> sorted_tag_paths;
+
+        /** Used for building tag_indices and sorted_tag_paths once; these are made when the tag array is populated */
+        std::unique_ptr<std::once_flag> tag_indices_built, sorted_tag_paths_built;
+
         /** Scenario tag ID */
         std::size_t scenario_tag_id = 0;
 
@@ -379,7 +505,7 @@ namespace Invader {
         std::uint32_t base_memory_address = HEK::CACHE_FILE_PC_BASE_MEMORY_ADDRESS;
         
         /** Invalid paths? */
-        bool invalid_paths_detected = false;
+        mutable std::atomic<bool> invalid_paths_detected = false;
 
         /** Map is compressed */
         CompressionType compressed = CompressionType::COMPRESSION_TYPE_NONE;
@@ -396,14 +522,35 @@ namespace Invader {
         /** Build */
         HEK::TagString build;
 
-        /** CRC32 */
-        std::optional<std::uint32_t> crc32;
+        /** CRC32; this is calculated the first time get_crc32() is called */
+        mutable std::uint32_t crc32 = 0;
+
+        /** Maximum number of threads to calculate the CRC32 with, or 0 for the CPU thread count */
+        std::size_t crc32_max_threads = 0;
+
+        /** Maximum number of threads to decompress MCC-compressed data with, or 0 for the CPU thread count */
+        std::size_t decompression_max_threads = 0;
+
+        /** Used for calculating crc32 once; this is made when the map is loaded */
+        std::unique_ptr<std::once_flag> crc32_calculated;
         
         /** CRC32 in header */
         std::uint32_t header_crc32;
 
         /** Asset indices offset */
         std::uint64_t asset_indices_offset;
+
+        /** Compressed map file if frames (or MCC chunks) are decompressed as they are accessed */
+        File::MappedFile compressed_file_m;
+
+        /** Offset of the decompressed data where each frame starts */
+        std::vector<std::size_t> frame_offsets;
+
+        /** Frames that have been decompressed */
+        std::vector<bool> decompressed_frames;
+
+        /** Held while decompressing frames; this is only set if frames are decompressed as they are accessed */
+        std::unique_ptr<std::mutex> decompression_mutex;
         
 
         /** Load the map now */
@@ -412,6 +559,20 @@ namespace Invader {
         /** Populate tag array */
         void populate_tag_array();
 
+        /**
+         * Read the tag from the tag array
+         * @param index the tag index
+         */
+        void populate_tag(std::size_t index);
+
+        /**
+         * Read the path of a tag from the tag array, giving it a placeholder path if it's invalid
+         * @param path_pointer pointer to the path in tag data
+         * @param index        the tag index
+         * @return             the path
+         */
+        std::string read_tag_path(std::uint64_t path_pointer, std::size_t index) const;
+
         /** Get BSPs */
         void get_bsps();
 
@@ -423,6 +584,13 @@ namespace Invader {
          */
         bool decompress_if_needed(const std::byte *data, std::size_t data_size);
 
+        /**
+         * Decompress the frames covering the given range of map data if they haven't been decompressed yet
+         * @param offset offset of the range
+         * @param size   size of the range
+         */
+        void decompress_range_if_needed(std::size_t offset, std::size_t size);
+
         Map() = default;
     };
 }
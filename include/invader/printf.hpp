@@ -119,7 +119,57 @@ else {\
 
 #endif
 
-#define eprintf(...) std::fprintf(stderr, __VA_ARGS__)
+#include <cstdarg>
+#include <string>
+
+namespace Invader {
+    /**
+     * If set, anything printed with eprintf on this thread is appended to this instead of being printed, so work done
+     * on other threads can have its errors and warnings printed by the main thread in order
+     */
+    inline thread_local std::string *eprintf_buffer = nullptr;
+
+    /**
+     * Append to the eprintf buffer, like fprintf
+     * @param  format format string
+     * @return        number of characters appended
+     */
+    inline int eprintf_buffered(const char *format, ...) {
+        std::va_list args, args_copy;
+        va_start(args, format);
+        va_copy(args_copy, args);
+        int length = std::vsnprintf(nullptr, 0, format, args_copy);
+        va_end(args_copy);
+        if(length > 0) {
+            auto &buffer = *eprintf_buffer;
+            std::size_t offset = buffer.size();
+            buffer.resize(offset + length + 1);
+            std::vsnprintf(buffer.data() + offset, length + 1, format, args);
+            buffer.resize(offset + length);
+        }
+        va_end(args);
+        return length;
+    }
+
+    /**
+     * Buffer everything printed with eprintf on this thread until this is destroyed
+     */
+    class EprintfBufferScope {
+    public:
+        EprintfBufferScope(std::string &buffer) noexcept : previous(eprintf_buffer) {
+            eprintf_buffer = &buffer;
+        }
+        ~EprintfBufferScope() {
+            eprintf_buffer = this->previous;
+        }
+        EprintfBufferScope(const EprintfBufferScope &) = delete;
+        EprintfBufferScope &operator=(const EprintfBufferScope &) = delete;
+    private:
+        std::string *previous;
+    };
+}
+
+#define eprintf(...) (Invader::eprintf_buffer ? Invader::eprintf_buffered(__VA_ARGS__) : std::fprintf(stderr, __VA_ARGS__))
 #define oprintf(...) std::fprintf(stdout, __VA_ARGS__)
 #define oflush() std::fflush(stdout)
 
@@ -131,6 +181,18 @@ else {\
 static inline int eprintf(...) {}
 static inline int oprintf(...) {}
 static inline void oflush() {}
+
+#include <string>
+
+namespace Invader {
+    // Nothing is printed, so there's nothing to buffer
+    class EprintfBufferScope {
+    public:
+        EprintfBufferScope(std::string &) noexcept {}
+        EprintfBufferScope(const EprintfBufferScope &) = delete;
+        EprintfBufferScope &operator=(const EprintfBufferScope &) = delete;
+    };
+}
 #endif
 
 #endif
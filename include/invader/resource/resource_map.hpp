@@ -4,24 +4,89 @@
 #define INVADER__RESOURCE__RESOURCE_MAP_HPP
 
 #include <cstddef>
+#include <filesystem>
+#include <optional>
 #include <string>
 #include <vector>
 
+#include "../file/file.hpp"
+
 namespace Invader {
+    /**
+     * Data of a resource. This points into the resource map it was loaded from rather than holding a copy.
+     */
+    class ResourceData {
+    public:
+        const std::byte *data() const noexcept {
+            return this->resource_data;
+        }
+        std::size_t size() const noexcept {
+            return this->resource_size;
+        }
+        const std::byte *begin() const noexcept {
+            return this->resource_data;
+        }
+        const std::byte *end() const noexcept {
+            return this->resource_data + this->resource_size;
+        }
+
+        ResourceData() noexcept = default;
+        ResourceData(const std::byte *data, std::size_t size) noexcept : resource_data(data), resource_size(size) {}
+
+    private:
+        const std::byte *resource_data = nullptr;
+        std::size_t resource_size = 0;
+    };
+
     struct Resource {
         std::string path;
-        std::vector<std::byte> data;
+        ResourceData data;
         std::size_t path_offset;
         std::size_t data_offset;
     };
 
     /**
-     * Return an array of containers for the given resource map
+     * Return an array of containers for the given resource map. The resources point into the given data, so it must
+     * outlive them.
      * @param  data pointer to resource data
      * @param  size size of resource data
      * @return      array of containers
      * @throws      if failed
      */
     std::vector<Resource> load_resource_map(const std::byte *data, std::size_t size);
+
+    /**
+     * Resource map that is mapped into memory along with the resources in it
+     */
+    class ResourceMap {
+    public:
+        /**
+         * Map the resource map at the given path and load its resources
+         * @param  path path to the resource map
+         * @return      resource map, or std::nullopt if it could not be opened
+         * @throws      if the resource map is invalid
+         */
+        static std::optional<ResourceMap> open_resource_map(const std::filesystem::path &path);
+
+        const Resource &operator[](std::size_t index) const noexcept {
+            return this->resources[index];
+        }
+        std::size_t size() const noexcept {
+            return this->resources.size();
+        }
+        std::vector<Resource>::const_iterator begin() const noexcept {
+            return this->resources.begin();
+        }
+        std::vector<Resource>::const_iterator end() const noexcept {
+            return this->resources.end();
+        }
+
+    private:
+        /** Mapped resource map file, which the resources point into */
+        File::MappedFile file;
+
+        /** Resources */
+        std::vector<Resource> resources;
+    };
 }
 #endif
@@ -4,6 +4,11 @@
 #define INVADER__TAG__PARSER__COMPILE__MODEL_HPP
 
 #include <cstdint>
+#include "../../hek/definition.hpp"
+
+namespace Invader {
+    class BuildWorkload;
+}
 
 namespace Invader::Parser {
     struct GBXModel;
@@ -18,6 +23,24 @@ namespace Invader::Parser {
     bool regenerate_missing_model_vertices(ModelGeometryPart &part, Model &model, bool fix);
     bool regenerate_missing_model_vertices(Model &model, bool fix);
     
+    /**
+     * Add triangle indices to the workload's model data, reusing an identical run of indices if one was already added
+     * @param workload workload to add to
+     * @param indices  indices to add
+     * @param count    number of indices
+     * @return         offset of the indices in bytes
+     */
+    std::uint32_t add_model_indices(BuildWorkload &workload, const HEK::Index *indices, std::size_t count);
+
+    /**
+     * Add vertices to the workload's model data, reusing an identical run of vertices if one was already added
+     * @param workload workload to add to
+     * @param vertices vertices to add
+     * @param count    number of vertices
+     * @return         offset of the vertices in bytes
+     */
+    std::uint32_t add_model_vertices(BuildWorkload &workload, const HEK::ModelVertexUncompressed<HEK::LittleEndian> *vertices, std::size_t count);
+    
     enum MaxCompressedModelNodeIndex : std::uint8_t {
         MAX_COMPRESSED_MODEL_NODE_INDEX = static_cast<std::int8_t>(INT8_MAX / 3)
     };
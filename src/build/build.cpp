@@ -5,9 +5,12 @@
 #include <vector>
 #include <cstring>
 #include <filesystem>
+#include <thread>
+#include <map>
+#include <chrono>
+#include <algorithm>
 
 #include <invader/build/build_workload.hpp>
-#include <invader/compress/compression.hpp>
 #include <invader/map/map.hpp>
 #include <invader/version.hpp>
 #include <invader/printf.hpp>
@@ -31,6 +34,44 @@ static std::uint32_t read_str32(const char *err, const char *s) {
     return static_cast<std::uint32_t>(std::strtoul(s, nullptr, 16));
 }
 
+using TagFileTimes = std::map<std::filesystem::path, std::pair<std::filesystem::file_time_type, std::uintmax_t>>;
+
+static TagFileTimes find_tag_files(const std::vector<std::filesystem::path> &tags_directories, const std::optional<std::filesystem::path> &cache_directory) {
+    TagFileTimes tags;
+    for(auto &tags_directory : tags_directories) {
+        std::error_code ec;
+        for(auto i = std::filesystem::recursive_directory_iterator(tags_directory, std::filesystem::directory_options::skip_permission_denied, ec); i != std::filesystem::recursive_directory_iterator(); i.increment(ec)) {
+            if(ec) {
+                break;
+            }
+            
+            // Don't rebuild because the build cache changed
+            if(i->is_directory(ec)) {
+                if(cache_directory.has_value() && std::filesystem::equivalent(i->path(), *cache_directory, ec)) {
+                    i.disable_recursion_pending();
+                }
+                continue;
+            }
+            
+            auto &file = tags[i->path()];
+            file.first = i->last_write_time(ec);
+            file.second = i->file_size(ec);
+        }
+    }
+    return tags;
+}
+
+static TagFileTimes find_file_times(const std::vector<std::filesystem::path> &paths) {
+    TagFileTimes times;
+    for(auto &path : paths) {
+        std::error_code ec;
+        auto &file = times[path];
+        file.first = std::filesystem::last_write_time(path, ec);
+        file.second = std::filesystem::file_size(path, ec);
+    }
+    return times;
+}
+
 int main(int argc, const char **argv) {
     using namespace Invader;
     using namespace Invader::HEK;
@@ -52,9 +93,16 @@ int main(int argc, const char **argv) {
         bool use_filesystem_path = false;
         std::optional<std::string> rename_scenario;
         std::optional<bool> compress;
+        bool long_distance_matching = false;
+        std::size_t frame_size = 0;
         bool optimize_space = false;
         bool hide_pedantic_warnings = false;
         bool mcc = false;
+        std::size_t max_threads = std::thread::hardware_concurrency() < 1 ? 1 : std::thread::hardware_concurrency();
+        std::optional<std::filesystem::path> cache_directory;
+        bool watch = false;
+        std::optional<BuildWorkload::BuildParameters::BuildStatsFormat> stats;
+        std::optional<std::filesystem::path> stats_output;
     } build_options;
 
     std::vector<CommandLineOption> options;
@@ -72,8 +120,15 @@ int main(int argc, const char **argv) {
     options.emplace_back("rename-scenario", 'N', 1, "Rename the scenario.", "<name>");
     options.emplace_back("compress", 'c', 0, "Compress the cache file.");
     options.emplace_back("uncompressed", 'u', 0, "Do not compress the cache file. This is default for demo, retail, and custom engines.");
-    options.emplace_back("optimize", 'O', 0, "Optimize tag space. This will drastically increase the amount of time required to build the cache file.");
+    options.emplace_back("optimize", 'O', 0, "Optimize tag space by deduplicating identical tag data.");
     options.emplace_back("hide-pedantic-warnings", 'H', 0, "Don't show minor warnings.");
+    options.emplace_back("threads", 'j', 1, "Set the number of threads to use for reading and parsing tags and for compressing in parallel. The cache file is the same regardless of thread count. Default: CPU thread count", "<#>");
+    options.emplace_back("long", 'L', 0, "Use long distance matching when compressing with -c. This improves compression of large maps at the cost of memory. This does not apply to MCC compression.");
+    options.emplace_back("frame-size", 'F', 1, "Compress native maps in independent frames of the given size in KiB when compressing with -c, so parts of the map can be read without decompressing all of it. Default: one frame", "<KiB>");
+    options.emplace_back("watch", 'W', 0, "Keep running and rebuild the map whenever a file in the tags directories changes. Resource maps and compiled tags are kept in memory between builds, and resource maps are reopened when they change. The tags directories are rescanned every second, or less often if scanning them is slow.");
+    options.emplace_back("stats", 's', 1, "Show how long each phase of the build and each tag class took, the peak memory usage after each phase, and the slowest tags. Valid formats are: text, json", "<format>");
+    options.emplace_back("stats-output", 'S', 1, "Save the report from --stats to a file instead of showing it. This is required for the json format.", "<file>");
+    options.emplace_back("cache", 'k', 1, "Store compiled tags in the given directory and reuse them on later builds if the tags and build options have not changed.", "<dir>");
 
     static constexpr char DESCRIPTION[] = "Build a cache file for a version of Halo: Combat Evolved.";
     static constexpr char USAGE[] = "[options] -g <target> <scenario>";
@@ -133,6 +188,22 @@ int main(int argc, const char **argv) {
             case 'u':
                 build_options.compress = false;
                 break;
+            case 'L':
+                build_options.long_distance_matching = true;
+                break;
+            case 'F':
+                try {
+                    auto frame_size = std::stoul(arguments[0]);
+                    if(frame_size < 1 || frame_size > UINT32_MAX / 1024) {
+                        throw std::exception();
+                    }
+                    build_options.frame_size = static_cast<std::size_t>(frame_size) * 1024;
+                }
+                catch(std::exception &) {
+                    eprintf_error("Invalid frame size %s\n", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
             case 'P':
                 build_options.use_filesystem_path = true;
                 break;
@@ -149,9 +220,53 @@ int main(int argc, const char **argv) {
             case 'H':
                 build_options.hide_pedantic_warnings = true;
                 break;
+            case 'j':
+                try {
+                    auto max_threads = std::stoi(arguments[0]);
+                    if(max_threads < 1) {
+                        throw std::exception();
+                    }
+                    build_options.max_threads = static_cast<std::size_t>(max_threads);
+                }
+                catch(std::exception &) {
+                    eprintf_error("Invalid number of threads %s\n", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
+            case 'k':
+                build_options.cache_directory = std::string(arguments[0]);
+                break;
+            case 'W':
+                build_options.watch = true;
+                break;
+            case 's':
+                if(std::strcmp(arguments[0], "text") == 0) {
+                    build_options.stats = BuildWorkload::BuildParameters::BuildStatsFormat::BUILD_STATS_FORMAT_TEXT;
+                }
+                else if(std::strcmp(arguments[0], "json") == 0) {
+                    build_options.stats = BuildWorkload::BuildParameters::BuildStatsFormat::BUILD_STATS_FORMAT_JSON;
+                }
+                else {
+                    eprintf_error("Unknown stats format: %s", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
+            case 'S':
+                build_options.stats_output = std::string(arguments[0]);
+                break;
         }
     });
     
+    // The JSON report can't be parsed if it's mixed in with everything else that gets printed
+    if(build_options.stats_output.has_value() && !build_options.stats.has_value()) {
+        eprintf_error("--stats-output requires --stats");
+        return EXIT_FAILURE;
+    }
+    if(build_options.stats == BuildWorkload::BuildParameters::BuildStatsFormat::BUILD_STATS_FORMAT_JSON && !build_options.stats_output.has_value()) {
+        eprintf_error("The json stats format requires --stats-output");
+        return EXIT_FAILURE;
+    }
+    
     std::string scenario;
 
     // By default, just use tags
@@ -226,6 +341,12 @@ int main(int argc, const char **argv) {
         parameters.scenario = scenario;
         parameters.rename_scenario = build_options.rename_scenario;
         parameters.optimize_space = build_options.optimize_space;
+        parameters.max_threads = build_options.max_threads;
+        parameters.long_distance_matching = build_options.long_distance_matching;
+        parameters.frame_size = build_options.frame_size;
+        parameters.cache_directory = build_options.cache_directory;
+        parameters.stats = build_options.stats;
+        parameters.stats_output = build_options.stats_output;
         parameters.forge_crc = build_options.forged_crc;
         parameters.index = with_index;
         
@@ -266,19 +387,20 @@ int main(int argc, const char **argv) {
             parameters.details.build_raw_data_handling = *build_options.raw_data_handling;
         }
         
-        // Load resource maps
+        // Load resource maps, keeping track of where they came from so they can be reopened if they change
+        std::vector<std::pair<std::filesystem::path, std::optional<ResourceMap> *>> resource_maps;
         if(require_resource_maps) {
             // Check if we have a custom_* resource maps or not (Custom Edition only)
             bool error = false;
             
-            auto try_open = [](const std::filesystem::path &path) {
-                auto file = File::open_file(path);
-                if(!file.has_value()) {
-                    eprintf_error("Failed to open %s", path.string().c_str());
-                    std::exit(EXIT_FAILURE);
-                }
+            auto try_open = [&resource_maps](const std::filesystem::path &path, std::optional<ResourceMap> &resource_map) {
                 try {
-                    return load_resource_map(file->data(), file->size());
+                    resource_map = ResourceMap::open_resource_map(path);
+                    if(!resource_map.has_value()) {
+                        eprintf_error("Failed to open %s", path.string().c_str());
+                        std::exit(EXIT_FAILURE);
+                    }
+                    resource_maps.emplace_back(path, &resource_map);
                 }
                 catch(std::exception &e) {
                     eprintf_error("Failed to read %s: %s", path.string().c_str(), e.what());
@@ -308,9 +430,9 @@ int main(int argc, const char **argv) {
                     goto show_me_the_spaghetti_code_error;
                 }
                 
-                parameters.bitmap_data = try_open(bitmaps);
-                parameters.sound_data = try_open(sounds);
-                parameters.loc_data = try_open(loc);
+                try_open(bitmaps, parameters.bitmap_data);
+                try_open(sounds, parameters.sound_data);
+                try_open(loc, parameters.loc_data);
             }
             else {
                 // Do it!
@@ -324,8 +446,8 @@ int main(int argc, const char **argv) {
                     goto show_me_the_spaghetti_code_error;
                 }
                 
-                parameters.bitmap_data = try_open(bitmaps);
-                parameters.sound_data = try_open(sounds);
+                try_open(bitmaps, parameters.bitmap_data);
+                try_open(sounds, parameters.sound_data);
             }
             
             show_me_the_spaghetti_code_error:
@@ -436,9 +558,6 @@ int main(int argc, const char **argv) {
             }
         }
 
-        // Build!
-        auto map = Invader::BuildWorkload::compile_map(parameters);
-        
         static const char MAP_EXTENSION[] = ".map"; 
         auto map_name_with_extension = std::string(map_name) + MAP_EXTENSION;
 
@@ -483,42 +602,115 @@ int main(int argc, const char **argv) {
             }
         }
         
-        // Save the file
-        if(!File::save_file(final_file, map)) {
-            eprintf_error("Failed to save %s", final_file.string().c_str());
-            return EXIT_FAILURE;
+        // Build! The map is written straight to the file.
+        auto build_map = [&parameters, &final_file, &build_options, &map_name]() {
+            auto uncompressed_file_size = Invader::BuildWorkload::compile_map(parameters, final_file);
+            
+            // Make an fmeta?
+            if(build_options.mcc) {
+                auto fmeta_path = std::filesystem::path(final_file).replace_extension(".fmeta");
+                
+                std::vector<std::byte> new_fmeta(0x4408);
+                
+                // Set these ints
+                *reinterpret_cast<HEK::LittleEndian<std::uint64_t> *>(new_fmeta.data() + 0x0) = 2;
+                *reinterpret_cast<HEK::LittleEndian<std::uint64_t> *>(new_fmeta.data() + 0x110) = UINT64_MAX;
+                *reinterpret_cast<HEK::LittleEndian<std::uint32_t> *>(new_fmeta.data() + 0x21C) = 1;
+                *reinterpret_cast<HEK::LittleEndian<std::uint64_t> *>(new_fmeta.data() + 0x220) = uncompressed_file_size;
+                
+                // Set this... or bad things happen
+                std::snprintf(reinterpret_cast<char *>(new_fmeta.data() + 0x118), 37, "%s.map", map_name.c_str());
+                
+                if(!File::save_file(fmeta_path, new_fmeta)) {
+                    eprintf_error("Failed to save %s", fmeta_path.string().c_str());
+                    return false;
+                }
+            }
+            
+            return true;
+        };
+        
+        if(!build_options.watch) {
+            return build_map() ? EXIT_SUCCESS : EXIT_FAILURE;
         }
         
-        // Make an fmeta?
-        if(build_options.mcc) {
-            auto fmeta_path = final_file.replace_extension(".fmeta");
-            
-            std::vector<std::byte> new_fmeta(0x4408);
+        // Otherwise, keep everything loaded and rebuild when something changes
+        BuildWorkload::BuildCacheMemory cache_memory;
+        parameters.cache_memory = &cache_memory;
+        
+        // Scanning reads the size and modification time of every file in the tags directories, so on large tags
+        // directories, wait longer between scans to keep it to a small fraction of the time spent waiting
+        std::vector<std::filesystem::path> resource_map_paths;
+        for(auto &resource_map : resource_maps) {
+            resource_map_paths.emplace_back(resource_map.first);
+        }
+        auto scan_time = std::chrono::steady_clock::duration::zero();
+        auto scan = [&build_options, &resource_map_paths, &scan_time]() {
+            auto start = std::chrono::steady_clock::now();
+            auto files = find_tag_files(build_options.tags, build_options.cache_directory);
+            files.merge(find_file_times(resource_map_paths));
+            scan_time = std::chrono::steady_clock::now() - start;
+            return files;
+        };
+        auto wait_for_next_scan = [&scan_time](std::chrono::steady_clock::duration minimum) {
+            std::this_thread::sleep_for(std::max(minimum, scan_time * 10));
+        };
+        
+        auto files = scan();
+        auto resource_map_times = find_file_times(resource_map_paths);
+        while(true) {
+            // Reopen any resource map that changed. The old mapping can't be used anymore, since reading a file that
+            // was overwritten in place while mapped can crash.
+            auto new_resource_map_times = find_file_times(resource_map_paths);
+            for(auto &[path, resource_map] : resource_maps) {
+                if(new_resource_map_times[path] == resource_map_times[path]) {
+                    continue;
+                }
+                resource_map->reset();
+                try {
+                    *resource_map = ResourceMap::open_resource_map(path);
+                    if(!resource_map->has_value()) {
+                        eprintf_error("Failed to open %s", path.string().c_str());
+                    }
+                }
+                catch(std::exception &e) {
+                    eprintf_error("Failed to read %s: %s", path.string().c_str(), e.what());
+                }
+            }
+            resource_map_times = std::move(new_resource_map_times);
             
-            // Get the uncompressed size
-            std::uint64_t uncompressed_file_size;
-            if(parameters.details.build_compress) {
-                uncompressed_file_size = *Compression::ceaflate_compression_size(map.data(), map.size());
+            bool resource_maps_open = std::all_of(resource_maps.begin(), resource_maps.end(), [](auto &resource_map) { return resource_map.second->has_value(); });
+            if(!resource_maps_open) {
+                eprintf_error("Not rebuilding until the resource maps can be read.");
             }
             else {
-                uncompressed_file_size = map.size();
+                try {
+                    build_map();
+                }
+                catch(std::exception &exception) {
+                    eprintf_error("Failed to compile the map.");
+                    eprintf_error("%s", exception.what());
+                }
             }
             
-            // Set these ints
-            *reinterpret_cast<HEK::LittleEndian<std::uint64_t> *>(new_fmeta.data() + 0x0) = 2;
-            *reinterpret_cast<HEK::LittleEndian<std::uint64_t> *>(new_fmeta.data() + 0x110) = UINT64_MAX;
-            *reinterpret_cast<HEK::LittleEndian<std::uint32_t> *>(new_fmeta.data() + 0x21C) = 1;
-            *reinterpret_cast<HEK::LittleEndian<std::uint64_t> *>(new_fmeta.data() + 0x220) = uncompressed_file_size;
+            oprintf("Waiting for changes...\n");
+            oflush();
             
-            // Set this... or bad things happen
-            std::snprintf(reinterpret_cast<char *>(new_fmeta.data() + 0x118), 37, "%s.map", map_name.c_str());
-            
-            if(!File::save_file(fmeta_path, new_fmeta)) {
-                eprintf_error("Failed to save %s", fmeta_path.string().c_str());
-                return EXIT_FAILURE;
+            // Wait until something changes, and then wait for it to stop changing so we don't build while a tag is still being saved
+            while(true) {
+                wait_for_next_scan(std::chrono::seconds(1));
+                auto new_files = scan();
+                if(new_files != files) {
+                    do {
+                        files = std::move(new_files);
+                        wait_for_next_scan(std::chrono::milliseconds(500));
+                        new_files = scan();
+                    }
+                    while(new_files != files);
+                    break;
+                }
             }
         }
-
         return EXIT_SUCCESS;
     }
     catch(std::exception &exception) {
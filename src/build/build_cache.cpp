@@ -0,0 +1,843 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cstring>
+#include <invader/file/file.hpp>
+#include <invader/printf.hpp>
+#include <invader/error.hpp>
+#include <invader/version.hpp>
+#include <invader/tag/parser/compile/model.hpp>
+#include "build_cache.hpp"
+
+namespace Invader {
+    static constexpr std::uint64_t BUILD_CACHE_RECORD_MAGIC = 0x48434143564E49; // "INVCACH"
+    static constexpr std::uint32_t BUILD_CACHE_RECORD_VERSION = 1;
+
+    /**
+     * Hash used for tag files and cache records. This has to give the same result every time, so std::hash can't be used.
+     */
+    class BuildCacheHash {
+    public:
+        BuildCacheHash &add(const void *data, std::size_t size) noexcept {
+            auto *bytes = reinterpret_cast<const std::uint8_t *>(data);
+            std::size_t words = size / sizeof(std::uint64_t);
+            for(std::size_t w = 0; w < words; w++) {
+                std::uint64_t word;
+                std::memcpy(&word, bytes + w * sizeof(word), sizeof(word));
+                this->hash = rotate_left(this->hash ^ (word * PRIME_2), 31) * PRIME_1;
+            }
+            for(std::size_t b = words * sizeof(std::uint64_t); b < size; b++) {
+                this->hash = rotate_left(this->hash ^ (bytes[b] * PRIME_1), 11) * PRIME_2;
+            }
+            this->length += size;
+            return *this;
+        }
+
+        template <typename T> BuildCacheHash &add_value(const T &value) noexcept {
+            return this->add(&value, sizeof(value));
+        }
+
+        BuildCacheHash &add_string(const std::string &value) noexcept {
+            return this->add_value(static_cast<std::uint64_t>(value.size())).add(value.data(), value.size());
+        }
+
+        std::uint64_t get() const noexcept {
+            std::uint64_t h = this->hash ^ this->length;
+            h ^= h >> 33;
+            h *= PRIME_2;
+            h ^= h >> 29;
+            h *= PRIME_1;
+            h ^= h >> 32;
+            return h;
+        }
+
+    private:
+        static constexpr std::uint64_t PRIME_1 = 0x9E3779B185EBCA87;
+        static constexpr std::uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4F;
+        std::uint64_t hash = 0x27D4EB2F165667C5;
+        std::uint64_t length = 0;
+
+        static std::uint64_t rotate_left(std::uint64_t value, int bits) noexcept {
+            return (value << bits) | (value >> (64 - bits));
+        }
+    };
+
+    class BuildCacheRecordWriter {
+    public:
+        std::vector<std::byte> data;
+
+        template <typename T> void write(T value) {
+            auto *bytes = reinterpret_cast<const std::byte *>(&value);
+            this->data.insert(this->data.end(), bytes, bytes + sizeof(value));
+        }
+
+        void write_bytes(const void *bytes, std::size_t size) {
+            this->write(static_cast<std::uint64_t>(size));
+            this->data.insert(this->data.end(), reinterpret_cast<const std::byte *>(bytes), reinterpret_cast<const std::byte *>(bytes) + size);
+        }
+
+        void write_string(const std::string &value) {
+            this->write_bytes(value.data(), value.size());
+        }
+    };
+
+    class BuildCacheRecordReader {
+    public:
+        BuildCacheRecordReader(const std::vector<std::byte> &data) noexcept : data(data) {}
+
+        template <typename T> bool read(T &value) noexcept {
+            if(this->data.size() - this->offset < sizeof(value)) {
+                return false;
+            }
+            std::memcpy(&value, this->data.data() + this->offset, sizeof(value));
+            this->offset += sizeof(value);
+            return true;
+        }
+
+        bool read_size(std::size_t &value) noexcept {
+            std::uint64_t value_read;
+            if(!this->read(value_read) || value_read > SIZE_MAX) {
+                return false;
+            }
+            value = static_cast<std::size_t>(value_read);
+            return true;
+        }
+
+        bool read_count(std::size_t &value) noexcept {
+            // Every element takes at least one byte, so a count larger than what's left is garbage
+            std::uint32_t value_read;
+            if(!this->read(value_read) || value_read > this->data.size() - this->offset) {
+                return false;
+            }
+            value = value_read;
+            return true;
+        }
+
+        bool read_bytes(void *bytes, std::size_t size) noexcept {
+            if(this->data.size() - this->offset < size) {
+                return false;
+            }
+            std::memcpy(bytes, this->data.data() + this->offset, size);
+            this->offset += size;
+            return true;
+        }
+
+        bool read_bytes(std::vector<std::byte> &value) {
+            std::size_t size;
+            if(!this->read_size(size) || this->data.size() - this->offset < size) {
+                return false;
+            }
+            value.assign(this->data.begin() + this->offset, this->data.begin() + this->offset + size);
+            this->offset += size;
+            return true;
+        }
+
+        bool read_string(std::string &value) {
+            std::size_t size;
+            if(!this->read_size(size) || this->data.size() - this->offset < size) {
+                return false;
+            }
+            value.assign(reinterpret_cast<const char *>(this->data.data() + this->offset), size);
+            this->offset += size;
+            return true;
+        }
+
+        bool read_class(TagClassInt &value) noexcept {
+            std::uint32_t value_read;
+            if(!this->read(value_read)) {
+                return false;
+            }
+            value = static_cast<TagClassInt>(value_read);
+            return true;
+        }
+
+        bool at_end() const noexcept {
+            return this->offset == this->data.size();
+        }
+
+    private:
+        const std::vector<std::byte> &data;
+        std::size_t offset = 0;
+    };
+
+    /**
+     * Get whether a tag class can be loaded from the cache
+     * @param tag_class_int tag class
+     * @return              true if it can be loaded
+     */
+    static bool cacheable_tag_class(TagClassInt tag_class_int) noexcept {
+        switch(tag_class_int) {
+            // Scenarios modify other tags and use the other tags' data when compiling them
+            case TagClassInt::TAG_CLASS_SCENARIO:
+
+            // Globals modify the sound tags they reference
+            case TagClassInt::TAG_CLASS_GLOBALS:
+
+            // These objects add pathfinding spheres to the collision models they reference
+            case TagClassInt::TAG_CLASS_BIPED:
+            case TagClassInt::TAG_CLASS_SCENERY:
+            case TagClassInt::TAG_CLASS_DEVICE_MACHINE:
+
+            // Collision models can be modified by the objects that reference them after they're compiled
+            case TagClassInt::TAG_CLASS_MODEL_COLLISION_GEOMETRY:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    /**
+     * Find the structs and offsets of the geometry parts of a compiled model
+     * @param structs     structs to look in
+     * @param base_struct index of the model's base struct
+     * @param parts       set to the struct index and offset of each part
+     * @return            true if all of the parts were found
+     */
+    template <typename Model, typename ModelGeometry, typename ModelGeometryPart> static bool find_model_parts(const std::vector<BuildWorkload::BuildWorkloadStruct> &structs, std::size_t base_struct, std::vector<std::pair<std::size_t, std::size_t>> &parts) {
+        auto &model_struct = structs[base_struct];
+        if(model_struct.data.size() < sizeof(Model)) {
+            return false;
+        }
+        auto &model = *reinterpret_cast<const Model *>(model_struct.data.data());
+        std::size_t geometry_count = model.geometries.count.read();
+        if(geometry_count == 0) {
+            return true;
+        }
+
+        auto geometries_struct_index = model_struct.resolve_pointer(&model.geometries.pointer);
+        if(!geometries_struct_index.has_value() || structs[*geometries_struct_index].data.size() < sizeof(ModelGeometry) * geometry_count) {
+            return false;
+        }
+        auto &geometries_struct = structs[*geometries_struct_index];
+        auto *geometries = reinterpret_cast<const ModelGeometry *>(geometries_struct.data.data());
+
+        for(std::size_t g = 0; g < geometry_count; g++) {
+            std::size_t part_count = geometries[g].parts.count.read();
+            if(part_count == 0) {
+                continue;
+            }
+
+            auto parts_struct_index = geometries_struct.resolve_pointer(&geometries[g].parts.pointer);
+            if(!parts_struct_index.has_value() || structs[*parts_struct_index].data.size() < sizeof(ModelGeometryPart) * part_count) {
+                return false;
+            }
+            for(std::size_t p = 0; p < part_count; p++) {
+                parts.emplace_back(*parts_struct_index, p * sizeof(ModelGeometryPart));
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Get the ID of a dependency in a struct
+     * @param data       struct data
+     * @param dependency dependency
+     * @return           tag ID
+     */
+    static HEK::LittleEndian<HEK::TagID> &dependency_tag_id(std::byte *data, const BuildWorkload::BuildWorkloadDependency &dependency) noexcept {
+        if(dependency.tag_id_only) {
+            return *reinterpret_cast<HEK::LittleEndian<HEK::TagID> *>(data + dependency.offset);
+        }
+        else {
+            return reinterpret_cast<HEK::TagDependency<HEK::LittleEndian> *>(data + dependency.offset)->tag_id;
+        }
+    }
+
+    BuildWorkload::BuildCache::BuildCache(BuildWorkload &workload) : workload(workload) {
+        auto &directory = workload.parameters->cache_directory;
+        if(directory.has_value()) {
+            std::error_code ec;
+            std::filesystem::create_directories(*directory, ec);
+            if(!std::filesystem::is_directory(*directory, ec)) {
+                eprintf_error("Failed to create cache directory %s", directory->string().c_str());
+                throw FailedToOpenFileException();
+            }
+        }
+    }
+
+    bool BuildWorkload::BuildCache::begin_tag(std::size_t tag_index, const std::byte *tag_data, std::size_t tag_data_size) {
+        auto tag_path = this->workload.tags[tag_index].path;
+        auto tag_class_int = this->workload.tags[tag_index].tag_class_int;
+        auto file_hash = BuildCacheHash().add(tag_data, tag_data_size).get();
+
+        if(cacheable_tag_class(tag_class_int) && this->validate(tag_path, tag_class_int, file_hash).has_value()) {
+            auto &validation = this->validations[this->record_key(tag_path, tag_class_int, file_hash)];
+            if(validation.record) {
+                auto record = std::move(validation.record);
+                if(this->load(tag_index, file_hash, *record)) {
+                    return true;
+                }
+            }
+        }
+
+        this->push_frame(tag_index, file_hash);
+        if(tag_class_int == TagClassInt::TAG_CLASS_SCENARIO_STRUCTURE_BSP) {
+            this->frames.back().bsp = this->workload.bsp_count;
+        }
+        return false;
+    }
+
+    void BuildWorkload::BuildCache::end_tag(std::size_t tag_index) {
+        auto frame = this->pop_frame();
+        auto &tag = this->workload.tags[tag_index];
+        this->workload.uncached_tag_count++;
+
+        // If we know what every referenced tag was built from, we know what this tag was built from
+        BuildCacheHash hash;
+        hash.add_value(this->settings_hash()).add_value(frame.file_hash).add_string(tag.path).add_value(tag.tag_class_int);
+        std::vector<Request> requests;
+        requests.reserve(frame.requests.size());
+        for(auto &[path, requested_class_int, request_index] : frame.requests) {
+            auto request_build_hash = this->get_build_hash(request_index);
+            if(!request_build_hash.has_value()) {
+                return;
+            }
+            auto &request = requests.emplace_back();
+            request.path = path;
+            request.requested_class_int = requested_class_int;
+            request.tag_class_int = this->workload.tags[request_index].tag_class_int;
+            request.build_hash = *request_build_hash;
+            hash.add_string(request.path).add_value(request.requested_class_int).add_value(request.tag_class_int).add_value(request.build_hash);
+        }
+
+        auto build_hash = hash.get();
+        if(this->build_hashes.size() <= tag_index) {
+            this->build_hashes.resize(tag_index + 1);
+        }
+        this->build_hashes[tag_index] = build_hash;
+
+        if(cacheable_tag_class(tag.tag_class_int)) {
+            this->save(frame, build_hash, requests);
+        }
+    }
+
+    void BuildWorkload::BuildCache::add_request(const std::string &tag_path, TagClassInt tag_class_int, std::size_t tag_index) {
+        if(!this->frames.empty()) {
+            this->frames.back().requests.emplace_back(tag_path, tag_class_int, tag_index);
+        }
+    }
+
+    void BuildWorkload::BuildCache::push_frame(std::size_t tag_index, std::uint64_t file_hash) {
+        auto &frame = this->frames.emplace_back();
+        frame.tag_index = tag_index;
+        frame.file_hash = file_hash;
+        frame.first_struct = this->workload.structs.size();
+        frame.errors = this->workload.get_errors();
+        frame.warnings = this->workload.get_warnings();
+    }
+
+    BuildWorkload::BuildCache::Frame BuildWorkload::BuildCache::pop_frame() {
+        auto frame = std::move(this->frames.back());
+        this->frames.pop_back();
+
+        // Anything made or reported while doing this tag belongs to this tag and not the tag that referenced it
+        if(!this->frames.empty()) {
+            auto &parent = this->frames.back();
+            parent.nested.emplace_back(frame.first_struct, this->workload.structs.size());
+            parent.nested_errors += this->workload.get_errors() - frame.errors;
+            parent.nested_warnings += this->workload.get_warnings() - frame.warnings;
+        }
+
+        return frame;
+    }
+
+    std::uint64_t BuildWorkload::BuildCache::settings_hash() const {
+        auto &details = this->workload.parameters->details;
+        auto &cache_file_type = this->workload.cache_file_type;
+
+        BuildCacheHash hash;
+        hash.add_value(BUILD_CACHE_RECORD_VERSION);
+        hash.add_string(full_version());
+        hash.add_value(details.build_cache_file_engine);
+        hash.add_value(details.build_tag_data_address);
+        hash.add_value(details.build_maximum_tag_space);
+        hash.add_value(details.build_maximum_cache_file_size);
+        hash.add_value(details.build_compress);
+        hash.add_value(details.build_compress_mcc);
+        hash.add_value(details.build_bsps_occupy_tag_space);
+        hash.add_value(details.build_raw_data_handling);
+        hash.add_value(cache_file_type.has_value());
+        hash.add_value(cache_file_type.value_or(HEK::CacheFileType::SCENARIO_TYPE_SINGLEPLAYER));
+        hash.add_value(this->workload.building_stock_map);
+        hash.add_value(this->workload.get_reporting_level());
+        return hash.get();
+    }
+
+    std::uint64_t BuildWorkload::BuildCache::record_key(const std::string &tag_path, TagClassInt tag_class_int, std::uint64_t file_hash) const {
+        return BuildCacheHash().add_value(this->settings_hash()).add_string(tag_path).add_value(tag_class_int).add_value(file_hash).get();
+    }
+
+    std::filesystem::path BuildWorkload::BuildCache::record_path(std::uint64_t key) const {
+        char file_name[32];
+        std::snprintf(file_name, sizeof(file_name), "%016llx.cache", static_cast<unsigned long long>(key));
+        return *this->workload.parameters->cache_directory / file_name;
+    }
+
+    std::optional<std::vector<std::byte>> BuildWorkload::BuildCache::read_record(std::uint64_t key) const {
+        auto *memory = this->workload.parameters->cache_memory;
+        if(memory) {
+            auto record = memory->records.find(key);
+            if(record != memory->records.end()) {
+                return record->second;
+            }
+        }
+        if(this->workload.parameters->cache_directory.has_value()) {
+            return File::open_file(this->record_path(key));
+        }
+        return std::nullopt;
+    }
+
+    void BuildWorkload::BuildCache::write_record(std::uint64_t key, const std::string &tag_path, TagClassInt tag_class_int, std::vector<std::byte> &&record_data) {
+        if(this->workload.parameters->cache_directory.has_value()) {
+            // Write to a temporary file first so a cancelled build doesn't leave a broken record
+            auto path = this->record_path(key);
+            auto temp_path = path;
+            temp_path += ".tmp";
+            std::error_code ec;
+            if(File::save_file(temp_path, record_data)) {
+                std::filesystem::rename(temp_path, path, ec);
+                if(ec) {
+                    std::filesystem::remove(path, ec);
+                    std::filesystem::rename(temp_path, path, ec);
+                }
+            }
+            std::filesystem::remove(temp_path, ec);
+        }
+
+        // Only keep the latest version of each tag in memory
+        auto *memory = this->workload.parameters->cache_memory;
+        if(memory) {
+            auto &latest_record = memory->latest_records[tag_path + "." + tag_class_to_extension(tag_class_int)];
+            if(latest_record != key) {
+                memory->records.erase(latest_record);
+                latest_record = key;
+            }
+            memory->records[key] = std::move(record_data);
+        }
+    }
+
+    std::optional<std::uint64_t> BuildWorkload::BuildCache::get_build_hash(std::size_t tag_index) const noexcept {
+        if(tag_index >= this->build_hashes.size()) {
+            return std::nullopt;
+        }
+        return this->build_hashes[tag_index];
+    }
+
+    std::optional<std::uint64_t> BuildWorkload::BuildCache::validate(const std::string &tag_path, TagClassInt tag_class_int, std::uint64_t file_hash) {
+        auto key = this->record_key(tag_path, tag_class_int, file_hash);
+        auto [validation_it, inserted] = this->validations.try_emplace(key);
+        auto &validation = validation_it->second;
+        if(!inserted) {
+            return validation.in_progress ? std::nullopt : validation.build_hash;
+        }
+
+        // Read the record
+        auto record = std::make_unique<Record>();
+        bool valid = false;
+        auto record_data = this->read_record(key);
+        if(record_data.has_value()) {
+            BuildCacheRecordReader reader(*record_data);
+            std::uint64_t magic;
+            std::uint32_t version;
+            std::uint8_t compiled = 0;
+            std::size_t request_count;
+            valid = reader.read(magic) && magic == BUILD_CACHE_RECORD_MAGIC &&
+                    reader.read(version) && version == BUILD_CACHE_RECORD_VERSION &&
+                    reader.read_string(record->path) && record->path == tag_path &&
+                    reader.read_class(record->tag_class_int) && record->tag_class_int == tag_class_int &&
+                    reader.read(record->file_hash) && record->file_hash == file_hash &&
+                    reader.read(record->build_hash) &&
+                    reader.read_count(request_count);
+
+            for(std::size_t r = 0; valid && r < request_count; r++) {
+                auto &request = record->requests.emplace_back();
+                valid = reader.read_string(request.path) && reader.read_class(request.requested_class_int) && reader.read_class(request.tag_class_int) && reader.read(request.build_hash);
+            }
+
+            valid = valid && reader.read(compiled);
+            record->compiled = compiled;
+
+            if(valid && record->compiled) {
+                std::size_t reference_count, struct_count, asset_count, part_count;
+                std::uint8_t has_bsp = 0;
+                std::uint64_t bsp = 0;
+                valid = reader.read_count(reference_count);
+                for(std::size_t r = 0; valid && r < reference_count; r++) {
+                    auto &reference = record->references.emplace_back();
+                    valid = reader.read_string(reference.path) && reader.read_class(reference.tag_class_int) && reader.read_size(reference.tag_index);
+                }
+
+                valid = valid && reader.read_size(record->base_struct) && reader.read(has_bsp) && reader.read(bsp) && reader.read_count(struct_count) && record->base_struct < struct_count;
+                if(valid && has_bsp) {
+                    record->bsp = bsp;
+                }
+
+                for(std::size_t s = 0; valid && s < struct_count; s++) {
+                    auto &new_struct = record->structs.emplace_back();
+                    std::uint8_t unsafe_to_dedupe = 0, struct_has_bsp = 0;
+                    std::uint64_t struct_bsp = 0;
+                    std::size_t dependency_count, pointer_count;
+                    valid = reader.read_bytes(new_struct.data) && reader.read(unsafe_to_dedupe) && reader.read(struct_has_bsp) && reader.read(struct_bsp) && reader.read_count(dependency_count);
+                    new_struct.unsafe_to_dedupe = unsafe_to_dedupe;
+                    new_struct.bsp = struct_has_bsp ? std::optional<std::size_t>(struct_bsp) : std::nullopt;
+
+                    for(std::size_t d = 0; valid && d < dependency_count; d++) {
+                        auto &dependency = new_struct.dependencies.emplace_back();
+                        std::uint32_t reference = 0;
+                        std::uint8_t tag_id_only = 0;
+                        valid = reader.read(reference) && reader.read_size(dependency.offset) && reader.read(tag_id_only) && reference < reference_count;
+                        dependency.tag_index = reference;
+                        dependency.tag_id_only = tag_id_only;
+                        std::size_t dependency_size = dependency.tag_id_only ? sizeof(HEK::LittleEndian<HEK::TagID>) : sizeof(HEK::TagDependency<HEK::LittleEndian>);
+                        valid = valid && dependency.offset <= new_struct.data.size() && new_struct.data.size() - dependency.offset >= dependency_size;
+                    }
+
+                    valid = valid && reader.read_count(pointer_count);
+                    for(std::size_t p = 0; valid && p < pointer_count; p++) {
+                        auto &pointer = new_struct.pointers.emplace_back();
+                        std::uint8_t limit_to_32_bits = 0;
+                        valid = reader.read_size(pointer.struct_index) && reader.read_size(pointer.offset) && reader.read(limit_to_32_bits) && pointer.struct_index < struct_count;
+                        pointer.limit_to_32_bits = limit_to_32_bits;
+                    }
+                }
+
+                valid = valid && reader.read_count(asset_count);
+                for(std::size_t a = 0; valid && a < asset_count; a++) {
+                    valid = reader.read_bytes(record->assets.emplace_back());
+                }
+
+                valid = valid && reader.read_count(part_count);
+                for(std::size_t p = 0; valid && p < part_count; p++) {
+                    auto &part = record->model_parts.emplace_back();
+                    std::size_t index_count, vertex_count;
+                    valid = reader.read_size(part.struct_index) && reader.read_size(part.offset) && part.struct_index < struct_count &&
+                            part.offset <= record->structs[part.struct_index].data.size() &&
+                            record->structs[part.struct_index].data.size() - part.offset >= sizeof(HEK::ModelGeometryPart<HEK::LittleEndian>) &&
+                            reader.read_count(index_count) && index_count > 0;
+                    if(valid) {
+                        part.indices.resize(index_count);
+                        valid = reader.read_bytes(part.indices.data(), index_count * sizeof(part.indices[0])) && reader.read_count(vertex_count);
+                    }
+                    if(valid) {
+                        part.vertices.resize(vertex_count);
+                        valid = reader.read_bytes(part.vertices.data(), vertex_count * sizeof(part.vertices[0]));
+                    }
+                }
+            }
+
+            valid = valid && reader.at_end();
+        }
+
+        // Check that everything it referenced is the same, too
+        if(valid) {
+            BuildCacheHash hash;
+            hash.add_value(this->settings_hash()).add_value(file_hash).add_string(tag_path).add_value(tag_class_int);
+            for(auto &request : record->requests) {
+                if(this->requested_build_hash(request.path, request.requested_class_int, request.tag_class_int) != request.build_hash) {
+                    valid = false;
+                    break;
+                }
+                hash.add_string(request.path).add_value(request.requested_class_int).add_value(request.tag_class_int).add_value(request.build_hash);
+            }
+            valid = valid && hash.get() == record->build_hash;
+        }
+
+        if(valid) {
+            validation.build_hash = record->build_hash;
+            if(record->compiled) {
+                validation.record = std::move(record);
+            }
+        }
+        validation.in_progress = false;
+        return validation.build_hash;
+    }
+
+    std::optional<std::uint64_t> BuildWorkload::BuildCache::requested_build_hash(const std::string &tag_path, TagClassInt requested_class_int, TagClassInt tag_class_int) {
+        // If it's already been compiled or loaded, we know it already
+        auto find_compiled_tag = [this, &tag_path](TagClassInt find_class_int) -> std::optional<std::size_t> {
+            auto tag_index = this->workload.find_tag(tag_path, find_class_int);
+            if(tag_index.has_value() && this->workload.tags[*tag_index].base_struct.has_value()) {
+                return tag_index;
+            }
+            return std::nullopt;
+        };
+        auto existing_tag = find_compiled_tag(requested_class_int);
+        if(!existing_tag.has_value() && requested_class_int == TagClassInt::TAG_CLASS_OBJECT) {
+            existing_tag = find_compiled_tag(tag_class_int);
+        }
+        if(existing_tag.has_value()) {
+            if(this->workload.tags[*existing_tag].tag_class_int != tag_class_int) {
+                return std::nullopt;
+            }
+            return this->get_build_hash(*existing_tag);
+        }
+
+        // Otherwise, look it up
+        char formatted_path[256];
+        auto found_class_int = requested_class_int;
+        auto file_path = BuildWorkload::find_tag_file(tag_path.c_str(), found_class_int, this->workload.parameters->tags_directories, formatted_path);
+        if(!file_path.has_value() || found_class_int != tag_class_int) {
+            return std::nullopt;
+        }
+        auto file_data = File::open_file(*file_path);
+        if(!file_data.has_value()) {
+            return std::nullopt;
+        }
+        return this->validate(tag_path, tag_class_int, BuildCacheHash().add(file_data->data(), file_data->size()).get());
+    }
+
+    bool BuildWorkload::BuildCache::load(std::size_t tag_index, std::uint64_t file_hash, Record &record) {
+        auto &workload = this->workload;
+        this->push_frame(tag_index, file_hash);
+
+        std::optional<std::size_t> bsp;
+        if(record.bsp.has_value()) {
+            bsp = workload.bsp_count++;
+        }
+
+        // Reference everything in the same order as when it was compiled so everything gets the same tag index
+        bool loaded = true;
+        for(auto &request : record.requests) {
+            auto request_index = workload.compile_tag_recursively(request.path.c_str(), request.requested_class_int);
+            if(workload.tags[request_index].tag_class_int != request.tag_class_int || this->get_build_hash(request_index) != request.build_hash) {
+                loaded = false;
+                break;
+            }
+        }
+
+        std::vector<std::size_t> reference_indices;
+        reference_indices.reserve(record.references.size());
+        for(std::size_t r = 0; loaded && r < record.references.size(); r++) {
+            auto &reference = record.references[r];
+            auto reference_index = workload.find_tag(reference.path, reference.tag_class_int);
+            if(!reference_index.has_value()) {
+                loaded = false;
+                break;
+            }
+            reference_indices.emplace_back(*reference_index);
+        }
+
+        // If something changed anyway, it'll have to be compiled
+        if(!loaded) {
+            if(bsp.has_value() && workload.bsp_count == *bsp + 1) {
+                workload.bsp_count = *bsp;
+            }
+            this->pop_frame();
+            return false;
+        }
+
+        // Add the structs
+        std::size_t first_struct = workload.structs.size();
+        workload.structs.reserve(first_struct + record.structs.size());
+        for(auto &s : record.structs) {
+            auto &new_struct = workload.structs.emplace_back(std::move(s));
+            for(auto &dependency : new_struct.dependencies) {
+                std::size_t old_index = record.references[dependency.tag_index].tag_index;
+                std::size_t new_index = reference_indices[dependency.tag_index];
+                auto &tag_id = dependency_tag_id(new_struct.data.data(), dependency);
+                HEK::TagID id = tag_id.read();
+                if((id.id & 0xFFFF) == old_index) {
+                    id.id = (id.id & 0xFFFF0000) | static_cast<std::uint16_t>(new_index);
+                    tag_id = id;
+                }
+                dependency.tag_index = new_index;
+            }
+            for(auto &pointer : new_struct.pointers) {
+                pointer.struct_index += first_struct;
+            }
+            if(bsp.has_value() && new_struct.bsp == record.bsp) {
+                new_struct.bsp = bsp;
+            }
+        }
+
+        auto &tag = workload.tags[tag_index];
+        tag.base_struct = first_struct + record.base_struct;
+
+        // Add the assets
+        for(auto &asset : record.assets) {
+            tag.asset_data.emplace_back(workload.raw_data.size());
+            workload.raw_data.emplace_back(std::move(asset));
+        }
+
+        // Add the model data. Adding it again instead of storing offsets lets it be deduped against everything else in the map.
+        for(auto &part : record.model_parts) {
+            auto &part_data = *reinterpret_cast<HEK::ModelGeometryPart<HEK::LittleEndian> *>(workload.structs[first_struct + part.struct_index].data.data() + part.offset);
+            part_data.triangle_offset = Parser::add_model_indices(workload, part.indices.data(), part.indices.size());
+            part_data.triangle_offset_2 = part_data.triangle_offset.read();
+            part_data.vertex_offset = Parser::add_model_vertices(workload, part.vertices.data(), part.vertices.size());
+            workload.part_count++;
+        }
+
+        this->pop_frame();
+        if(this->build_hashes.size() <= tag_index) {
+            this->build_hashes.resize(tag_index + 1);
+        }
+        this->build_hashes[tag_index] = record.build_hash;
+        workload.cached_tag_count++;
+        return true;
+    }
+
+    void BuildWorkload::BuildCache::save(const Frame &frame, std::uint64_t build_hash, const std::vector<Request> &requests) {
+        auto &workload = this->workload;
+        auto &tag = workload.tags[frame.tag_index];
+
+        BuildCacheRecordWriter writer;
+        writer.write(BUILD_CACHE_RECORD_MAGIC);
+        writer.write(BUILD_CACHE_RECORD_VERSION);
+        writer.write_string(tag.path);
+        writer.write(static_cast<std::uint32_t>(tag.tag_class_int));
+        writer.write(frame.file_hash);
+        writer.write(build_hash);
+        writer.write(static_cast<std::uint32_t>(requests.size()));
+        for(auto &request : requests) {
+            writer.write_string(request.path);
+            writer.write(static_cast<std::uint32_t>(request.requested_class_int));
+            writer.write(static_cast<std::uint32_t>(request.tag_class_int));
+            writer.write(request.build_hash);
+        }
+
+        // Tags with errors or warnings are compiled every time so the warnings still show up
+        std::size_t errors = workload.get_errors() - frame.errors - frame.nested_errors;
+        std::size_t warnings = workload.get_warnings() - frame.warnings - frame.nested_warnings;
+        bool compiled = errors == 0 && warnings == 0 && tag.base_struct.has_value();
+
+        // Find which structs belong to this tag
+        std::size_t struct_count = workload.structs.size();
+        std::vector<std::size_t> own_structs;
+        std::vector<std::size_t> local_indices(struct_count - frame.first_struct, SIZE_MAX);
+        auto nested = frame.nested.begin();
+        for(std::size_t s = frame.first_struct; compiled && s < struct_count; s++) {
+            while(nested != frame.nested.end() && s >= nested->second) {
+                nested++;
+            }
+            if(nested != frame.nested.end() && s >= nested->first) {
+                s = nested->second - 1;
+                continue;
+            }
+            local_indices[s - frame.first_struct] = own_structs.size();
+            own_structs.emplace_back(s);
+        }
+        auto local_index = [&frame, &local_indices, &struct_count](std::size_t struct_index) -> std::optional<std::size_t> {
+            if(struct_index < frame.first_struct || struct_index >= struct_count || local_indices[struct_index - frame.first_struct] == SIZE_MAX) {
+                return std::nullopt;
+            }
+            return local_indices[struct_index - frame.first_struct];
+        };
+
+        // Any tag it references has to be found the same way when it's loaded
+        std::vector<std::size_t> references;
+        std::vector<std::uint32_t> reference_of_tag;
+        auto reference = [&workload, &references, &reference_of_tag](std::size_t tag_index) -> std::optional<std::uint32_t> {
+            auto &reference_tag = workload.tags[tag_index];
+            if(workload.find_tag(reference_tag.path, reference_tag.tag_class_int) != tag_index) {
+                return std::nullopt;
+            }
+            if(reference_of_tag.size() <= tag_index) {
+                reference_of_tag.resize(tag_index + 1, UINT32_MAX);
+            }
+            if(reference_of_tag[tag_index] == UINT32_MAX) {
+                reference_of_tag[tag_index] = static_cast<std::uint32_t>(references.size());
+                references.emplace_back(tag_index);
+            }
+            return reference_of_tag[tag_index];
+        };
+
+        BuildCacheRecordWriter struct_writer;
+        for(std::size_t s = 0; compiled && s < own_structs.size(); s++) {
+            auto &own_struct = workload.structs[own_structs[s]];
+            struct_writer.write_bytes(own_struct.data.data(), own_struct.data.size());
+            struct_writer.write(static_cast<std::uint8_t>(own_struct.unsafe_to_dedupe));
+            struct_writer.write(static_cast<std::uint8_t>(own_struct.bsp.has_value()));
+            struct_writer.write(static_cast<std::uint64_t>(own_struct.bsp.value_or(0)));
+            struct_writer.write(static_cast<std::uint32_t>(own_struct.dependencies.size()));
+            for(auto &dependency : own_struct.dependencies) {
+                auto dependency_reference = reference(dependency.tag_index);
+                if(!dependency_reference.has_value()) {
+                    compiled = false;
+                    break;
+                }
+                struct_writer.write(*dependency_reference);
+                struct_writer.write(static_cast<std::uint64_t>(dependency.offset));
+                struct_writer.write(static_cast<std::uint8_t>(dependency.tag_id_only));
+            }
+            struct_writer.write(static_cast<std::uint32_t>(own_struct.pointers.size()));
+            for(auto &pointer : own_struct.pointers) {
+                auto pointer_index = local_index(pointer.struct_index);
+                if(!pointer_index.has_value()) {
+                    compiled = false;
+                    break;
+                }
+                struct_writer.write(static_cast<std::uint64_t>(*pointer_index));
+                struct_writer.write(static_cast<std::uint64_t>(pointer.offset));
+                struct_writer.write(static_cast<std::uint8_t>(pointer.limit_to_32_bits));
+            }
+        }
+
+        // Find the model parts so the vertices and indices can be stored with them
+        std::vector<std::pair<std::size_t, std::size_t>> model_parts;
+        if(compiled) {
+            switch(tag.tag_class_int) {
+                case TagClassInt::TAG_CLASS_GBXMODEL:
+                    compiled = find_model_parts<Parser::GBXModel::struct_little, Parser::GBXModelGeometry::struct_little, Parser::GBXModelGeometryPart::struct_little>(workload.structs, *tag.base_struct, model_parts);
+                    break;
+                case TagClassInt::TAG_CLASS_MODEL:
+                    compiled = find_model_parts<Parser::Model::struct_little, Parser::ModelGeometry::struct_little, Parser::ModelGeometryPart::struct_little>(workload.structs, *tag.base_struct, model_parts);
+                    break;
+                default:
+                    break;
+            }
+        }
+        for(auto &part : model_parts) {
+            if(!local_index(part.first).has_value()) {
+                compiled = false;
+                break;
+            }
+        }
+
+        auto base_struct = compiled ? local_index(*tag.base_struct) : std::nullopt;
+        compiled = base_struct.has_value();
+
+        // If it can't be loaded, keep the build hash anyway so tags that reference this tag can still be loaded
+        writer.write(static_cast<std::uint8_t>(compiled));
+        if(compiled) {
+            writer.write(static_cast<std::uint32_t>(references.size()));
+            for(auto &r : references) {
+                writer.write_string(workload.tags[r].path);
+                writer.write(static_cast<std::uint32_t>(workload.tags[r].tag_class_int));
+                writer.write(static_cast<std::uint64_t>(r));
+            }
+
+            writer.write(static_cast<std::uint64_t>(*base_struct));
+            writer.write(static_cast<std::uint8_t>(frame.bsp.has_value()));
+            writer.write(static_cast<std::uint64_t>(frame.bsp.value_or(0)));
+            writer.write(static_cast<std::uint32_t>(own_structs.size()));
+            writer.data.insert(writer.data.end(), struct_writer.data.begin(), struct_writer.data.end());
+
+            writer.write(static_cast<std::uint32_t>(tag.asset_data.size()));
+            for(auto &a : tag.asset_data) {
+                auto &asset = workload.raw_data[a];
+                writer.write_bytes(asset.data(), asset.size());
+            }
+
+            writer.write(static_cast<std::uint32_t>(model_parts.size()));
+            for(auto &[part_struct, part_offset] : model_parts) {
+                auto &part = *reinterpret_cast<const HEK::ModelGeometryPart<HEK::LittleEndian> *>(workload.structs[part_struct].data.data() + part_offset);
+                std::size_t index_offset = part.triangle_offset.read() / sizeof(workload.model_indices[0]);
+                std::size_t index_count = part.triangle_count.read() + 2;
+                std::size_t vertex_offset = part.vertex_offset.read() / sizeof(workload.model_vertices[0]);
+                std::size_t vertex_count = part.vertex_count.read();
+
+                writer.write(static_cast<std::uint64_t>(*local_index(part_struct)));
+                writer.write(static_cast<std::uint64_t>(part_offset));
+                writer.write(static_cast<std::uint32_t>(index_count));
+                for(std::size_t i = 0; i < index_count; i++) {
+                    writer.write(static_cast<HEK::Index>(workload.model_indices[index_offset + i]));
+                }
+                writer.write(static_cast<std::uint32_t>(vertex_count));
+                writer.data.insert(writer.data.end(), reinterpret_cast<const std::byte *>(workload.model_vertices.data() + vertex_offset), reinterpret_cast<const std::byte *>(workload.model_vertices.data() + vertex_offset + vertex_count));
+            }
+        }
+
+        this->write_record(this->record_key(tag.path, tag.tag_class_int, frame.file_hash), tag.path, tag.tag_class_int, std::move(writer.data));
+    }
+}
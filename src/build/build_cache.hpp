@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef INVADER__BUILD__BUILD_CACHE_HPP
+#define INVADER__BUILD__BUILD_CACHE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <invader/build/build_workload.hpp>
+
+namespace Invader {
+    /**
+     * Stores compiled tags on disk so later builds can skip compiling tags that have not changed.
+     *
+     * Each tag gets a build hash made from its file, the build options, and the build hashes of every tag it referenced
+     * (in the order they were referenced). A tag whose file and references all have the same build hashes is loaded by
+     * referencing the same tags in the same order and then appending its structs, so tag indices and struct order match
+     * what compiling it would have done.
+     */
+    struct BuildWorkload::BuildCache {
+        /**
+         * Use the cache directory and/or cache memory in the workload's build parameters, creating the directory if needed
+         * @param workload workload to cache tags for
+         */
+        BuildCache(BuildWorkload &workload);
+
+        /**
+         * Load the tag from the cache if possible. Otherwise, start recording the tag so it can be cached once it is
+         * compiled, in which case end_tag must be called after it is compiled.
+         * @param tag_index     index of the tag
+         * @param tag_data      tag file data
+         * @param tag_data_size size of the tag file data
+         * @return              true if the tag was loaded from the cache
+         */
+        bool begin_tag(std::size_t tag_index, const std::byte *tag_data, std::size_t tag_data_size);
+
+        /**
+         * Finish recording the tag and store it in the cache if it can be cached
+         * @param tag_index index of the tag
+         */
+        void end_tag(std::size_t tag_index);
+
+        /**
+         * Record that the tag being compiled referenced a tag
+         * @param tag_path      path of the referenced tag
+         * @param tag_class_int class the tag was referenced as
+         * @param tag_index     index of the referenced tag
+         */
+        void add_request(const std::string &tag_path, TagClassInt tag_class_int, std::size_t tag_index);
+
+    private:
+        /** Tag referenced by a cached tag */
+        struct Request {
+            /** Path of the tag */
+            std::string path;
+
+            /** Class the tag was referenced as */
+            TagClassInt requested_class_int;
+
+            /** Class of the tag that was found */
+            TagClassInt tag_class_int;
+
+            /** Build hash of the tag */
+            std::uint64_t build_hash;
+        };
+
+        /** Tag whose ID is stored in a cached tag */
+        struct Reference {
+            /** Path of the tag */
+            std::string path;
+
+            /** Class of the tag */
+            TagClassInt tag_class_int;
+
+            /** Index of the tag when it was cached */
+            std::size_t tag_index;
+        };
+
+        /** Model part in a cached tag */
+        struct ModelPart {
+            /** Index of the struct the part is in */
+            std::size_t struct_index;
+
+            /** Offset of the part in the struct */
+            std::size_t offset;
+
+            /** Triangle indices of the part */
+            std::vector<HEK::Index> indices;
+
+            /** Vertices of the part */
+            std::vector<Parser::ModelVertexUncompressed::struct_little> vertices;
+        };
+
+        /** Cached tag */
+        struct Record {
+            std::string path;
+            TagClassInt tag_class_int;
+            std::uint64_t file_hash;
+            std::uint64_t build_hash;
+            std::vector<Request> requests;
+
+            /** If false, only the build hash was cached, and the tag has to be compiled */
+            bool compiled;
+
+            /** Structs with dependency tag indices being indices of references and struct indices being relative to the first struct */
+            std::vector<BuildWorkloadStruct> structs;
+            std::vector<Reference> references;
+            std::size_t base_struct;
+            std::optional<std::size_t> bsp;
+            std::vector<std::vector<std::byte>> assets;
+            std::vector<ModelPart> model_parts;
+        };
+
+        /** Result of looking up a tag in the cache */
+        struct Validation {
+            /** The tag is being looked up; used for references that loop back */
+            bool in_progress = true;
+
+            /** Build hash if the record is still valid */
+            std::optional<std::uint64_t> build_hash;
+
+            /** Record to load, if it can be loaded and hasn't been loaded yet */
+            std::unique_ptr<Record> record;
+        };
+
+        /** Tag being compiled or loaded */
+        struct Frame {
+            std::size_t tag_index;
+            std::uint64_t file_hash;
+
+            /** Index of the first struct made while compiling the tag */
+            std::size_t first_struct;
+
+            /** Ranges of structs made by other tags while compiling the tag */
+            std::vector<std::pair<std::size_t, std::size_t>> nested;
+
+            /** Tags referenced by the tag as path, class, and index */
+            std::vector<std::tuple<std::string, TagClassInt, std::size_t>> requests;
+
+            std::size_t errors;
+            std::size_t warnings;
+            std::size_t nested_errors = 0;
+            std::size_t nested_warnings = 0;
+
+            /** BSP index of the tag if it's a BSP */
+            std::optional<std::size_t> bsp;
+        };
+
+        BuildWorkload &workload;
+
+        /** Build hash of each tag, if known */
+        std::vector<std::optional<std::uint64_t>> build_hashes;
+
+        /** Tags currently being compiled or loaded */
+        std::vector<Frame> frames;
+
+        /** Records that were looked up, keyed by record key */
+        std::unordered_map<std::uint64_t, Validation> validations;
+
+        void push_frame(std::size_t tag_index, std::uint64_t file_hash);
+        Frame pop_frame();
+        std::uint64_t settings_hash() const;
+        std::uint64_t record_key(const std::string &tag_path, TagClassInt tag_class_int, std::uint64_t file_hash) const;
+        std::filesystem::path record_path(std::uint64_t key) const;
+        std::optional<std::vector<std::byte>> read_record(std::uint64_t key) const;
+        void write_record(std::uint64_t key, const std::string &tag_path, TagClassInt tag_class_int, std::vector<std::byte> &&record_data);
+        std::optional<std::uint64_t> get_build_hash(std::size_t tag_index) const noexcept;
+        std::optional<std::uint64_t> validate(const std::string &tag_path, TagClassInt tag_class_int, std::uint64_t file_hash);
+        std::optional<std::uint64_t> requested_build_hash(const std::string &tag_path, TagClassInt requested_class_int, TagClassInt tag_class_int);
+        bool load(std::size_t tag_index, std::uint64_t file_hash, Record &record);
+        void save(const Frame &frame, std::uint64_t build_hash, const std::vector<Request> &requests);
+    };
+}
+
+#endif
@@ -0,0 +1,274 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cstdarg>
+#include <map>
+#include <string>
+#include <invader/file/file.hpp>
+#include <invader/json.hpp>
+#include <invader/printf.hpp>
+#include "build_stats.hpp"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#define SLOWEST_TAG_COUNT 10
+
+namespace Invader {
+    using clock = std::chrono::steady_clock;
+
+    static double to_ms(clock::duration duration) noexcept {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    static std::optional<std::uint64_t> peak_memory_usage() noexcept {
+        #ifndef _WIN32
+        struct rusage usage;
+        if(getrusage(RUSAGE_SELF, &usage) == 0) {
+            #ifdef __APPLE__
+            return static_cast<std::uint64_t>(usage.ru_maxrss);
+            #else
+            return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+            #endif
+        }
+        #endif
+        return std::nullopt;
+    }
+
+    // Format and append to the string, like sprintf
+    static void appendf(std::string &string, const char *format, ...) {
+        std::va_list args, args_copy;
+        va_start(args, format);
+        va_copy(args_copy, args);
+        int length = std::vsnprintf(nullptr, 0, format, args_copy);
+        va_end(args_copy);
+        if(length > 0) {
+            std::size_t offset = string.size();
+            string.resize(offset + length + 1);
+            std::vsnprintf(string.data() + offset, length + 1, format, args);
+            string.resize(offset + length);
+        }
+        va_end(args);
+    }
+
+    BuildWorkload::BuildStats::BuildStats(BuildWorkload &workload) : workload(workload) {}
+
+    void BuildWorkload::CompileStepTimer::begin(std::size_t tag_index, CompileStep step) {
+        this->workload.stats->begin_step(tag_index, step);
+    }
+
+    void BuildWorkload::CompileStepTimer::end() {
+        this->workload.stats->end_step();
+    }
+
+    void BuildWorkload::BuildStats::begin_phase(const char *name) {
+        auto &phase = this->phases.emplace_back();
+        phase.name = name;
+        this->phase_start = clock::now();
+    }
+
+    void BuildWorkload::BuildStats::end_phase() {
+        auto &phase = this->phases.back();
+        phase.time = clock::now() - this->phase_start;
+        phase.peak_memory = peak_memory_usage();
+    }
+
+    void BuildWorkload::BuildStats::add_step_time(const Step &step, clock::time_point now) {
+        if(step.tag_index >= this->tag_times.size()) {
+            this->tag_times.resize(step.tag_index + 1);
+        }
+        auto &times = this->tag_times[step.tag_index];
+        times.steps[step.step] += now - step.resumed;
+        times.compiled = true;
+    }
+
+    void BuildWorkload::BuildStats::add_step_time(std::size_t tag_index, CompileStep step, clock::duration time) {
+        if(tag_index >= this->tag_times.size()) {
+            this->tag_times.resize(tag_index + 1);
+        }
+        this->tag_times[tag_index].steps[step] += time;
+    }
+
+    void BuildWorkload::BuildStats::begin_step(std::size_t tag_index, CompileStep step) {
+        auto now = clock::now();
+        if(!this->steps.empty()) {
+            this->add_step_time(this->steps.back(), now);
+        }
+        this->steps.push_back({ tag_index, step, now });
+    }
+
+    void BuildWorkload::BuildStats::end_step() {
+        auto now = clock::now();
+        this->add_step_time(this->steps.back(), now);
+        this->steps.pop_back();
+        if(!this->steps.empty()) {
+            this->steps.back().resumed = now;
+        }
+    }
+
+    void BuildWorkload::BuildStats::print_report() const {
+        std::string report;
+        switch(*this->workload.parameters->stats) {
+            case BuildParameters::BuildStatsFormat::BUILD_STATS_FORMAT_TEXT:
+                report = this->text_report();
+                break;
+            case BuildParameters::BuildStatsFormat::BUILD_STATS_FORMAT_JSON:
+                report = this->json_report();
+                break;
+        }
+
+        // Saving it keeps the report from being mixed in with everything else that gets printed
+        auto &output = this->workload.parameters->stats_output;
+        if(output.has_value()) {
+            auto *report_data = reinterpret_cast<const std::byte *>(report.data());
+            if(!File::save_file(*output, std::vector<std::byte>(report_data, report_data + report.size()))) {
+                eprintf_error("Failed to save the stats report to %s", output->string().c_str());
+            }
+        }
+        else {
+            oprintf("%s", report.c_str());
+        }
+    }
+
+    namespace {
+        struct TagClassStats {
+            TagClassInt tag_class_int;
+            std::size_t count = 0;
+            std::array<clock::duration, BuildWorkload::COMPILE_STEP_COUNT> steps = {};
+            clock::duration total = {};
+        };
+
+        struct TagStats {
+            std::size_t tag_index;
+            clock::duration total;
+        };
+
+        template<typename TagTimes> clock::duration total_time(const TagTimes &times) {
+            clock::duration total = {};
+            for(auto &t : times.steps) {
+                total += t;
+            }
+            return total;
+        }
+
+        // Add up the time per tag class (slowest first), and find the slowest tags
+        template<typename TagTimes> std::pair<std::vector<TagClassStats>, std::vector<TagStats>> summarize_tags(const std::vector<BuildWorkload::BuildWorkloadTag> &tags, const std::vector<TagTimes> &tag_times) {
+            std::map<TagClassInt, TagClassStats> classes;
+            std::vector<TagStats> slowest_tags;
+            for(std::size_t t = 0; t < tag_times.size() && t < tags.size(); t++) {
+                auto &times = tag_times[t];
+                if(!times.compiled) {
+                    continue;
+                }
+                auto tag_class_int = tags[t].tag_class_int;
+                auto &c = classes[tag_class_int];
+                c.tag_class_int = tag_class_int;
+                c.count++;
+                for(std::size_t s = 0; s < times.steps.size(); s++) {
+                    c.steps[s] += times.steps[s];
+                }
+                auto total = total_time(times);
+                c.total += total;
+                slowest_tags.push_back({ t, total });
+            }
+
+            std::vector<TagClassStats> sorted_classes;
+            sorted_classes.reserve(classes.size());
+            for(auto &c : classes) {
+                sorted_classes.push_back(c.second);
+            }
+            std::stable_sort(sorted_classes.begin(), sorted_classes.end(), [](auto &a, auto &b) { return a.total > b.total; });
+
+            std::stable_sort(slowest_tags.begin(), slowest_tags.end(), [](auto &a, auto &b) { return a.total > b.total; });
+            if(slowest_tags.size() > SLOWEST_TAG_COUNT) {
+                slowest_tags.resize(SLOWEST_TAG_COUNT);
+            }
+
+            return { sorted_classes, slowest_tags };
+        }
+
+        std::string tag_path(const BuildWorkload::BuildWorkloadTag &tag) {
+            return File::halo_path_to_preferred_path(tag.path) + "." + HEK::tag_class_to_extension(tag.tag_class_int);
+        }
+    }
+
+    std::string BuildWorkload::BuildStats::text_report() const {
+        std::string report;
+        appendf(report, "\n%-32s %12s %18s\n", "Phase", "Time (ms)", "Peak memory (MiB)");
+        for(auto &phase : this->phases) {
+            if(phase.peak_memory.has_value()) {
+                appendf(report, "%-32s %12.03f %18.02f\n", phase.name, to_ms(phase.time), *phase.peak_memory / 1024.0 / 1024.0);
+            }
+            else {
+                appendf(report, "%-32s %12.03f %18s\n", phase.name, to_ms(phase.time), "N/A");
+            }
+        }
+
+        auto [classes, slowest_tags] = summarize_tags(this->workload.tags, this->tag_times);
+
+        appendf(report, "\n%-32s %6s %12s %12s %12s %12s %12s\n", "Tag class", "Tags", "Parse", "Pre-compile", "Post-compile", "Other", "Total (ms)");
+        for(auto &c : classes) {
+            appendf(report, "%-32s %6zu %12.03f %12.03f %12.03f %12.03f %12.03f\n",
+                    HEK::tag_class_to_extension(c.tag_class_int),
+                    c.count,
+                    to_ms(c.steps[COMPILE_STEP_PARSE]),
+                    to_ms(c.steps[COMPILE_STEP_PRE_COMPILE]),
+                    to_ms(c.steps[COMPILE_STEP_POST_COMPILE]),
+                    to_ms(c.steps[COMPILE_STEP_COMPILE]),
+                    to_ms(c.total));
+        }
+
+        appendf(report, "\nSlowest tags (ms):\n");
+        for(auto &t : slowest_tags) {
+            appendf(report, "%12.03f  %s\n", to_ms(t.total), tag_path(this->workload.tags[t.tag_index]).c_str());
+        }
+        return report;
+    }
+
+    std::string BuildWorkload::BuildStats::json_report() const {
+        std::string report;
+        appendf(report, "{\n    \"phases\": [");
+        for(std::size_t p = 0; p < this->phases.size(); p++) {
+            auto &phase = this->phases[p];
+            appendf(report, "%s\n        { \"name\": %s, \"time_ms\": %.03f, \"peak_memory_bytes\": ", p ? "," : "", json_string(phase.name).c_str(), to_ms(phase.time));
+            if(phase.peak_memory.has_value()) {
+                appendf(report, "%llu }", static_cast<unsigned long long>(*phase.peak_memory));
+            }
+            else {
+                appendf(report, "null }");
+            }
+        }
+
+        auto [classes, slowest_tags] = summarize_tags(this->workload.tags, this->tag_times);
+
+        appendf(report, "\n    ],\n    \"tag_classes\": [");
+        for(std::size_t c = 0; c < classes.size(); c++) {
+            auto &tag_class = classes[c];
+            appendf(report, "%s\n        { \"class\": \"%s\", \"count\": %zu, \"parse_ms\": %.03f, \"pre_compile_ms\": %.03f, \"post_compile_ms\": %.03f, \"other_ms\": %.03f, \"total_ms\": %.03f }",
+                    c ? "," : "",
+                    HEK::tag_class_to_extension(tag_class.tag_class_int),
+                    tag_class.count,
+                    to_ms(tag_class.steps[COMPILE_STEP_PARSE]),
+                    to_ms(tag_class.steps[COMPILE_STEP_PRE_COMPILE]),
+                    to_ms(tag_class.steps[COMPILE_STEP_POST_COMPILE]),
+                    to_ms(tag_class.steps[COMPILE_STEP_COMPILE]),
+                    to_ms(tag_class.total));
+        }
+
+        appendf(report, "\n    ],\n    \"slowest_tags\": [");
+        for(std::size_t t = 0; t < slowest_tags.size(); t++) {
+            auto &steps = this->tag_times[slowest_tags[t].tag_index].steps;
+            appendf(report, "%s\n        { \"path\": %s, \"parse_ms\": %.03f, \"pre_compile_ms\": %.03f, \"post_compile_ms\": %.03f, \"other_ms\": %.03f, \"total_ms\": %.03f }",
+                    t ? "," : "",
+                    json_string(tag_path(this->workload.tags[slowest_tags[t].tag_index])).c_str(),
+                    to_ms(steps[COMPILE_STEP_PARSE]),
+                    to_ms(steps[COMPILE_STEP_PRE_COMPILE]),
+                    to_ms(steps[COMPILE_STEP_POST_COMPILE]),
+                    to_ms(steps[COMPILE_STEP_COMPILE]),
+                    to_ms(slowest_tags[t].total));
+        }
+        appendf(report, "\n    ]\n}\n");
+        return report;
+    }
+}
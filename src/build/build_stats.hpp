@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef INVADER__BUILD__BUILD_STATS_HPP
+#define INVADER__BUILD__BUILD_STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include <invader/build/build_workload.hpp>
+
+namespace Invader {
+    /**
+     * Records how long each phase of the build and each step of compiling each tag took for the --stats report
+     */
+    struct BuildWorkload::BuildStats {
+        using clock = std::chrono::steady_clock;
+
+        /**
+         * Record stats for the workload
+         * @param workload workload to record stats for
+         */
+        BuildStats(BuildWorkload &workload);
+
+        /**
+         * Run the function as a phase of the build, recording how long it took and the peak memory usage after it
+         * @param stats    stats to record to, if any
+         * @param name     name of the phase
+         * @param function function to run
+         * @return         whatever the function returns
+         */
+        template<typename F> static auto time_phase(BuildStats *stats, const char *name, F &&function) {
+            if(!stats) {
+                return function();
+            }
+            stats->begin_phase(name);
+            struct EndPhase {
+                BuildStats &stats;
+                ~EndPhase() {
+                    stats.end_phase();
+                }
+            } end_phase = { *stats };
+            return function();
+        }
+
+        /**
+         * Start a step of compiling a tag, pausing the step currently being timed, if any
+         * @param tag_index index of the tag
+         * @param step      step being done
+         */
+        void begin_step(std::size_t tag_index, CompileStep step);
+
+        /**
+         * End the most recently started step, resuming the step before it, if any
+         */
+        void end_step();
+
+        /**
+         * Add time spent on a step of compiling a tag that was done elsewhere (such as parsing it on another thread)
+         * @param tag_index index of the tag
+         * @param step      step that was done
+         * @param time      time it took
+         */
+        void add_step_time(std::size_t tag_index, CompileStep step, clock::duration time);
+
+        /**
+         * Print the report in the format given in the build parameters, or save it to the stats output file if one was
+         * given
+         */
+        void print_report() const;
+
+    private:
+        /** Phase of the build */
+        struct Phase {
+            const char *name;
+            clock::duration time;
+
+            /** Peak memory usage of the process in bytes at the end of the phase, if it can be determined */
+            std::optional<std::uint64_t> peak_memory;
+        };
+
+        /** Step being timed */
+        struct Step {
+            std::size_t tag_index;
+            CompileStep step;
+
+            /** When the step was started or last resumed */
+            clock::time_point resumed;
+        };
+
+        /** Time spent on each step of compiling a tag */
+        struct TagTimes {
+            std::array<clock::duration, COMPILE_STEP_COUNT> steps = {};
+
+            /** The tag was compiled or loaded from the build cache */
+            bool compiled = false;
+        };
+
+        BuildWorkload &workload;
+        std::vector<Phase> phases;
+        clock::time_point phase_start;
+        std::vector<Step> steps;
+
+        /** Time spent on each step of each tag, indexed by tag index */
+        std::vector<TagTimes> tag_times;
+
+        void begin_phase(const char *name);
+        void end_phase();
+        void add_step_time(const Step &step, clock::time_point now);
+        std::string text_report() const;
+        std::string json_report() const;
+    };
+}
+
+#endif
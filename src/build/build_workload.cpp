@@ -2,6 +2,15 @@
 
 #include <ctime>
 #include <cstdio>
+#include <algorithm>
+#include <string_view>
+#include <map>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
 
 #include <invader/build/build_workload.hpp>
 #include <invader/hek/map.hpp>
@@ -14,6 +23,8 @@
 #include <invader/tag/parser/compile/bitmap.hpp>
 #include <invader/tag/parser/compile/sound.hpp>
 #include "../crc/crc32.h"
+#include "build_cache.hpp"
+#include "build_stats.hpp"
 
 namespace Invader {
     using namespace HEK;
@@ -74,6 +85,268 @@ namespace Invader {
     #define TAG_DATA_HEADER_STRUCT (structs[0])
     #define TAG_ARRAY_STRUCT (structs[1])
 
+    std::optional<std::filesystem::path> BuildWorkload::find_tag_file(const char *tag_path, TagClassInt &tag_class_int, const std::vector<std::filesystem::path> &tags_directories, char (&formatted_path)[256]) {
+        auto try_class = [&tag_path, &tags_directories, &formatted_path](TagClassInt try_class_int) {
+            std::snprintf(formatted_path, sizeof(formatted_path), "%s.%s", tag_path, tag_class_to_extension(try_class_int));
+            Invader::File::halo_path_to_preferred_path_chars(formatted_path);
+            return Invader::File::tag_path_to_file_path(formatted_path, tags_directories, true);
+        };
+
+        if(tag_class_int != TagClassInt::TAG_CLASS_OBJECT) {
+            return try_class(tag_class_int);
+        }
+
+        // Object references can be any of these, so try each one in order
+        static constexpr TagClassInt OBJECT_TAG_CLASSES[] = {
+            TagClassInt::TAG_CLASS_BIPED,
+            TagClassInt::TAG_CLASS_VEHICLE,
+            TagClassInt::TAG_CLASS_WEAPON,
+            TagClassInt::TAG_CLASS_EQUIPMENT,
+            TagClassInt::TAG_CLASS_GARBAGE,
+            TagClassInt::TAG_CLASS_SCENERY,
+            TagClassInt::TAG_CLASS_PLACEHOLDER,
+            TagClassInt::TAG_CLASS_SOUND_SCENERY,
+            TagClassInt::TAG_CLASS_DEVICE_CONTROL,
+            TagClassInt::TAG_CLASS_DEVICE_MACHINE,
+            TagClassInt::TAG_CLASS_DEVICE_LIGHT_FIXTURE
+        };
+        for(auto object_class_int : OBJECT_TAG_CLASSES) {
+            auto new_path = try_class(object_class_int);
+            if(new_path.has_value()) {
+                tag_class_int = object_class_int;
+                return new_path;
+            }
+        }
+
+        std::snprintf(formatted_path, sizeof(formatted_path), "%s.%s", tag_path, tag_class_to_extension(tag_class_int));
+        return std::nullopt;
+    }
+
+    static void find_tag_references(Parser::ParserStruct &tag_struct, std::vector<std::pair<std::string, TagClassInt>> &references) {
+        for(auto &value : tag_struct.get_values()) {
+            switch(value.get_type()) {
+                case Parser::ParserStructValue::ValueType::VALUE_TYPE_DEPENDENCY: {
+                    auto &dependency = value.get_dependency();
+                    if(dependency.path.size() > 0 && dependency.tag_class_int != TagClassInt::TAG_CLASS_NULL && dependency.tag_class_int != TagClassInt::TAG_CLASS_NONE) {
+                        references.emplace_back(Invader::File::remove_duplicate_slashes(dependency.path), dependency.tag_class_int);
+                    }
+                    break;
+                }
+                case Parser::ParserStructValue::ValueType::VALUE_TYPE_REFLEXIVE: {
+                    std::size_t count = value.get_array_size();
+                    for(std::size_t i = 0; i < count; i++) {
+                        find_tag_references(value.get_object_in_array(i), references);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    /**
+     * Reads and parses tags on worker threads ahead of compile_tag_recursively. Tags are still compiled in the same order on
+     * the calling thread, so tag indices and struct order (and thus the resulting cache file) do not change.
+     */
+    struct BuildWorkload::TagPrefetchQueue {
+        using TagKey = std::pair<std::string, TagClassInt>;
+
+        /** Number of tags each thread can read ahead of the compiling thread before waiting for it to catch up */
+        static constexpr std::size_t MAX_PREFETCHED_TAGS_PER_THREAD = 16;
+
+        struct PrefetchedTag {
+            std::filesystem::path file_path;
+            std::optional<std::vector<std::byte>> file_data;
+            std::unique_ptr<Parser::ParserStruct> parsed_tag_struct;
+
+            /** Anything printed while parsing it, which is printed when it's taken */
+            std::string output;
+
+            /** How long it took to parse, which is added to the tag's build stats when it's taken */
+            std::chrono::steady_clock::duration parse_time = {};
+
+            /** It was read before the compiling thread asked for it, so it counts towards the prefetch limit */
+            bool prefetched = false;
+            bool done = false;
+            bool taken = false;
+        };
+
+        TagPrefetchQueue(const std::vector<std::filesystem::path> &tags_directories, std::size_t max_threads) : tags_directories(tags_directories), max_prefetched(max_threads * MAX_PREFETCHED_TAGS_PER_THREAD) {
+            this->threads.reserve(max_threads);
+            for(std::size_t i = 0; i < max_threads; i++) {
+                this->threads.emplace_back(&TagPrefetchQueue::work, this);
+            }
+        }
+
+        ~TagPrefetchQueue() {
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->stopping = true;
+            }
+            this->condition.notify_all();
+            for(auto &t : this->threads) {
+                t.join();
+            }
+        }
+
+        /**
+         * Get the tag, waiting for it to be read if needed
+         * @param tag_path          tag path (without extension)
+         * @param tag_class_int     resolved tag class
+         * @param file_path         path to the tag file
+         * @param file_data         set to the tag file data, if it could be read
+         * @param parsed_tag_struct set to the parsed tag, if it could be parsed
+         * @param parse_time        set to how long it took to parse the tag, if it could be parsed
+         * @return                  true if the tag was taken from the queue
+         */
+        bool take(const std::string &tag_path, TagClassInt tag_class_int, const std::filesystem::path &file_path, std::optional<std::vector<std::byte>> &file_data, std::unique_ptr<Parser::ParserStruct> &parsed_tag_struct, std::chrono::steady_clock::duration &parse_time) {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            TagKey key(tag_path, tag_class_int);
+
+            // If nobody has gotten to it yet, put it at the front of the line
+            auto prefetched_tag = this->prefetched.find(key);
+            if(prefetched_tag == this->prefetched.end()) {
+                prefetched_tag = this->prefetched.emplace(key, PrefetchedTag()).first;
+                prefetched_tag->second.file_path = file_path;
+                this->requested.insert(key);
+                this->claimed.emplace_back(key);
+                this->condition.notify_all();
+            }
+
+            auto &tag = prefetched_tag->second;
+            if(tag.taken) {
+                return false;
+            }
+            this->condition.wait(lock, [&tag]() { return tag.done; });
+
+            tag.taken = true;
+            file_data = std::move(tag.file_data);
+            parsed_tag_struct = std::move(tag.parsed_tag_struct);
+            parse_time = tag.parse_time;
+            auto output = std::move(tag.output);
+
+            // Let the threads read more now that this one is out of the way
+            if(tag.prefetched) {
+                this->prefetched_count--;
+                this->condition.notify_all();
+            }
+            lock.unlock();
+
+            // Print what happened when it was parsed now so it's in order with everything else (if it failed to parse, it
+            // gets parsed again, which prints the same thing)
+            if(parsed_tag_struct) {
+                eprintf("%s", output.c_str());
+            }
+            return true;
+        }
+
+    private:
+        const std::vector<std::filesystem::path> &tags_directories;
+
+        /** Tags that have been claimed by a thread, keyed by their resolved class */
+        std::map<TagKey, PrefetchedTag> prefetched;
+
+        /** Every reference ever queued, keyed by the class it was referenced as */
+        std::set<TagKey> requested;
+
+        /** References that still need to be found */
+        std::deque<TagKey> pending;
+
+        /** Tags that were claimed by the compiling thread and need to be read as soon as possible */
+        std::deque<TagKey> claimed;
+
+        /** Tags read ahead of the compiling thread that it hasn't taken yet; this is kept under max_prefetched */
+        std::size_t prefetched_count = 0;
+        std::size_t max_prefetched;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::vector<std::thread> threads;
+        bool stopping = false;
+
+        void work() {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            while(true) {
+                // Tags the compiling thread is waiting on can always be read, but don't get too far ahead of it otherwise
+                this->condition.wait(lock, [this]() { return this->stopping || !this->claimed.empty() || (!this->pending.empty() && this->prefetched_count < this->max_prefetched); });
+                if(this->stopping) {
+                    return;
+                }
+
+                // Get the next tag to read
+                PrefetchedTag *tag;
+                if(!this->claimed.empty()) {
+                    tag = &this->prefetched[this->claimed.front()];
+                    this->claimed.pop_front();
+                }
+                else {
+                    auto key = std::move(this->pending.front());
+                    this->pending.pop_front();
+                    this->prefetched_count++;
+
+                    // Find it (if looking for it fails, leave it for the compiling thread to report when it gets to it)
+                    lock.unlock();
+                    char formatted_path[256];
+                    std::optional<std::filesystem::path> file_path;
+                    try {
+                        file_path = find_tag_file(key.first.c_str(), key.second, this->tags_directories, formatted_path);
+                    }
+                    catch(std::exception &) {
+                        file_path = std::nullopt;
+                    }
+                    lock.lock();
+
+                    // If we couldn't find it or someone else claimed it, move on
+                    if(!file_path.has_value() || this->prefetched.find(key) != this->prefetched.end()) {
+                        this->prefetched_count--;
+                        this->condition.notify_all();
+                        continue;
+                    }
+                    tag = &this->prefetched[key];
+                    tag->file_path = std::move(*file_path);
+                    tag->prefetched = true;
+                }
+                lock.unlock();
+
+                // Read and parse it. If anything goes wrong, the compiling thread will handle it when it gets to it.
+                std::optional<std::vector<std::byte>> file_data;
+                std::unique_ptr<Parser::ParserStruct> parsed_tag_struct;
+                std::vector<TagKey> references;
+                std::string output;
+                std::chrono::steady_clock::duration parse_time = {};
+                try {
+                    EprintfBufferScope buffer_output(output);
+                    file_data = File::open_file(tag->file_path);
+                    if(file_data.has_value()) {
+                        auto parse_start = std::chrono::steady_clock::now();
+                        parsed_tag_struct = Parser::ParserStruct::parse_hek_tag_file(file_data->data(), file_data->size(), true);
+                        parse_time = std::chrono::steady_clock::now() - parse_start;
+                        find_tag_references(*parsed_tag_struct, references);
+                    }
+                }
+                catch(std::exception &) {
+                    parsed_tag_struct.reset();
+                    references.clear();
+                }
+
+                // Hand it off and queue up its references
+                lock.lock();
+                tag->file_data = std::move(file_data);
+                tag->parsed_tag_struct = std::move(parsed_tag_struct);
+                tag->output = std::move(output);
+                tag->parse_time = parse_time;
+                tag->done = true;
+                for(auto &r : references) {
+                    if(this->requested.insert(r).second) {
+                        this->pending.emplace_back(std::move(r));
+                    }
+                }
+                this->condition.notify_all();
+            }
+        }
+    };
+
     bool BuildWorkload::BuildWorkloadStruct::can_dedupe(const BuildWorkload::BuildWorkloadStruct &other) const noexcept {
         if(this->unsafe_to_dedupe || other.unsafe_to_dedupe || (this->bsp.has_value() && this->bsp != other.bsp)) {
             return false;
@@ -91,31 +364,127 @@ namespace Invader {
 
     BuildWorkload::BuildWorkload() : ErrorHandler() {}
 
-    std::vector<std::byte> BuildWorkload::compile_map(const BuildParameters &parameters) {
-        BuildWorkload workload;
-        workload.parameters = &parameters;
+    void BuildWorkload::set_parameters(const BuildParameters &parameters) {
+        this->parameters = &parameters;
 
         // Start benchmark
-        workload.start = std::chrono::steady_clock::now();
+        this->start = std::chrono::steady_clock::now();
 
         // Hide these?
         switch(parameters.verbosity) {
             case BuildParameters::BuildVerbosity::BUILD_VERBOSITY_SHOW_ALL:
                 break;
             case BuildParameters::BuildVerbosity::BUILD_VERBOSITY_HIDE_PEDANTIC:
-                workload.set_reporting_level(REPORTING_LEVEL_HIDE_ALL_PEDANTIC_WARNINGS);
+                this->set_reporting_level(REPORTING_LEVEL_HIDE_ALL_PEDANTIC_WARNINGS);
                 break;
             case BuildParameters::BuildVerbosity::BUILD_VERBOSITY_HIDE_WARNINGS:
-                workload.set_reporting_level(REPORTING_LEVEL_HIDE_ALL_WARNINGS);
+                this->set_reporting_level(REPORTING_LEVEL_HIDE_ALL_WARNINGS);
                 break;
             case BuildParameters::BuildVerbosity::BUILD_VERBOSITY_QUIET:
-                workload.set_reporting_level(REPORTING_LEVEL_HIDE_EVERYTHING);
+                this->set_reporting_level(REPORTING_LEVEL_HIDE_EVERYTHING);
                 break;
         }
+    }
 
+    std::vector<std::byte> BuildWorkload::compile_map(const BuildParameters &parameters) {
+        BuildWorkload workload;
+        workload.set_parameters(parameters);
         return workload.build_cache_file();
     }
 
+    std::size_t BuildWorkload::compile_map(const BuildParameters &parameters, const std::filesystem::path &output) {
+        BuildWorkload workload;
+        workload.set_parameters(parameters);
+        workload.output_file = &output;
+        workload.build_cache_file();
+        return workload.uncompressed_size;
+    }
+
+    /**
+     * Cache file being written to disk. It's written to a temporary file which replaces the output once it's done.
+     */
+    class CacheFileOutput {
+    public:
+        CacheFileOutput(const std::filesystem::path &path) : path(path), temp_path(path.string() + ".tmp") {
+            this->file = std::fopen(this->temp_path.string().c_str(), "wb");
+            if(!this->file) {
+                eprintf_error("Failed to open %s for writing", this->temp_path.string().c_str());
+                throw FailedToOpenFileException();
+            }
+        }
+
+        /**
+         * Write data to the given offset
+         * @param data   data to write
+         * @param size   size of the data
+         * @param offset offset to write to
+         * @return       true if successful
+         */
+        bool write(const std::byte *data, std::size_t size, std::size_t offset) noexcept {
+            // Go back if we're patching something we already wrote
+            if(offset != this->position) {
+                if(std::fseek(this->file, static_cast<long>(offset), SEEK_SET) != 0) {
+                    return false;
+                }
+                this->position = offset;
+            }
+            if(size > 0 && std::fwrite(data, size, 1, this->file) != 1) {
+                return false;
+            }
+            this->position += size;
+
+            // And return to the end
+            if(this->position < this->end && std::fseek(this->file, 0, SEEK_END) == 0) {
+                this->position = this->end;
+            }
+            this->end = std::max(this->end, this->position);
+            return true;
+        }
+
+        static bool write_callback(const std::byte *data, std::size_t size, std::size_t offset, void *user_data) noexcept {
+            return reinterpret_cast<CacheFileOutput *>(user_data)->write(data, size, offset);
+        }
+
+        /**
+         * Close the file and move it to its final path
+         */
+        void finish() {
+            bool closed = std::fclose(this->file) == 0;
+            this->file = nullptr;
+
+            std::error_code ec;
+            if(closed) {
+                std::filesystem::rename(this->temp_path, this->path, ec);
+                if(ec) {
+                    // Some platforms won't rename over an existing file
+                    std::filesystem::remove(this->path, ec);
+                    std::filesystem::rename(this->temp_path, this->path, ec);
+                }
+            }
+            if(!closed || ec) {
+                std::filesystem::remove(this->temp_path, ec);
+                eprintf_error("Failed to save %s", this->path.string().c_str());
+                throw FailedToSaveFileException();
+            }
+        }
+
+        ~CacheFileOutput() {
+            // If we didn't finish, don't leave anything behind
+            if(this->file) {
+                std::fclose(this->file);
+                std::error_code ec;
+                std::filesystem::remove(this->temp_path, ec);
+            }
+        }
+
+    private:
+        std::filesystem::path path;
+        std::filesystem::path temp_path;
+        std::FILE *file;
+        std::size_t position = 0;
+        std::size_t end = 0;
+    };
+
     #define BYTES_TO_MiB(bytes) (bytes / 1024.0 / 1024.0)
 
     std::vector<std::byte> BuildWorkload::build_cache_file() {
@@ -146,6 +515,7 @@ namespace Invader {
                 tag.path = i.path;
                 tag.tag_class_int = i.class_int;
                 tag.stubbed = true;
+                this->index_tag(this->tags.size() - 1);
             }
         }
 
@@ -154,17 +524,38 @@ namespace Invader {
         TAG_DATA_HEADER_STRUCT.unsafe_to_dedupe = true;
         TAG_ARRAY_STRUCT.unsafe_to_dedupe = true;
 
+        // Record how long everything takes if we're asked to
+        std::optional<BuildStats> stats;
+        if(this->parameters->stats.has_value()) {
+            stats.emplace(*this);
+            this->stats = &*stats;
+        }
+
         // Add all of the tags
         if(this->parameters->verbosity) {
             oprintf("Reading tags...\n");
         }
-        this->add_tags();
+        BuildStats::time_phase(this->stats, "reading tags", [this]() {
+            std::optional<TagPrefetchQueue> prefetch_queue;
+            if(this->parameters->max_threads > 1) {
+                prefetch_queue.emplace(this->parameters->tags_directories, this->parameters->max_threads);
+                this->prefetch_queue = &*prefetch_queue;
+            }
+            std::optional<BuildCache> build_cache;
+            if(this->parameters->cache_directory.has_value() || this->parameters->cache_memory) {
+                build_cache.emplace(*this);
+                this->build_cache = &*build_cache;
+            }
+            this->add_tags();
+            this->prefetch_queue = nullptr;
+            this->build_cache = nullptr;
+        });
 
         // If we have resource maps to check, check them
-        this->externalize_tags();
+        BuildStats::time_phase(this->stats, "externalize_tags", [this]() { this->externalize_tags(); });
 
         // Generate the tag array
-        this->generate_tag_array();
+        BuildStats::time_phase(this->stats, "generate_tag_array", [this]() { this->generate_tag_array(); });
 
         // Set the scenario tag thingy
         auto make_tag_data_header_struct = [](std::size_t scenario_index, auto &structs, auto size) {
@@ -204,7 +595,7 @@ namespace Invader {
 
         // Dedupe structs
         if(this->parameters->optimize_space) {
-            this->dedupe_structs();
+            BuildStats::time_phase(this->stats, "dedupe_structs", [this]() { this->dedupe_structs(); });
         }
 
         // Get the tag data
@@ -212,7 +603,7 @@ namespace Invader {
             oprintf("Building tag data...");
             oflush();
         }
-        std::size_t end_of_bsps = this->generate_tag_data();
+        std::size_t end_of_bsps = BuildStats::time_phase(this->stats, "generate_tag_data", [this]() { return this->generate_tag_data(); });
         if(this->parameters->verbosity) {
             oprintf(" done\n");
         }
@@ -253,7 +644,7 @@ namespace Invader {
             oprintf("Building raw data...");
             oflush();
         }
-        this->generate_bitmap_sound_data(end_of_bsps);
+        BuildStats::time_phase(this->stats, "generate_bitmap_sound_data", [this, end_of_bsps]() { this->generate_bitmap_sound_data(end_of_bsps); });
         if(this->parameters->verbosity) {
             oprintf(" done\n");
         }
@@ -271,43 +662,66 @@ namespace Invader {
                 oflush();
             }
 
-            // Add header stuff
-            final_data.resize(sizeof(HEK::CacheFileHeader));
-
-            // Go through each BSP and add that stuff
-            if(workload.parameters->details.build_cache_file_engine != HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
+            // Lay everything out first
+            bool bsps_in_file = workload.parameters->details.build_cache_file_engine != HEK::CacheFileEngine::CACHE_FILE_NATIVE;
+            std::size_t bsp_data_offset = sizeof(HEK::CacheFileHeader);
+            std::size_t raw_data_offset = bsp_data_offset;
+            if(bsps_in_file) {
                 for(std::size_t b = 0; b < workload.bsp_count; b++) {
-                    final_data.insert(final_data.end(), workload.map_data_structs[b + 1].begin(), workload.map_data_structs[b + 1].end());
+                    raw_data_offset += workload.map_data_structs[b + 1].size();
                 }
             }
-            workload.map_data_structs.resize(1);
-
-            // Now add all the raw data
-            final_data.insert(final_data.end(), workload.all_raw_data.begin(), workload.all_raw_data.end());
             auto raw_data_size = workload.all_raw_data.size();
-            workload.all_raw_data = std::vector<std::byte>();
-
-            // Let's get the model data there
-            std::size_t model_offset = final_data.size() + REQUIRED_PADDING_32_BIT(final_data.size());
-            final_data.resize(model_offset, std::byte());
-            final_data.insert(final_data.end(), reinterpret_cast<std::byte *>(workload.model_vertices.data()), reinterpret_cast<std::byte *>(workload.model_vertices.data() + workload.model_vertices.size()));
-
-            // Now add model indices
+            std::size_t model_offset = raw_data_offset + raw_data_size;
+            model_offset += REQUIRED_PADDING_32_BIT(model_offset);
             std::size_t vertex_size = workload.model_vertices.size() * sizeof(*workload.model_vertices.data());
-            final_data.insert(final_data.end(), reinterpret_cast<std::byte *>(workload.model_indices.data()), reinterpret_cast<std::byte *>(workload.model_indices.data() + workload.model_indices.size()));
-            workload.model_vertices = decltype(workload.model_vertices)();
-            workload.model_indices = decltype(workload.model_indices)();
-
-            // We're almost there
-            std::size_t tag_data_offset = final_data.size() + REQUIRED_PADDING_32_BIT(final_data.size());
+            std::size_t index_size = workload.model_indices.size() * sizeof(*workload.model_indices.data());
+            std::size_t tag_data_offset = model_offset + vertex_size + index_size;
+            tag_data_offset += REQUIRED_PADDING_32_BIT(tag_data_offset);
             std::size_t model_data_size = tag_data_offset - model_offset;
-            final_data.resize(tag_data_offset, std::byte());
-
-            // Add tag data
             std::size_t tag_data_size = workload.map_data_structs[0].size();
-            final_data.insert(final_data.end(), workload.map_data_structs[0].begin(), workload.map_data_structs[0].end());
+
+            // Each section of the file, in order, so the file can be written (or compressed) from where everything
+            // already is instead of being put together in one buffer first
+            std::byte header_data[sizeof(HEK::CacheFileHeader)] = {};
+            static constexpr std::byte padding[4] = {};
+            std::vector<std::pair<const std::byte *, std::size_t>> sections;
+            sections.emplace_back(header_data, sizeof(header_data));
+            if(bsps_in_file) {
+                for(std::size_t b = 0; b < workload.bsp_count; b++) {
+                    auto &bsp_data = workload.map_data_structs[b + 1];
+                    sections.emplace_back(bsp_data.data(), bsp_data.size());
+                }
+            }
+            sections.emplace_back(workload.all_raw_data.data(), raw_data_size);
+            sections.emplace_back(padding, model_offset - raw_data_offset - raw_data_size);
+            sections.emplace_back(reinterpret_cast<const std::byte *>(workload.model_vertices.data()), vertex_size);
+            sections.emplace_back(reinterpret_cast<const std::byte *>(workload.model_indices.data()), index_size);
+            sections.emplace_back(padding, tag_data_offset - model_offset - vertex_size - index_size);
+            sections.emplace_back(workload.map_data_structs[0].data(), tag_data_size);
+            std::size_t uncompressed_size = tag_data_offset + tag_data_size;
+
+            // Get the data in the given range of the file (this can span multiple sections)
+            auto add_file_range = [&sections](std::vector<std::pair<const std::byte *, std::size_t>> &ranges, std::size_t start, std::size_t end) {
+                std::size_t section_offset = 0;
+                for(auto &s : sections) {
+                    std::size_t section_end = section_offset + s.second;
+                    if(start < section_end && end > section_offset) {
+                        std::size_t range_start = std::max(start, section_offset);
+                        std::size_t range_end = std::min(end, section_end);
+                        ranges.emplace_back(s.first + (range_start - section_offset), range_end - range_start);
+                    }
+                    section_offset = section_end;
+                }
+                if(start > end || end > section_offset) {
+                    throw OutOfBoundsException();
+                }
+            };
+
+            // Add tag data (this is kept around for the summary)
+            auto *tag_data = workload.map_data_structs[0].data();
             if(workload.parameters->details.build_cache_file_engine == HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
-                auto &tag_data_struct = *reinterpret_cast<HEK::NativeCacheFileTagDataHeader *>(final_data.data() + tag_data_offset);
+                auto &tag_data_struct = *reinterpret_cast<HEK::NativeCacheFileTagDataHeader *>(tag_data);
                 tag_data_struct.tag_count = static_cast<std::uint32_t>(workload.tags.size());
                 tag_data_struct.tags_literal = CacheFileLiteral::CACHE_FILE_TAGS;
                 tag_data_struct.model_part_count = static_cast<std::uint32_t>(workload.part_count);
@@ -317,7 +731,7 @@ namespace Invader {
                 tag_data_struct.raw_data_indices = workload.raw_data_indices_offset;
             }
             else {
-                auto &tag_data_struct = *reinterpret_cast<HEK::CacheFileTagDataHeaderPC *>(final_data.data() + tag_data_offset);
+                auto &tag_data_struct = *reinterpret_cast<HEK::CacheFileTagDataHeaderPC *>(tag_data);
                 tag_data_struct.tag_count = static_cast<std::uint32_t>(workload.tags.size());
                 tag_data_struct.tags_literal = CacheFileLiteral::CACHE_FILE_TAGS;
                 tag_data_struct.model_part_count = static_cast<std::uint32_t>(workload.part_count);
@@ -333,12 +747,10 @@ namespace Invader {
             if(workload.parameters->details.build_cache_file_engine == HEK::CacheFileEngine::CACHE_FILE_DEMO) {
                 header.head_literal = CacheFileLiteral::CACHE_FILE_HEAD_DEMO;
                 header.foot_literal = CacheFileLiteral::CACHE_FILE_FOOT_DEMO;
-                *reinterpret_cast<HEK::CacheFileDemoHeader *>(final_data.data()) = *reinterpret_cast<HEK::CacheFileHeader *>(&header);
             }
             else {
                 header.head_literal = CacheFileLiteral::CACHE_FILE_HEAD;
                 header.foot_literal = CacheFileLiteral::CACHE_FILE_FOOT;
-                std::memcpy(final_data.data(), &header, sizeof(header));
             }
 
             if(workload.parameters->verbosity) {
@@ -346,7 +758,6 @@ namespace Invader {
             }
 
             // Check to make sure we aren't too big
-            std::size_t uncompressed_size = final_data.size();
             if(static_cast<std::uint64_t>(uncompressed_size) > max_size) {
                 REPORT_ERROR_PRINTF(workload, ERROR_TYPE_FATAL_ERROR, std::nullopt, "Map file exceeds maximum size when uncompressed (%.04f MiB > %.04f MiB)", BYTES_TO_MiB(uncompressed_size), BYTES_TO_MiB(static_cast<std::size_t>(max_size)));
                 throw MaximumFileSizeException();
@@ -363,7 +774,7 @@ namespace Invader {
             }
 
             // Hold this here, of course
-            auto &tag_file_checksums = reinterpret_cast<HEK::CacheFileTagDataHeader *>(final_data.data() + tag_data_offset)->tag_file_checksums;
+            auto &tag_file_checksums = reinterpret_cast<HEK::CacheFileTagDataHeader *>(tag_data)->tag_file_checksums;
             tag_file_checksums = workload.tag_file_checksums;
             
             // If we can calculate the CRC32, do it
@@ -374,16 +785,32 @@ namespace Invader {
                     oprintf("Calculating CRC32...");
                     oflush();
                 }
+
+                // BSPs (in the order the scenario has them), model data, and then tag data get CRC'd
+                std::vector<std::pair<const std::byte *, std::size_t>> crc_regions;
+                if(bsps_in_file && workload.bsp_count > 0) {
+                    auto &scenario_tag_struct = workload.structs[*workload.tags[workload.scenario_index].base_struct];
+                    auto &scenario_tag_data = *reinterpret_cast<Parser::Scenario::struct_little *>(scenario_tag_struct.data.data());
+                    auto *scenario_tag_bsps = reinterpret_cast<Parser::ScenarioBSP::struct_little *>(tag_data + *workload.structs[*scenario_tag_struct.resolve_pointer(&scenario_tag_data.structure_bsps.pointer)].offset);
+                    for(std::size_t b = 0; b < workload.bsp_count; b++) {
+                        std::size_t bsp_start = scenario_tag_bsps[b].bsp_start.read();
+                        add_file_range(crc_regions, bsp_start, bsp_start + scenario_tag_bsps[b].bsp_size.read());
+                    }
+                }
+                add_file_range(crc_regions, model_offset, tag_data_offset);
+                add_file_range(crc_regions, tag_data_offset, uncompressed_size);
                 
                 // Calculate the CRC32 and/or forge one if we must
-                if(workload.parameters->forge_crc.has_value()) {
-                    std::uint32_t checksum_delta = 0;
-                    new_crc = calculate_map_crc(final_data.data(), final_data.size(), &workload.parameters->forge_crc.value(), &checksum_delta);
-                    tag_file_checksums = checksum_delta;
-                }
-                else {
-                    new_crc = calculate_map_crc(final_data.data(), final_data.size());
-                }
+                BuildStats::time_phase(workload.stats, "crc32", [&workload, &crc_regions, &new_crc, &tag_file_checksums]() {
+                    if(workload.parameters->forge_crc.has_value()) {
+                        std::uint32_t checksum_delta = 0;
+                        new_crc = calculate_map_crc(crc_regions, reinterpret_cast<const std::byte *>(&tag_file_checksums), &workload.parameters->forge_crc.value(), &checksum_delta);
+                        tag_file_checksums = checksum_delta;
+                    }
+                    else {
+                        new_crc = calculate_map_crc(crc_regions, reinterpret_cast<const std::byte *>(&tag_file_checksums));
+                    }
+                });
                 
                 header.crc32 = new_crc;
                 if(workload.parameters->verbosity) {
@@ -391,33 +818,130 @@ namespace Invader {
                 }
             }
 
-            // Copy it again, this time with the new CRC32
+            // Set the file size in the header if needed
+            if(!workload.parameters->details.build_compress && workload.parameters->details.build_cache_file_engine == HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
+                header.decompressed_file_size = uncompressed_size;
+            }
+
+            // Now the header is done
             if(workload.parameters->details.build_cache_file_engine == HEK::CacheFileEngine::CACHE_FILE_DEMO) {
-                *reinterpret_cast<HEK::CacheFileDemoHeader *>(final_data.data()) = *reinterpret_cast<HEK::CacheFileHeader *>(&header);
+                *reinterpret_cast<HEK::CacheFileDemoHeader *>(header_data) = *reinterpret_cast<HEK::CacheFileHeader *>(&header);
             }
             else {
-                std::memcpy(final_data.data(), &header, sizeof(header));
+                std::memcpy(header_data, &header, sizeof(header));
             }
 
-            // Compress if needed
-            if(workload.parameters->details.build_compress) {
-                if(workload.parameters->verbosity) {
-                    oprintf("Compressing...");
-                    oflush();
+            // Free each section once it's in the file (or in the final data), except for the header, the padding, and
+            // the tag data (which is kept around for the summary)
+            auto free_section = [&workload, &bsps_in_file](std::size_t section) {
+                std::size_t bsp_sections = bsps_in_file ? workload.bsp_count : 0;
+                if(section >= 1 && section <= bsp_sections) {
+                    workload.map_data_structs[section] = std::vector<std::byte>();
                 }
-                if(!workload.parameters->details.build_compress_mcc) {
-                    final_data = Compression::compress_map_data(final_data.data(), final_data.size());
+                else if(section == bsp_sections + 1) {
+                    workload.all_raw_data = std::vector<std::byte>();
                 }
-                else {
-                    final_data = Compression::ceaflate_compress(final_data.data(), final_data.size());
+                else if(section == bsp_sections + 3) {
+                    workload.model_vertices = std::remove_reference_t<decltype(workload.model_vertices)>();
                 }
-                if(workload.parameters->verbosity) {
-                    oprintf(" done\n");
+                else if(section == bsp_sections + 4) {
+                    workload.model_indices = std::remove_reference_t<decltype(workload.model_indices)>();
                 }
+            };
+            auto free_sections = [&workload, &sections, &free_section]() {
+                for(std::size_t s = 0; s < sections.size(); s++) {
+                    free_section(s);
+                }
+                workload.map_data_structs.resize(1);
+            };
+
+            workload.uncompressed_size = uncompressed_size;
+            std::size_t final_size = uncompressed_size;
+            bool compress = workload.parameters->details.build_compress;
+            bool compress_mcc = compress && workload.parameters->details.build_compress_mcc;
+
+            // If we're writing to a file, write each section to it in order, compressing it on the way if needed. MCC
+            // compression needs everything in one buffer, though.
+            if(workload.output_file && !compress_mcc) {
+                auto write_sections = [&workload, &sections, &final_size, &compress, &free_section]() {
+                    CacheFileOutput output(*workload.output_file);
+                    if(compress) {
+                        // Always use at least one worker thread so the output doesn't depend on the thread count
+                        Compression::ZstdOptions zstd_options;
+                        zstd_options.threads = workload.parameters->max_threads;
+                        zstd_options.long_distance_matching = workload.parameters->long_distance_matching;
+                        zstd_options.frame_size = workload.parameters->frame_size;
+                        final_size = Compression::compress_map_data(sections, CacheFileOutput::write_callback, &output, 19, zstd_options);
+                    }
+                    else {
+                        std::size_t offset = 0;
+                        for(std::size_t s = 0; s < sections.size(); s++) {
+                            if(!output.write(sections[s].first, sections[s].second, offset)) {
+                                eprintf_error("Failed to save %s", workload.output_file->string().c_str());
+                                throw FailedToSaveFileException();
+                            }
+                            offset += sections[s].second;
+                            free_section(s);
+                        }
+                    }
+                    output.finish();
+                };
+
+                if(compress) {
+                    if(workload.parameters->verbosity) {
+                        oprintf("Compressing...");
+                        oflush();
+                    }
+                    BuildStats::time_phase(workload.stats, "compression", write_sections);
+                    if(workload.parameters->verbosity) {
+                        oprintf(" done\n");
+                    }
+                }
+                else {
+                    write_sections();
+                }
+                free_sections();
             }
-            // Set the file size in the header if needed
-            else if(workload.parameters->details.build_cache_file_engine == HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
-                header.decompressed_file_size = final_data.size();
+            else {
+                // Put it all together
+                final_data.reserve(uncompressed_size);
+                for(std::size_t s = 0; s < sections.size(); s++) {
+                    final_data.insert(final_data.end(), sections[s].first, sections[s].first + sections[s].second);
+                    free_section(s);
+                }
+                workload.map_data_structs.resize(1);
+
+                // Compress if needed
+                if(compress) {
+                    if(workload.parameters->verbosity) {
+                        oprintf("Compressing...");
+                        oflush();
+                    }
+                    BuildStats::time_phase(workload.stats, "compression", [&workload, &final_data, &final_size, &compress_mcc]() {
+                        if(!compress_mcc) {
+                            // Always use at least one worker thread so the output doesn't depend on the thread count
+                            Compression::ZstdOptions zstd_options;
+                            zstd_options.threads = workload.parameters->max_threads;
+                            zstd_options.long_distance_matching = workload.parameters->long_distance_matching;
+                            zstd_options.frame_size = workload.parameters->frame_size;
+                            final_data = Compression::compress_map_data(final_data.data(), final_data.size(), 19, zstd_options);
+                            final_size = final_data.size();
+                        }
+                        else if(workload.output_file) {
+                            CacheFileOutput output(*workload.output_file);
+                            final_size = Compression::ceaflate_compress(final_data.data(), final_data.size(), CacheFileOutput::write_callback, &output, 9, workload.parameters->max_threads);
+                            output.finish();
+                            final_data = std::vector<std::byte>();
+                        }
+                        else {
+                            final_data = Compression::ceaflate_compress(final_data.data(), final_data.size(), 9, workload.parameters->max_threads);
+                            final_size = final_data.size();
+                        }
+                    });
+                    if(workload.parameters->verbosity) {
+                        oprintf(" done\n");
+                    }
+                }
             }
 
             // Display the scenario name and information
@@ -498,7 +1022,13 @@ namespace Invader {
 
                 // Show some other data that might be useful
                 oprintf("Models:            %zu (%.02f MiB)\n", workload.part_count, BYTES_TO_MiB(model_data_size));
+                if(workload.parameters->cache_directory.has_value() || workload.parameters->cache_memory) {
+                    oprintf("Cached tags:       %zu loaded, %zu compiled\n", workload.cached_tag_count, workload.uncached_tag_count);
+                }
                 oprintf("Raw data:          %.02f MiB (%.02f MiB bitmaps, %.02f MiB sounds)\n", BYTES_TO_MiB(raw_data_size), BYTES_TO_MiB(workload.raw_bitmap_size), BYTES_TO_MiB(workload.raw_sound_size));
+                if(workload.deduped_raw_data_count > 0) {
+                    oprintf("Deduped raw data:  %zu asset%s (%.02f MiB saved)\n", workload.deduped_raw_data_count, workload.deduped_raw_data_count == 1 ? "" : "s", BYTES_TO_MiB(workload.deduped_raw_data_size));
+                }
 
                 // Show our CRC32
                 if(can_calculate_crc) {
@@ -507,7 +1037,7 @@ namespace Invader {
 
                 // If we compressed it, how small did we get it?
                 if(workload.parameters->details.build_compress) {
-                    std::size_t compressed_size = final_data.size();
+                    std::size_t compressed_size = final_size;
                     oprintf("Compressed size:   %.02f MiB (%.02f %%)\n", BYTES_TO_MiB(compressed_size), 100.0 * compressed_size / uncompressed_size);
                 }
 
@@ -538,6 +1068,7 @@ namespace Invader {
             return final_data;
         };
 
+        std::vector<std::byte> final_data;
         if(this->parameters->details.build_cache_file_engine == HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
             HEK::NativeCacheFileHeader header = {};
             
@@ -547,28 +1078,52 @@ namespace Invader {
             std::snprintf(header.timestamp.string, sizeof(header.timestamp.string), "%04u-%02u-%02uT%02u:%02u:%02uZ", gmt->tm_year + 1900, gmt->tm_mon + 1, gmt->tm_mday, gmt->tm_hour, gmt->tm_min, gmt->tm_sec);
             
             // Done
-            return generate_final_data(header, UINT64_MAX);
+            final_data = generate_final_data(header, UINT64_MAX);
         }
         else {
             HEK::CacheFileHeader header = {};
-            return generate_final_data(header, UINT32_MAX);
+            final_data = generate_final_data(header, UINT32_MAX);
         }
+
+        if(this->stats) {
+            this->stats->print_report();
+            this->stats = nullptr;
+        }
+
+        return final_data;
     }
 
     void BuildWorkload::compile_tag_data_recursively(const std::byte *tag_data, std::size_t tag_data_size, std::size_t tag_index, std::optional<TagClassInt> tag_class_int) {
+        this->compile_tag_data_recursively(tag_data, tag_data_size, tag_index, tag_class_int, nullptr);
+    }
+
+    void BuildWorkload::compile_tag_data_recursively(const std::byte *tag_data, std::size_t tag_data_size, std::size_t tag_index, std::optional<TagClassInt> tag_class_int, std::unique_ptr<Parser::ParserStruct> parsed_tag_struct) {
+        // Use the already-parsed tag if we have it; otherwise, parse it now
+        #define PARSE_TAG_CLASS(class_struct) (dynamic_cast<Parser::class_struct *>(parsed_tag_struct.get()) ? std::move(*dynamic_cast<Parser::class_struct *>(parsed_tag_struct.get())) : Parser::class_struct::parse_hek_tag_file(tag_data, tag_data_size, true))
+
         #define COMPILE_TAG_CLASS(class_struct, class_int) case TagClassInt::class_int: { \
-            do_compile_tag(std::move(Parser::class_struct::parse_hek_tag_file(tag_data, tag_data_size, true))); \
+            std::optional<Parser::class_struct> parsed_tag; \
+            { \
+                auto parse_timer = this->time_compile_step(tag_index, COMPILE_STEP_PARSE); \
+                parsed_tag.emplace(PARSE_TAG_CLASS(class_struct)); \
+            } \
+            do_compile_tag(std::move(*parsed_tag)); \
             break; \
         }
 
         auto *header = reinterpret_cast<const HEK::TagFileHeader *>(tag_data);
+        auto compile_timer = this->time_compile_step(tag_index, COMPILE_STEP_COMPILE);
 
         if(!tag_class_int.has_value()) {
             tag_class_int = header->tag_class_int;
         }
 
         // Set this in case it's not set yet
-        this->tags[tag_index].tag_class_int = *tag_class_int;
+        if(this->tags[tag_index].tag_class_int != *tag_class_int) {
+            this->unindex_tag(tag_index);
+            this->tags[tag_index].tag_class_int = *tag_class_int;
+            this->index_tag(tag_index);
+        }
         
         // Make sure the path isn't bullshit
         bool invalid_path = false;
@@ -625,6 +1180,11 @@ namespace Invader {
         // TODO: Although it accomplishes the same task, this is NOT the algorithm tool.exe uses.
         this->tag_file_checksums = crc32(this->tag_file_checksums, &expected_crc, sizeof(expected_crc));
 
+        // If we already compiled it on a previous build, we're done
+        if(this->build_cache && this->build_cache->begin_tag(tag_index, tag_data, tag_data_size)) {
+            return;
+        }
+
         auto &structs = this->structs;
         auto &tags = this->tags;
         auto &workload = *this;
@@ -724,7 +1284,12 @@ namespace Invader {
             // And, of course, BSP tags
             case TagClassInt::TAG_CLASS_SCENARIO_STRUCTURE_BSP: {
                 // First thing's first - parse the tag data
-                auto tag_data_parsed = Parser::ScenarioStructureBSP::parse_hek_tag_file(tag_data, tag_data_size, true);
+                std::optional<Parser::ScenarioStructureBSP> parsed_tag;
+                {
+                    auto parse_timer = this->time_compile_step(tag_index, COMPILE_STEP_PARSE);
+                    parsed_tag.emplace(PARSE_TAG_CLASS(ScenarioStructureBSP));
+                }
+                auto &tag_data_parsed = *parsed_tag;
                 std::size_t bsp = this->bsp_count++;
 
                 // Next, if we're making a native map, we need to only do this
@@ -771,6 +1336,10 @@ namespace Invader {
             default:
                 throw UnknownTagClassException();
         }
+
+        if(this->build_cache) {
+            this->build_cache->end_tag(tag_index);
+        }
     }
 
     std::size_t BuildWorkload::compile_tag_recursively(const char *tag_path, TagClassInt tag_class_int) {
@@ -778,69 +1347,45 @@ namespace Invader {
         auto fixed_path = Invader::File::remove_duplicate_slashes(tag_path);
         tag_path = fixed_path.c_str();
 
+        // Let the build cache know what the tag being compiled references
+        auto requested_class_int = tag_class_int;
+        auto done = [this, &fixed_path, &requested_class_int](std::size_t tag_index) {
+            if(this->build_cache) {
+                this->build_cache->add_request(fixed_path, requested_class_int, tag_index);
+            }
+            return tag_index;
+        };
+
         // Search for the tag
         std::size_t return_value = this->tags.size();
         bool found = false;
-        for(std::size_t i = 0; i < return_value; i++) {
+        auto use_existing_tag = [this, &return_value, &found](std::size_t i) {
             auto &tag = this->tags[i];
-            if((tag.tag_class_int == tag_class_int || tag.alias == tag_class_int) && tag.path == tag_path) {
-                if(tag.base_struct.has_value()) {
-                    return i;
-                }
-                return_value = i;
-                found = true;
-                tag.stubbed = false;
-                break;
+            if(tag.base_struct.has_value()) {
+                return true;
             }
+            return_value = i;
+            found = true;
+            tag.stubbed = false;
+            return false;
+        };
+        auto existing_tag = this->find_tag(fixed_path, tag_class_int);
+        if(existing_tag.has_value() && use_existing_tag(*existing_tag)) {
+            return done(*existing_tag);
         }
         
         auto &tags_directories = this->parameters->tags_directories;
 
         // Find it
         char formatted_path[256];
-        std::optional<std::filesystem::path> new_path;
-        if(tag_class_int != TagClassInt::TAG_CLASS_OBJECT) {
-            std::snprintf(formatted_path, sizeof(formatted_path), "%s.%s", tag_path, tag_class_to_extension(tag_class_int));
-            Invader::File::halo_path_to_preferred_path_chars(formatted_path);
-            new_path = Invader::File::tag_path_to_file_path(formatted_path, tags_directories, true);
-        }
-        else {
-            #define TRY_THIS(new_int) if(!new_path.has_value()) { \
-                std::snprintf(formatted_path, sizeof(formatted_path), "%s.%s", tag_path, tag_class_to_extension(new_int)); \
-                Invader::File::halo_path_to_preferred_path_chars(formatted_path); \
-                new_path = Invader::File::tag_path_to_file_path(formatted_path, tags_directories, true); \
-                tag_class_int = new_int; \
-            }
-            TRY_THIS(TagClassInt::TAG_CLASS_BIPED);
-            TRY_THIS(TagClassInt::TAG_CLASS_VEHICLE);
-            TRY_THIS(TagClassInt::TAG_CLASS_WEAPON);
-            TRY_THIS(TagClassInt::TAG_CLASS_EQUIPMENT);
-            TRY_THIS(TagClassInt::TAG_CLASS_GARBAGE);
-            TRY_THIS(TagClassInt::TAG_CLASS_SCENERY);
-            TRY_THIS(TagClassInt::TAG_CLASS_PLACEHOLDER);
-            TRY_THIS(TagClassInt::TAG_CLASS_SOUND_SCENERY);
-            TRY_THIS(TagClassInt::TAG_CLASS_DEVICE_CONTROL);
-            TRY_THIS(TagClassInt::TAG_CLASS_DEVICE_MACHINE);
-            TRY_THIS(TagClassInt::TAG_CLASS_DEVICE_LIGHT_FIXTURE);
-            #undef TRY_THIS
-            if(!new_path.has_value()) {
-                tag_class_int = TagClassInt::TAG_CLASS_OBJECT;
-                std::snprintf(formatted_path, sizeof(formatted_path), "%s.%s", tag_path, tag_class_to_extension(tag_class_int));
-            }
-            else {
-                // Look for it again
-                for(std::size_t i = 0; i < return_value; i++) {
-                    auto &tag = this->tags[i];
-                    if(tag.tag_class_int == tag_class_int && tag.path == tag_path) {
-                        if(tag.base_struct.has_value()) {
-                            return i;
-                        }
-                        return_value = i;
-                        found = true;
-                        tag.stubbed = false;
-                        break;
-                    }
-                }
+        bool object_reference = tag_class_int == TagClassInt::TAG_CLASS_OBJECT;
+        auto new_path = find_tag_file(tag_path, tag_class_int, tags_directories, formatted_path);
+
+        // If it was an object reference, we know the actual class now, so look for it again
+        if(object_reference && new_path.has_value()) {
+            existing_tag = this->find_tag(fixed_path, tag_class_int);
+            if(existing_tag.has_value() && *existing_tag < return_value && use_existing_tag(*existing_tag)) {
+                return done(*existing_tag);
             }
         }
 
@@ -850,11 +1395,12 @@ namespace Invader {
             tag.path = tag_path;
             tag.tag_class_int = tag_class_int;
             this->get_tag_paths().emplace_back(tag_path, tag_class_int);
+            this->index_tag(this->tags.size() - 1);
         }
 
         // And we're done! Maybe?
         if(this->disable_recursion && return_value > 0) {
-            return return_value;
+            return done(return_value);
         }
 
         if(!new_path.has_value()) {
@@ -862,8 +1408,17 @@ namespace Invader {
             throw InvalidTagPathException();
         }
 
-        // Open it
-        auto tag_file = Invader::File::open_file(*new_path);
+        // Open it (or get it from the prefetch queue if we're using it)
+        std::optional<std::vector<std::byte>> tag_file;
+        std::unique_ptr<Parser::ParserStruct> parsed_tag_struct;
+        std::chrono::steady_clock::duration parse_time;
+        if(!this->prefetch_queue || !this->prefetch_queue->take(tag_path, tag_class_int, *new_path, tag_file, parsed_tag_struct, parse_time)) {
+            tag_file = Invader::File::open_file(*new_path);
+        }
+        else if(parsed_tag_struct && this->stats) {
+            // It was parsed on another thread, so the parse step only covers getting it out of the queue
+            this->stats->add_step_time(return_value, COMPILE_STEP_PARSE, parse_time);
+        }
         if(!tag_file.has_value()) {
             eprintf_error("Failed to open %s\n", formatted_path);
             throw FailedToOpenFileException();
@@ -871,14 +1426,64 @@ namespace Invader {
         auto &tag_file_data = *tag_file;
 
         try {
-            this->compile_tag_data_recursively(tag_file_data.data(), tag_file_data.size(), return_value, tag_class_int);
+            this->compile_tag_data_recursively(tag_file_data.data(), tag_file_data.size(), return_value, tag_class_int, std::move(parsed_tag_struct));
         }
         catch(std::exception &e) {
             eprintf("Failed to compile tag %s\n", formatted_path);
             throw;
         }
 
-        return return_value;
+        return done(return_value);
+    }
+
+    std::optional<std::size_t> BuildWorkload::find_tag(const std::string &tag_path, TagClassInt tag_class_int) const {
+        auto tag = this->tag_indices.find(std::make_pair(tag_path, tag_class_int));
+        if(tag == this->tag_indices.end()) {
+            return std::nullopt;
+        }
+        
+        // The lowest index is the one a linear search would have found first
+        return tag->second.front();
+    }
+
+    void BuildWorkload::index_tag(std::size_t tag_index) {
+        auto &tag = this->tags[tag_index];
+        auto add_key = [this, &tag_index](const std::string &tag_path, TagClassInt tag_class_int) {
+            // Tags are almost always added in order, so this is usually appended to the end
+            auto &indices = this->tag_indices[std::make_pair(tag_path, tag_class_int)];
+            auto position = std::upper_bound(indices.begin(), indices.end(), tag_index);
+            if(position == indices.begin() || *(position - 1) != tag_index) {
+                indices.insert(position, tag_index);
+            }
+        };
+        add_key(tag.path, tag.tag_class_int);
+        if(tag.alias.has_value()) {
+            add_key(tag.path, *tag.alias);
+        }
+    }
+
+    void BuildWorkload::unindex_tag(std::size_t tag_index) {
+        auto &tag = this->tags[tag_index];
+        auto remove_key = [this, &tag_index](const std::string &tag_path, TagClassInt tag_class_int) {
+            auto entry = this->tag_indices.find(std::make_pair(tag_path, tag_class_int));
+            if(entry == this->tag_indices.end()) {
+                return;
+            }
+            
+            // If another tag has the same path and class, the next lowest index takes its place
+            auto &indices = entry->second;
+            auto position = std::lower_bound(indices.begin(), indices.end(), tag_index);
+            if(position != indices.end() && *position == tag_index) {
+                indices.erase(position);
+            }
+            if(indices.empty()) {
+                this->tag_indices.erase(entry);
+            }
+        };
+        remove_key(tag.path, tag.tag_class_int);
+        if(tag.alias.has_value()) {
+            remove_key(tag.path, *tag.alias);
+        }
     }
 
     void BuildWorkload::add_tags() {
@@ -922,7 +1527,9 @@ namespace Invader {
                 last_slash = i + 1;
             }
         }
+        this->unindex_tag(this->scenario_index);
         this->tags[this->scenario_index].path = std::string(first_char, last_slash - first_char) + this->scenario_name.string;
+        this->index_tag(this->scenario_index);
 
         this->compile_tag_recursively("globals\\globals", TagClassInt::TAG_CLASS_GLOBALS);
         this->compile_tag_recursively("ui\\ui_tags_loaded_all_scenario_types", TagClassInt::TAG_CLASS_TAG_COLLECTION);
@@ -961,8 +1568,11 @@ namespace Invader {
                     warned++;
                 }
 
+                std::size_t tag_index = &tag - this->tags.data();
+                this->unindex_tag(tag_index);
                 tag.path = "MISSINGNO.";
                 tag.tag_class_int = TagClassInt::TAG_CLASS_NONE;
+                this->index_tag(tag_index);
                 this->stubbed_tag_count++;
             }
         }
@@ -975,54 +1585,171 @@ namespace Invader {
     }
 
     void BuildWorkload::dedupe_structs() {
-        bool found_something = true;
         std::size_t total_savings = 0;
         std::size_t struct_count = this->structs.size();
+        auto &structs = this->structs;
 
         oprintf("Optimizing tag space...");
         oflush();
 
-        while(found_something) {
-            found_something = false;
-            for(std::size_t i = 0; i < struct_count; i++) {
-                if(this->structs[i].unsafe_to_dedupe) {
+        // Each struct maps to the struct that replaces it (or itself if it was kept)
+        std::vector<std::size_t> remap(struct_count);
+        for(std::size_t i = 0; i < struct_count; i++) {
+            remap[i] = i;
+        }
+        auto resolve = [&remap](std::size_t struct_index) {
+            while(remap[struct_index] != struct_index) {
+                struct_index = remap[struct_index] = remap[remap[struct_index]];
+            }
+            return struct_index;
+        };
+        auto merge = [&remap, &structs, &total_savings](std::size_t struct_index, std::size_t replacement) {
+            remap[struct_index] = replacement;
+            total_savings += structs[struct_index].data.size();
+            structs[struct_index].unsafe_to_dedupe = true;
+        };
+
+        // Hash everything that can_dedupe() compares except the BSP, which is checked per candidate
+        auto hash_struct = [&structs, &resolve](std::size_t struct_index) {
+            auto &s = structs[struct_index];
+            std::size_t hash = std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char *>(s.data.data()), s.data.size()));
+            for(auto &d : s.dependencies) {
+                hash = hash * 31 + d.tag_index;
+                hash = hash * 31 + d.offset;
+                hash = hash * 31 + d.tag_id_only;
+            }
+            for(auto &p : s.pointers) {
+                hash = hash * 31 + resolve(p.struct_index);
+                hash = hash * 31 + p.offset;
+            }
+            return hash;
+        };
+        auto same_pointers = [&structs, &resolve](std::size_t a, std::size_t b) {
+            auto &a_pointers = structs[a].pointers;
+            auto &b_pointers = structs[b].pointers;
+            std::size_t pointer_count = a_pointers.size();
+            if(pointer_count != b_pointers.size()) {
+                return false;
+            }
+            for(std::size_t p = 0; p < pointer_count; p++) {
+                if(a_pointers[p].offset != b_pointers[p].offset || resolve(a_pointers[p].struct_index) != resolve(b_pointers[p].struct_index)) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        // Merging a struct into a larger one changes the pointers of every struct that pointed to it, which can make
+        // those structs the same as others, too, so keep going until no more structs are merged that way
+        bool merged_prefix = true;
+        while(merged_prefix) {
+            merged_prefix = false;
+
+            // Go through structs bottom-up (children before parents) so that every struct's pointers are already
+            // remapped when it is hashed, letting identical subtrees collapse in a single pass
+            std::unordered_map<std::size_t, std::vector<std::size_t>> buckets;
+            std::vector<std::uint8_t> visited(struct_count);
+            std::vector<std::pair<std::size_t, std::size_t>> stack;
+            for(std::size_t root = 0; root < struct_count; root++) {
+                if(visited[root]) {
                     continue;
                 }
-                for(std::size_t j = i + 1; j < struct_count; j++) {
-                    if(this->structs[j].unsafe_to_dedupe) {
+                visited[root] = 1;
+                stack.emplace_back(root, 0);
+                while(!stack.empty()) {
+                    auto &[struct_index, next_pointer] = stack.back();
+                    auto &pointers = structs[struct_index].pointers;
+                    if(next_pointer < pointers.size()) {
+                        auto child = resolve(pointers[next_pointer++].struct_index);
+                        if(!visited[child]) {
+                            visited[child] = 1;
+                            stack.emplace_back(child, 0);
+                        }
                         continue;
                     }
 
-                    // Check if the structs are the same
-                    if(this->structs[i].can_dedupe(this->structs[j])) {
-                        // If so, go through every struct pointer. If they equal j, set to i. If they're greater than j, decrement
-                        for(std::size_t k = 0; k < struct_count; k++) {
-                            for(auto &pointer : this->structs[k].pointers) {
-                                auto &struct_index = pointer.struct_index;
-                                if(struct_index == j) {
-                                    struct_index = i;
-                                }
-                            }
-                        }
+                    std::size_t k = struct_index;
+                    stack.pop_back();
 
-                        // Also go through every tag, too
-                        for(auto &tag : this->tags) {
-                            if(tag.base_struct.has_value()) {
-                                auto &base_struct = tag.base_struct.value();
-                                if(base_struct == j) {
-                                    base_struct = i;
-                                }
-                            }
-                        }
+                    auto &s = structs[k];
+                    if(s.unsafe_to_dedupe) {
+                        continue;
+                    }
 
-                        total_savings += this->structs[j].data.size();
-                        this->structs[j].unsafe_to_dedupe = true;
+                    auto &bucket = buckets[hash_struct(k)];
+                    bool deduped = false;
+                    for(auto candidate : bucket) {
+                        auto &c = structs[candidate];
+                        if((!c.bsp.has_value() || c.bsp == s.bsp) && c.data == s.data && c.dependencies == s.dependencies && same_pointers(candidate, k)) {
+                            merge(k, candidate);
+                            deduped = true;
+                            break;
+                        }
+                    }
+                    if(!deduped) {
+                        bucket.emplace_back(k);
+                    }
+                }
+            }
 
-                        found_something = true;
+            // Next, a struct whose data is a prefix of another struct with the same dependencies and pointers can be
+            // replaced by it, too. Group the remaining structs by everything but their data, then sort each group by
+            // data; any struct that is a prefix of another is immediately followed by one in that order.
+            std::unordered_map<std::size_t, std::vector<std::size_t>> groups;
+            for(auto &bucket : buckets) {
+                for(auto k : bucket.second) {
+                    auto &s = structs[k];
+                    std::size_t hash = s.bsp.has_value() ? *s.bsp + 1 : 0;
+                    for(auto &d : s.dependencies) {
+                        hash = hash * 31 + d.tag_index;
+                        hash = hash * 31 + d.offset;
                     }
+                    for(auto &p : s.pointers) {
+                        hash = hash * 31 + resolve(p.struct_index);
+                        hash = hash * 31 + p.offset;
+                    }
+                    groups[hash].emplace_back(k);
                 }
             }
+            for(auto &group : groups) {
+                auto &members = group.second;
+                if(members.size() < 2) {
+                    continue;
+                }
+                std::sort(members.begin(), members.end(), [&structs](std::size_t a, std::size_t b) {
+                    return structs[a].data < structs[b].data;
+                });
+                std::size_t member_count = members.size();
+                for(std::size_t m = member_count - 1; m > 0; m--) {
+                    auto smaller = members[m - 1];
+                    auto larger = resolve(members[m]);
+                    auto &smaller_s = structs[smaller];
+                    auto &larger_s = structs[larger];
+                    std::size_t smaller_size = smaller_s.data.size();
+                    if(smaller_s.bsp == larger_s.bsp &&
+                       smaller_s.dependencies == larger_s.dependencies &&
+                       same_pointers(smaller, larger) &&
+                       larger_s.data.size() >= smaller_size &&
+                       std::memcmp(larger_s.data.data(), smaller_s.data.data(), smaller_size) == 0) {
+                        merge(smaller, larger);
+                        merged_prefix = true;
+                    }
+                }
+            }
+        }
+
+        // Lastly, point everything at the structs that replaced what they pointed to
+        for(auto &s : structs) {
+            for(auto &pointer : s.pointers) {
+                pointer.struct_index = resolve(pointer.struct_index);
+            }
         }
+        for(auto &tag : this->tags) {
+            if(tag.base_struct.has_value()) {
+                tag.base_struct = resolve(*tag.base_struct);
+            }
+        }
+
         oprintf(" done; reduced tag space usage by %.02f MiB\n", BYTES_TO_MiB(total_savings));
     }
 
@@ -1038,6 +1765,7 @@ namespace Invader {
         
         auto &tag = workload.tags.emplace_back();
         tag.path = "unknown";
+        workload.index_tag(0);
         workload.compile_tag_data_recursively(tag_data, tag_data_size, 0);
         return workload;
     }
@@ -1066,20 +1794,14 @@ namespace Invader {
         }
         TAG_ARRAY_STRUCT.data.reserve(TAG_ARRAY_STRUCT.data.size() + potential_size);
 
-        // Tag path
+        // Tag path (tags with the same path share the same string)
+        std::unordered_map<std::string, std::size_t> path_offsets;
+        path_offsets.reserve(tag_count);
         for(std::size_t t = 0; t < tag_count; t++) {
-            bool found = false;
             auto &tag = tags[t];
-            for(std::size_t t2 = 0; t2 < t; t2++) {
-                auto &tag2 = tags[t2];
-                if(tag2.path == tag.path) {
-                    tag.path_offset = tag2.path_offset;
-                    found = true;
-                    break;
-                }
-            }
-            if(!found) {
-                tag.path_offset = TAG_ARRAY_STRUCT.data.size();
+            auto path_offset = path_offsets.emplace(tag.path, TAG_ARRAY_STRUCT.data.size());
+            tag.path_offset = path_offset.first->second;
+            if(path_offset.second) {
                 const std::byte *tag_path_str = reinterpret_cast<const std::byte *>(tag.path.c_str());
                 TAG_ARRAY_STRUCT.data.insert(TAG_ARRAY_STRUCT.data.end(), tag_path_str, tag_path_str + 1 + tag.path.size());
             }
@@ -1176,10 +1898,6 @@ namespace Invader {
         auto &tags = this->tags;
         std::size_t tag_count = tags.size();
 
-        // Pointer offset to what struct
-        using PointerInternal = std::pair<std::size_t, std::size_t>;
-        std::vector<PointerInternal> pointers;
-        std::vector<PointerInternal> pointers_64_bit;
         auto name_tag_data_pointer = this->parameters->details.build_tag_data_address;
         auto &tag_array_struct = TAG_ARRAY_STRUCT;
 
@@ -1189,67 +1907,76 @@ namespace Invader {
 
         auto &engine_target = this->parameters->details.build_cache_file_engine;
 
-        auto recursively_generate_data = [&structs, &tags, &pointers, &pointers_64_bit, &pointer_of_tag_path, &engine_target](std::vector<std::byte> &data, std::size_t struct_index, auto &recursively_generate_data) {
+        // Give each struct that hasn't been laid out yet an offset, adding it to the order it's laid out in
+        auto lay_out_structs = [&structs](std::size_t struct_index, std::vector<std::size_t> &order, std::size_t &size, auto &lay_out_structs) -> void {
             auto &s = structs[struct_index];
 
-            // Return the pointer thingy
+            // Already laid out
             if(s.offset.has_value()) {
                 return;
             }
 
             // Set the offset thingy
-            std::size_t offset = data.size();
-            s.offset = offset;
-            data.insert(data.end(), s.data.begin(), s.data.end());
+            s.offset = size;
+            order.emplace_back(struct_index);
+            size += s.data.size();
 
             // Get the pointers
             for(auto &pointer : s.pointers) {
-                recursively_generate_data(data, pointer.struct_index, recursively_generate_data);
-                PointerInternal pointer_internal(pointer.offset + offset, pointer.struct_index);
-                if(engine_target != HEK::CacheFileEngine::CACHE_FILE_NATIVE || pointer.limit_to_32_bits) {
-                    pointers.emplace_back(pointer_internal);
-                }
-                else {
-                    pointers_64_bit.emplace_back(pointer_internal);
-                }
+                lay_out_structs(pointer.struct_index, order, size, lay_out_structs);
             }
 
-            // Get the pointers
-            for(auto &dependency : s.dependencies) {
-                auto tag_index = dependency.tag_index;
-                std::uint32_t full_id = static_cast<std::uint32_t>(tag_index + 0xE741) << 16 | static_cast<std::uint16_t>(tag_index);
-                HEK::TagID new_tag_id = { full_id };
+            // Append stuff
+            size += REQUIRED_PADDING_32_BIT(size);
+        };
 
-                if(dependency.tag_id_only) {
-                    *reinterpret_cast<HEK::LittleEndian<HEK::TagID> *>(data.data() + offset + dependency.offset) = new_tag_id;
+        // Copy the laid out structs into the data and fix their pointers and dependencies; this only reads the workload, so it can be done on multiple threads at once
+        auto write_structs = [&structs, &tags, &pointer_of_tag_path, &engine_target, &name_tag_data_pointer](std::vector<std::byte> &data, const std::vector<std::size_t> &order, HEK::Pointer64 bsp_data_base) {
+            for(auto struct_index : order) {
+                auto &s = structs[struct_index];
+                auto *struct_data = data.data() + *s.offset;
+                std::copy(s.data.begin(), s.data.end(), struct_data);
+
+                // Get the pointers
+                for(auto &pointer : s.pointers) {
+                    auto &struct_pointed_to = structs[pointer.struct_index];
+                    auto base = struct_pointed_to.bsp.has_value() ? bsp_data_base : name_tag_data_pointer;
+                    if(engine_target != HEK::CacheFileEngine::CACHE_FILE_NATIVE || pointer.limit_to_32_bits) {
+                        *reinterpret_cast<HEK::LittleEndian<HEK::Pointer> *>(struct_data + pointer.offset) = static_cast<HEK::Pointer>(base + *struct_pointed_to.offset);
+                    }
+                    else {
+                        *reinterpret_cast<HEK::LittleEndian<HEK::Pointer64> *>(struct_data + pointer.offset) = static_cast<HEK::Pointer64>(base + *struct_pointed_to.offset);
+                    }
                 }
-                else {
-                    auto &dependency_struct = *reinterpret_cast<HEK::TagDependency<HEK::LittleEndian> *>(data.data() + offset + dependency.offset);
-                    dependency_struct.tag_class_int = tags[tag_index].tag_class_int;
-                    dependency_struct.tag_id = new_tag_id;
-                    if(engine_target != HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
-                        dependency_struct.path_pointer = pointer_of_tag_path(tag_index);
+
+                // Get the dependencies
+                for(auto &dependency : s.dependencies) {
+                    auto tag_index = dependency.tag_index;
+                    std::uint32_t full_id = static_cast<std::uint32_t>(tag_index + 0xE741) << 16 | static_cast<std::uint16_t>(tag_index);
+                    HEK::TagID new_tag_id = { full_id };
+
+                    if(dependency.tag_id_only) {
+                        *reinterpret_cast<HEK::LittleEndian<HEK::TagID> *>(struct_data + dependency.offset) = new_tag_id;
+                    }
+                    else {
+                        auto &dependency_struct = *reinterpret_cast<HEK::TagDependency<HEK::LittleEndian> *>(struct_data + dependency.offset);
+                        dependency_struct.tag_class_int = tags[tag_index].tag_class_int;
+                        dependency_struct.tag_id = new_tag_id;
+                        if(engine_target != HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
+                            dependency_struct.path_pointer = pointer_of_tag_path(tag_index);
+                        }
                     }
                 }
             }
-
-            // Append stuff
-            data.insert(data.end(), REQUIRED_PADDING_32_BIT(data.size()), std::byte());
         };
 
         // Build the tag data for the main tag data
-        auto &tag_data_struct = this->map_data_structs.emplace_back();
-        recursively_generate_data(tag_data_struct, 0, recursively_generate_data);
-        auto *tag_data_b = tag_data_struct.data();
-
-        // Adjust the pointers
-        for(auto &p : pointers) {
-            *reinterpret_cast<HEK::LittleEndian<HEK::Pointer> *>(tag_data_b + p.first) = static_cast<HEK::Pointer>(name_tag_data_pointer + *this->structs[p.second].offset);
-        }
-
-        for(auto &p : pointers_64_bit) {
-            *reinterpret_cast<HEK::LittleEndian<HEK::Pointer64> *>(tag_data_b + p.first) = static_cast<HEK::Pointer64>(name_tag_data_pointer + *this->structs[p.second].offset);
-        }
+        this->map_data_structs.reserve(this->bsp_count + 1);
+        std::vector<std::size_t> tag_data_order;
+        std::size_t tag_data_size = 0;
+        lay_out_structs(0, tag_data_order, tag_data_size, lay_out_structs);
+        auto &tag_data_struct = this->map_data_structs.emplace_back(tag_data_size);
+        write_structs(tag_data_struct, tag_data_order, name_tag_data_pointer);
 
         // Get the tag path pointers working
         auto *tag_array = reinterpret_cast<HEK::CacheFileTagDataTag *>(tag_data_struct.data() + *TAG_ARRAY_STRUCT.offset);
@@ -1275,6 +2002,13 @@ namespace Invader {
                 auto scenario_bsps_struct_index = *structs[*scenario_tag.base_struct].resolve_pointer(reinterpret_cast<const std::byte *>(&scenario_tag_data.structure_bsps.pointer) - reinterpret_cast<const std::byte *>(&scenario_tag_data));
                 auto *scenario_bsps_struct_data = reinterpret_cast<Parser::ScenarioBSP::struct_little *>(map_data_structs[0].data() + *structs[scenario_bsps_struct_index].offset);
 
+                // Each BSP gets its own data, so lay them all out first, and then they can be written in parallel
+                struct BSPData {
+                    std::vector<std::size_t> order;
+                    HEK::Pointer64 tag_data_base;
+                };
+                std::vector<BSPData> bsps;
+
                 // Go through each BSP tag
                 for(std::size_t i = 0; i < tag_count; i++) {
                     auto &t = tags[i];
@@ -1285,38 +2019,24 @@ namespace Invader {
                     // Do it!
                     auto &base_struct = *t.base_struct;
 
-                    // Build the tag data for the BSP data now
-                    pointers.clear();
-                    pointers_64_bit.clear();
-                    auto &bsp_data_struct = this->map_data_structs.emplace_back();
-                    recursively_generate_data(bsp_data_struct, base_struct, recursively_generate_data);
-                    std::size_t bsp_size = bsp_data_struct.size();
+                    // Lay out the tag data for the BSP data now
+                    auto &bsp = bsps.emplace_back();
+                    std::size_t bsp_size = 0;
+                    lay_out_structs(base_struct, bsp.order, bsp_size, lay_out_structs);
+                    this->map_data_structs.emplace_back(bsp_size);
 
                     if(bsp_size > max_bsp_size) {
                         REPORT_ERROR_PRINTF(*this, ERROR_TYPE_FATAL_ERROR, i, "BSP size exceeds the maximum size for this engine (%zu > %zu)\n", bsp_size, max_bsp_size);
                         throw InvalidTagDataException();
                     }
 
-                    HEK::Pointer64 tag_data_base;
+                    HEK::Pointer64 &tag_data_base = bsp.tag_data_base;
                     if(engine_target != HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
                         tag_data_base = this->parameters->details.build_tag_data_address + this->parameters->details.build_maximum_tag_space - bsp_size;
                     }
                     else {
                         tag_data_base = 0;
                     }
-                    tag_data_b = bsp_data_struct.data();
-
-                    // Chu
-                    for(auto &p : pointers) {
-                        auto &struct_pointed_to = this->structs[p.second];
-                        auto base = struct_pointed_to.bsp.has_value() ? tag_data_base : name_tag_data_pointer;
-                        *reinterpret_cast<HEK::LittleEndian<HEK::Pointer> *>(tag_data_b + p.first) = static_cast<HEK::Pointer>(base + *struct_pointed_to.offset);
-                    }
-                    for(auto &p : pointers_64_bit) {
-                        auto &struct_pointed_to = this->structs[p.second];
-                        auto base = struct_pointed_to.bsp.has_value() ? tag_data_base : name_tag_data_pointer;
-                        *reinterpret_cast<HEK::LittleEndian<HEK::Pointer64> *>(tag_data_b + p.first) = static_cast<HEK::Pointer64>(base + *struct_pointed_to.offset);
-                    }
 
                     // Find the BSP in the scenario array thingy
                     bool found = false;
@@ -1336,6 +2056,24 @@ namespace Invader {
                         REPORT_ERROR_PRINTF(*this, ERROR_TYPE_ERROR, this->scenario_index, "Scenario structure BSP array is missing %s.%s", File::halo_path_to_preferred_path(t.path).c_str(), HEK::tag_class_to_extension(t.tag_class_int));
                     }
                 }
+
+                // Write the BSPs, each on whichever thread gets to it first
+                auto *bsp_data = this->map_data_structs.data() + 1;
+                std::atomic<std::size_t> next_bsp = 0;
+                auto write_bsps = [&bsps, &bsp_data, &next_bsp, &write_structs]() {
+                    for(std::size_t b; (b = next_bsp++) < bsps.size();) {
+                        write_structs(bsp_data[b], bsps[b].order, bsps[b].tag_data_base);
+                    }
+                };
+                std::vector<std::thread> threads;
+                std::size_t thread_count = std::min(this->parameters->max_threads, bsps.size());
+                for(std::size_t t = 1; t < thread_count; t++) {
+                    threads.emplace_back(write_bsps);
+                }
+                write_bsps();
+                for(auto &t : threads) {
+                    t.join();
+                }
             }
         }
         return bsp_end;
@@ -1353,11 +2091,18 @@ namespace Invader {
         // Offset followed by size
         std::vector<std::pair<std::size_t, std::size_t>> all_assets;
 
-        auto add_or_dedupe_asset = [&all_assets, &all_raw_data](const std::vector<std::byte> &raw_data, std::size_t &counter) -> std::uint32_t {
+        // Assets by hash of their data, so only assets with the same hash need to be compared
+        std::unordered_map<std::size_t, std::vector<std::size_t>> assets_by_hash;
+
+        auto add_or_dedupe_asset = [this, &all_assets, &all_raw_data, &assets_by_hash](const std::vector<std::byte> &raw_data, std::size_t &counter) -> std::uint32_t {
             std::size_t raw_data_size = raw_data.size();
-            for(auto &a : all_assets) {
-                if(a.second == raw_data_size && std::memcmp(raw_data.data(), all_raw_data.data() + a.first, raw_data_size) == 0) {
-                    return static_cast<std::uint32_t>(&a - all_assets.data());
+            auto &same_hash = assets_by_hash[std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char *>(raw_data.data()), raw_data_size))];
+            for(auto a : same_hash) {
+                auto &asset = all_assets[a];
+                if(asset.second == raw_data_size && std::memcmp(raw_data.data(), all_raw_data.data() + asset.first, raw_data_size) == 0) {
+                    this->deduped_raw_data_count++;
+                    this->deduped_raw_data_size += raw_data_size;
+                    return static_cast<std::uint32_t>(a);
                 }
             }
 
@@ -1366,6 +2111,7 @@ namespace Invader {
             new_asset.second = raw_data_size;
             counter += raw_data_size;
             all_raw_data.insert(all_raw_data.end(), raw_data.begin(), raw_data.end());
+            same_hash.emplace_back(all_assets.size() - 1);
             return static_cast<std::uint32_t>(all_assets.size() - 1);
         };
 
@@ -1454,6 +2200,87 @@ namespace Invader {
         }
     }
 
+    /** Index of each tag in a resource map by its path */
+    using ResourcePathIndex = std::unordered_map<std::string_view, std::size_t>;
+
+    /**
+     * Index the tags in a resource map by path. If a path appears more than once, the first one is used.
+     * @param resources   resources to index
+     * @param every_other only index odd resources (bitmaps and sounds, where even resources are raw data)
+     * @return            index
+     */
+    static ResourcePathIndex index_resource_paths(const std::optional<ResourceMap> &resources, bool every_other) {
+        ResourcePathIndex index;
+        if(resources.has_value()) {
+            std::size_t count = resources->size();
+            std::size_t iterate_count = every_other ? 2 : 1;
+            index.reserve(count / iterate_count);
+            for(std::size_t i = iterate_count - 1; i < count; i += iterate_count) {
+                index.emplace((*resources)[i].path, i);
+            }
+        }
+        return index;
+    }
+
+    /** Resource data is indexed by a hash of up to this many bytes from its start */
+    static constexpr std::size_t RESOURCE_DATA_PREFIX_LENGTH = 256;
+
+    /** Indices of resources by the hash of the start of their data, in order */
+    using ResourceDataIndex = std::unordered_map<std::size_t, std::vector<std::size_t>>;
+
+    static std::size_t hash_resource_data_prefix(const std::byte *data, std::size_t size) noexcept {
+        return std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char *>(data), std::min(size, RESOURCE_DATA_PREFIX_LENGTH)));
+    }
+
+    /**
+     * Index each resource by the hash of the start of its data
+     * @param resources resources to index
+     * @return          index
+     */
+    static ResourceDataIndex index_resource_data(const ResourceMap &resources) {
+        ResourceDataIndex index;
+        index.reserve(resources.size());
+        for(std::size_t i = 0; i < resources.size(); i++) {
+            index[hash_resource_data_prefix(resources[i].data.data(), resources[i].data.size())].emplace_back(i);
+        }
+        return index;
+    }
+
+    /**
+     * Find the first resource whose data starts with the given data
+     * @param resources resources to search
+     * @param index     index of the resources' data
+     * @param data      data to find
+     * @param size      size of the data
+     * @return          resource if found
+     */
+    static const Resource *find_resource_data(const ResourceMap &resources, const ResourceDataIndex &index, const std::byte *data, std::size_t size) noexcept {
+        auto starts_with_data = [&data, &size](const Resource &resource) {
+            return resource.data.size() >= size && std::memcmp(resource.data.data(), data, size) == 0;
+        };
+
+        // Anything this short would have a different hash than a longer resource it's the start of, so check everything
+        if(size < RESOURCE_DATA_PREFIX_LENGTH) {
+            for(auto &resource : resources) {
+                if(starts_with_data(resource)) {
+                    return &resource;
+                }
+            }
+            return nullptr;
+        }
+
+        // Otherwise, only resources that start with the same bytes can match
+        auto candidates = index.find(hash_resource_data_prefix(data, size));
+        if(candidates != index.end()) {
+            for(auto i : candidates->second) {
+                if(starts_with_data(resources[i])) {
+                    return &resources[i];
+                }
+            }
+        }
+        return nullptr;
+    }
+
     void BuildWorkload::externalize_tags() noexcept {
         bool always_index_tags = this->parameters->details.build_raw_data_handling == BuildParameters::BuildParametersDetails::RawDataHandling::RAW_DATA_HANDLING_ALWAYS_INDEX;
         
@@ -1462,35 +2289,24 @@ namespace Invader {
         auto &loc = this->parameters->loc_data;
 
         switch(this->parameters->details.build_cache_file_engine) {
-            case HEK::CacheFileEngine::CACHE_FILE_CUSTOM_EDITION:
+            case HEK::CacheFileEngine::CACHE_FILE_CUSTOM_EDITION: {
+                auto bitmap_paths = index_resource_paths(bitmaps, true);
+                auto sound_paths = index_resource_paths(sounds, true);
+                auto loc_paths = index_resource_paths(loc, false);
+                
                 for(auto &t : this->tags) {
                     // Find the tag
-                    auto find_tag_index = [](const std::string &path, const std::optional<std::vector<Resource>> &resources, bool every_other) -> std::optional<std::size_t> {
-                        if(!resources.has_value()) {
+                    auto find_tag_index = [](const std::string &path, const ResourcePathIndex &paths) -> std::optional<std::size_t> {
+                        auto index = paths.find(path);
+                        if(index == paths.end()) {
                             return std::nullopt;
                         }
-                        
-                        std::size_t count = resources->size();
-                        std::size_t iterate_count, iterate_start;
-                        if(every_other) {
-                            iterate_count = 2;
-                            iterate_start = 1;
-                        }
-                        else {
-                            iterate_count = 1;
-                            iterate_start = 0;
-                        }
-                        for(std::size_t i = iterate_start; i < count; i += iterate_count) {
-                            if((*resources)[i].path == path) {
-                                return i;
-                            }
-                        }
-                        return std::nullopt;
+                        return index->second;
                     };
 
                     switch(t.tag_class_int) {
                         case TagClassInt::TAG_CLASS_BITMAP: {
-                            auto index = find_tag_index(t.path, bitmaps, true);
+                            auto index = find_tag_index(t.path, bitmap_paths);
                             if(index.has_value()) {
                                 if((*index % 2) == 0) {
                                     REPORT_ERROR_PRINTF(*this, ERROR_TYPE_ERROR, std::nullopt, "%s in bitmaps.map appears to be corrupt (tag is on an even index)", File::halo_path_to_preferred_path(t.path).c_str());
@@ -1670,7 +2486,7 @@ namespace Invader {
                             break;
                         }
                         case TagClassInt::TAG_CLASS_SOUND: {
-                            auto index = find_tag_index(t.path, sounds, true);
+                            auto index = find_tag_index(t.path, sound_paths);
                             if(index.has_value()) {
                                 if((*index % 2) == 0) {
                                     REPORT_ERROR_PRINTF(*this, ERROR_TYPE_ERROR, std::nullopt, "%s in sounds.map appears to be corrupt (tag is on an even index)", File::halo_path_to_preferred_path(t.path).c_str());
@@ -1829,7 +2645,7 @@ namespace Invader {
                         case TagClassInt::TAG_CLASS_FONT:
                         case TagClassInt::TAG_CLASS_UNICODE_STRING_LIST:
                         case TagClassInt::TAG_CLASS_HUD_MESSAGE_TEXT: {
-                            auto index = find_tag_index(t.path, loc, false);
+                            auto index = find_tag_index(t.path, loc_paths);
                             if(index.has_value()) {
                                 bool match = true;
 
@@ -2089,8 +2905,17 @@ namespace Invader {
                     }
                 }
                 break;
+            }
             case HEK::CacheFileEngine::CACHE_FILE_RETAIL:
-            case HEK::CacheFileEngine::CACHE_FILE_DEMO:
+            case HEK::CacheFileEngine::CACHE_FILE_DEMO: {
+                ResourceDataIndex bitmap_data_index, sound_data_index;
+                if(bitmaps.has_value()) {
+                    bitmap_data_index = index_resource_data(*bitmaps);
+                }
+                if(sounds.has_value()) {
+                    sound_data_index = index_resource_data(*sounds);
+                }
+                
                 for(auto &t : this->tags) {
                     switch(t.tag_class_int) {
                         // Iterate through each permutation in each pitch range to find the bitmap
@@ -2108,15 +2933,13 @@ namespace Invader {
                                     std::size_t raw_data_size = raw_data.size();
 
                                     // Find bitmaps
-                                    for(auto &ab : *bitmaps) {
-                                        if(ab.data.size() >= raw_data_size && std::memcmp(ab.data.data(), raw_data_data, raw_data_size) == 0) {
-                                            this->delete_raw_data(raw_data_index);
-                                            bitmap_data.pixel_data_offset = static_cast<std::uint32_t>(ab.data_offset);
-                                            auto flags = bitmap_data.flags.read();
-                                            flags |= HEK::BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_EXTERNAL;
-                                            bitmap_data.flags = flags;
-                                            break;
-                                        }
+                                    auto *ab = find_resource_data(*bitmaps, bitmap_data_index, raw_data_data, raw_data_size);
+                                    if(ab) {
+                                        this->delete_raw_data(raw_data_index);
+                                        bitmap_data.pixel_data_offset = static_cast<std::uint32_t>(ab->data_offset);
+                                        auto flags = bitmap_data.flags.read();
+                                        flags |= HEK::BitmapDataFlagsFlag::BITMAP_DATA_FLAGS_FLAG_EXTERNAL;
+                                        bitmap_data.flags = flags;
                                     }
                                 }
                             }
@@ -2145,13 +2968,11 @@ namespace Invader {
                                             std::size_t raw_data_size = raw_data.size();
 
                                             // Find sounds
-                                            for(auto &ab : *sounds) {
-                                                if(ab.data.size() >= raw_data_size && std::memcmp(ab.data.data(), raw_data_data, raw_data_size) == 0) {
-                                                    this->delete_raw_data(raw_data_index);
-                                                    permutation.samples.file_offset = static_cast<std::uint32_t>(ab.data_offset);
-                                                    permutation.samples.external = 1;
-                                                    break;
-                                                }
+                                            auto *ab = find_resource_data(*sounds, sound_data_index, raw_data_data, raw_data_size);
+                                            if(ab) {
+                                                this->delete_raw_data(raw_data_index);
+                                                permutation.samples.file_offset = static_cast<std::uint32_t>(ab->data_offset);
+                                                permutation.samples.external = 1;
                                             }
                                         }
                                     }
@@ -2164,6 +2985,7 @@ namespace Invader {
                     }
                 }
                 break;
+            }
             default:
                 break;
         }
@@ -234,20 +234,20 @@ int main(int argc, const char **argv) {
             
         if(i.map.has_value()) {
             // Load resource maps
-            std::vector<std::byte> loc, bitmaps, sounds;
+            File::MappedFile loc, bitmaps, sounds;
             if(i.maps.has_value() && !i.ignore_resource_maps) {
-                loc = File::open_file(*i.maps / "loc.map").value_or(std::vector<std::byte>());
-                bitmaps = File::open_file(*i.maps / "bitmaps.map").value_or(std::vector<std::byte>());
-                sounds = File::open_file(*i.maps / "sounds.map").value_or(std::vector<std::byte>());
+                loc = File::map_file(*i.maps / "loc.map").value_or(File::MappedFile());
+                bitmaps = File::map_file(*i.maps / "bitmaps.map").value_or(File::MappedFile());
+                sounds = File::map_file(*i.maps / "sounds.map").value_or(File::MappedFile());
             }
         
-            auto data = File::open_file(*i.map);
+            auto data = File::map_file(*i.map);
             if(!data.has_value()) {
                 eprintf_error("Failed to read %s", i.map->string().c_str());
                 return EXIT_FAILURE;
             }
             
-            auto &map = *(i.map_data = std::make_unique<Map>(Map::map_with_move(*std::move(data),std::move(bitmaps),std::move(loc),std::move(sounds))));
+            auto &map = *(i.map_data = std::make_unique<Map>(Map::map_with_lazy_decompression(*std::move(data),std::move(bitmaps),std::move(loc),std::move(sounds))));
             
             // Warn if we failed to open some resource maps
             if(!i.ignore_resource_maps) {
@@ -426,18 +426,27 @@ static void regular_comparison(const std::vector<Input> &inputs, bool precision,
             // If it's a map, do this
             if(i.map.has_value()) {
                 // First, extract it
-                auto tag_count = i.map_data->get_tag_count();
-                for(std::size_t t = 0; t < tag_count; t++) {
+                auto extract_map_tag = [&i, &structs, &struct_paths, &struct_inputs](std::size_t t) {
                     auto &map_tag = i.map_data->get_tag(t);
-                    auto &map_tag_path = map_tag.get_path();
-                    if(map_tag.get_tag_class_int() == tag.class_int && CAN_COMPARE(by_path_copy, tag.path, map_tag_path)) {
-                        auto extracted_data = Invader::ExtractionWorkload::extract_single_tag(i.map_data->get_tag(t));
-                        structs.emplace_back(Parser::ParserStruct::parse_hek_tag_file(extracted_data.data(), extracted_data.size(), true));
-                        struct_paths.emplace_back(map_tag_path);
-                        struct_inputs.emplace_back(&i);
-                            
-                        if(only_finding_same_tag) {
-                            break;
+                    auto extracted_data = Invader::ExtractionWorkload::extract_single_tag(map_tag);
+                    structs.emplace_back(Parser::ParserStruct::parse_hek_tag_file(extracted_data.data(), extracted_data.size(), true));
+                    struct_paths.emplace_back(map_tag.get_path());
+                    struct_inputs.emplace_back(&i);
+                };
+
+                // If we only want the same tag, we can look it up directly
+                if(only_finding_same_tag) {
+                    auto t = i.map_data->find_tag(tag.path.c_str(), tag.class_int);
+                    if(t.has_value()) {
+                        extract_map_tag(*t);
+                    }
+                }
+                else {
+                    auto tag_count = i.map_data->get_tag_count();
+                    for(std::size_t t = 0; t < tag_count; t++) {
+                        auto &map_tag = i.map_data->get_tag(t);
+                        if(map_tag.get_tag_class_int() == tag.class_int && CAN_COMPARE(by_path_copy, tag.path, map_tag.get_path())) {
+                            extract_map_tag(t);
                         }
                     }
                 }
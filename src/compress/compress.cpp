@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include <chrono>
+#include <thread>
 #include <zstd.h>
 #include <invader/command_line_option.hpp>
 #include <invader/printf.hpp>
@@ -21,6 +22,9 @@ int main(int argc, const char **argv) {
         long compression_level = 19;
         bool decompress = false;
         bool ceaflate = false;
+        std::size_t max_threads = std::thread::hardware_concurrency() < 1 ? 1 : std::thread::hardware_concurrency();
+        bool long_distance_matching = false;
+        std::size_t frame_size = 0;
     } compress_options;
 
     std::vector<CommandLineOption> options;
@@ -29,6 +33,9 @@ int main(int argc, const char **argv) {
     options.emplace_back("output", 'o', 1, "Emit the resulting map at the given path. By default, this is the map path (overwrite).", "<file>");
     options.emplace_back("level", 'l', 1, "Set the compression level. Must be between 1 and 19. If compressing an Xbox or MCC map, this will be clamped from 1 to 9. Default: 19", "<level>");
     options.emplace_back("decompress", 'd', 0, "Decompress instead of compress.");
+    options.emplace_back("threads", 'j', 1, "Set the number of threads to use when compressing. The output is the same regardless of thread count. Default: CPU thread count", "<#>");
+    options.emplace_back("long", 'L', 0, "Use long distance matching when compressing with Zstandard. This improves compression of large maps at the cost of memory.");
+    options.emplace_back("frame-size", 'F', 1, "Compress native maps in independent frames of the given size in KiB, so parts of the map can be read without decompressing all of it. Default: one frame", "<KiB>");
 
     static constexpr char DESCRIPTION[] = "Compress cache files.";
     static constexpr char USAGE[] = "[options] <map>";
@@ -45,6 +52,35 @@ int main(int argc, const char **argv) {
                     std::exit(EXIT_FAILURE);
                 }
                 break;
+            case 'j':
+                try {
+                    auto max_threads = std::stoi(arguments[0]);
+                    if(max_threads < 1) {
+                        throw std::exception();
+                    }
+                    compress_options.max_threads = static_cast<std::size_t>(max_threads);
+                }
+                catch(std::exception &) {
+                    eprintf_error("Invalid number of threads %s\n", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
+            case 'L':
+                compress_options.long_distance_matching = true;
+                break;
+            case 'F':
+                try {
+                    auto frame_size = std::stoul(arguments[0]);
+                    if(frame_size < 1 || frame_size > UINT32_MAX / 1024) {
+                        throw std::exception();
+                    }
+                    compress_options.frame_size = static_cast<std::size_t>(frame_size) * 1024;
+                }
+                catch(std::exception &) {
+                    eprintf_error("Invalid frame size %s\n", arguments[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
             case 'M':
                 compress_options.ceaflate = true;
                 break;
@@ -93,7 +129,7 @@ int main(int argc, const char **argv) {
                 }
             }
             else {
-                decompressed_data = Compression::ceaflate_decompress(input_file_data.data(), input_file_data.size());
+                decompressed_data = Compression::ceaflate_decompress(input_file_data.data(), input_file_data.size(), compress_options.max_threads);
             }
         }
         catch(Invader::MapNeedsCompressedException &) {
@@ -131,10 +167,14 @@ int main(int argc, const char **argv) {
         std::vector<std::byte> compressed_data;
         try {
             if(!compress_options.ceaflate) {
-                compressed_data = Compression::compress_map_data(input_file_data.data(), input_file_data.size(), static_cast<int>(compress_options.compression_level));
+                Compression::ZstdOptions zstd_options;
+                zstd_options.threads = compress_options.max_threads;
+                zstd_options.long_distance_matching = compress_options.long_distance_matching;
+                zstd_options.frame_size = compress_options.frame_size;
+                compressed_data = Compression::compress_map_data(input_file_data.data(), input_file_data.size(), static_cast<int>(compress_options.compression_level), zstd_options);
             }
             else {
-                compressed_data = Compression::ceaflate_compress(input_file_data.data(), input_file_data.size(), static_cast<int>(compress_options.compression_level));
+                compressed_data = Compression::ceaflate_compress(input_file_data.data(), input_file_data.size(), static_cast<int>(compress_options.compression_level), compress_options.max_threads);
             }
         }
         catch(Invader::MapNeedsDecompressedException &) {
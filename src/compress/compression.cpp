@@ -4,18 +4,34 @@
 #include <invader/map/map.hpp>
 #include <zstd.h>
 #include <cstdio>
+#include <atomic>
 #include <thread>
-#include <filesystem>
 #include <mutex>
+#include <condition_variable>
+#include <filesystem>
+#include <cstring>
+#include <algorithm>
 
 #ifndef DISABLE_ZLIB
 #include <zlib.h>
 #endif
 
 namespace Invader::Compression {
-    template <typename T> static void compress_header(const Map &map, std::byte *header_output, std::size_t decompressed_size) {
-        auto new_engine_version = map.get_engine();
-        switch(new_engine_version) {
+    // Write the header of the compressed map from the header of the uncompressed map, returning the uncompressed map's engine
+    static HEK::CacheFileEngine compress_header(const std::byte *header_input, std::byte *header_output, std::size_t decompressed_size) {
+        // Demo maps lay out their header differently
+        HEK::CacheFileHeader header = *reinterpret_cast<const HEK::CacheFileHeader *>(header_input);
+        if(!header.valid()) {
+            header = *reinterpret_cast<const HEK::CacheFileDemoHeader *>(header_input);
+            if(!header.valid()) {
+                throw InvalidMapException();
+            }
+        }
+        const auto &native_header = *reinterpret_cast<const HEK::NativeCacheFileHeader *>(header_input);
+
+        auto engine = header.engine.read();
+        auto new_engine_version = engine;
+        switch(engine) {
             case HEK::CacheFileEngine::CACHE_FILE_CUSTOM_EDITION:
                 new_engine_version = HEK::CacheFileEngine::CACHE_FILE_CUSTOM_EDITION_COMPRESSED;
                 break;
@@ -26,8 +42,12 @@ namespace Invader::Compression {
                 new_engine_version = HEK::CacheFileEngine::CACHE_FILE_DEMO_COMPRESSED;
                 break;
             case HEK::CacheFileEngine::CACHE_FILE_XBOX:
+                if(header.decompressed_file_size.read() != 0) {
+                    throw MapNeedsDecompressedException();
+                }
+                break;
             case HEK::CacheFileEngine::CACHE_FILE_NATIVE:
-                if(map.get_compression_algorithm()) {
+                if(native_header.compression_type.read() != HEK::NativeCacheFileHeader::NativeCacheFileCompressionType::NATIVE_CACHE_FILE_COMPRESSION_UNCOMPRESSED) {
                     throw MapNeedsDecompressedException();
                 }
                 break;
@@ -39,25 +59,35 @@ namespace Invader::Compression {
                 throw UnsupportedMapEngineException();
         }
 
-        // Write the header
-        auto &header_out = *reinterpret_cast<T *>(header_output);
-        header_out = {};
-        header_out.crc32 = map.get_header_crc32();
-        std::strncpy(header_out.build.string, map.get_build(), sizeof(header_out.build));
-        std::strncpy(header_out.name.string, map.get_scenario_name(), sizeof(header_out.name));
-        header_out.map_type = map.get_type();
-        header_out.engine = new_engine_version;
-        header_out.foot_literal = HEK::CacheFileLiteral::CACHE_FILE_FOOT;
-        header_out.head_literal = HEK::CacheFileLiteral::CACHE_FILE_HEAD;
-        header_out.tag_data_size = map.get_tag_data_length();
-        header_out.tag_data_offset = map.get_tag_data_at_offset(0) - map.get_data_at_offset(0);
-        if(new_engine_version == HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
-            reinterpret_cast<HEK::NativeCacheFileHeader *>(&header_out)->compression_type = HEK::NativeCacheFileHeader::NativeCacheFileCompressionType::NATIVE_CACHE_FILE_COMPRESSION_ZSTD;
-        }
         if(decompressed_size > UINT32_MAX) {
             throw MaximumFileSizeException();
         }
-        header_out.decompressed_file_size = static_cast<std::uint32_t>(decompressed_size);
+
+        // Write the header
+        auto write_header = [&new_engine_version, &decompressed_size](const auto &header_in, auto &header_out) {
+            header_out = {};
+            header_out.crc32 = header_in.crc32;
+            header_out.build = header_in.build;
+            header_out.name = header_in.name;
+            header_out.map_type = header_in.map_type;
+            header_out.engine = new_engine_version;
+            header_out.foot_literal = HEK::CacheFileLiteral::CACHE_FILE_FOOT;
+            header_out.head_literal = HEK::CacheFileLiteral::CACHE_FILE_HEAD;
+            header_out.tag_data_size = header_in.tag_data_size;
+            header_out.tag_data_offset = header_in.tag_data_offset;
+            header_out.decompressed_file_size = static_cast<std::uint32_t>(decompressed_size);
+        };
+        if(engine == HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
+            auto &header_out = *reinterpret_cast<HEK::NativeCacheFileHeader *>(header_output);
+            write_header(native_header, header_out);
+            header_out.timestamp = native_header.timestamp;
+            header_out.compression_type = HEK::NativeCacheFileHeader::NativeCacheFileCompressionType::NATIVE_CACHE_FILE_COMPRESSION_ZSTD;
+        }
+        else {
+            write_header(header, *reinterpret_cast<HEK::CacheFileHeader *>(header_output));
+        }
+
+        return engine;
     }
 
     template <typename T> static void decompress_header(const std::byte *header_input, std::byte *header_output) {
@@ -123,7 +153,11 @@ namespace Invader::Compression {
         
         // Set the type, too, if need be
         if(new_engine_version == HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
-            reinterpret_cast<HEK::NativeCacheFileHeader *>(&header_copy)->compression_type = HEK::NativeCacheFileHeader::NativeCacheFileCompressionType::NATIVE_CACHE_FILE_COMPRESSION_UNCOMPRESSED;
+            auto &native_header = *reinterpret_cast<HEK::NativeCacheFileHeader *>(&header_copy);
+            native_header.compression_type = HEK::NativeCacheFileHeader::NativeCacheFileCompressionType::NATIVE_CACHE_FILE_COMPRESSION_UNCOMPRESSED;
+            native_header.frame_size = 0;
+            native_header.frame_count = 0;
+            native_header.frame_index_offset = 0;
         }
 
         // if demo, convert the header, otherwise copy the header
@@ -139,7 +173,269 @@ namespace Invader::Compression {
 
     constexpr std::size_t HEADER_SIZE = sizeof(HEK::CacheFileHeader);
 
-    std::size_t compress_map_data(const std::byte *data, std::size_t data_size, std::byte *output, std::size_t output_size, int compression_level) {
+    using MapDataSections = std::vector<std::pair<const std::byte *, std::size_t>>;
+
+    // Largest window log that decompressors accept without being told to (ZSTD_WINDOWLOG_LIMIT_DEFAULT, which needs ZSTD_STATIC_LINKING_ONLY)
+    constexpr int ZSTD_MAX_DEFAULT_WINDOW_LOG = 27;
+
+    static ZSTD_CCtx *create_compression_context(int compression_level, const ZstdOptions &zstd_options, std::size_t data_size) {
+        auto *compression_context = ZSTD_createCCtx();
+        if(!compression_context) {
+            throw CompressionFailureException();
+        }
+
+        bool success = !ZSTD_isError(ZSTD_CCtx_setParameter(compression_context, ZSTD_c_compressionLevel, compression_level)) &&
+                       !ZSTD_isError(ZSTD_CCtx_setPledgedSrcSize(compression_context, data_size));
+
+        // If zstd was built without multithreading support, this fails and we just compress on this thread
+        if(success && zstd_options.threads > 0 && !ZSTD_isError(ZSTD_CCtx_setParameter(compression_context, ZSTD_c_nbWorkers, static_cast<int>(zstd_options.threads)))) {
+            if(zstd_options.job_size > 0) {
+                success = !ZSTD_isError(ZSTD_CCtx_setParameter(compression_context, ZSTD_c_jobSize, static_cast<int>(zstd_options.job_size)));
+            }
+        }
+
+        // Don't go past the largest window decompressors accept by default, or decompress_map_data won't be able to read it
+        if(success && zstd_options.long_distance_matching) {
+            success = !ZSTD_isError(ZSTD_CCtx_setParameter(compression_context, ZSTD_c_enableLongDistanceMatching, 1)) &&
+                      !ZSTD_isError(ZSTD_CCtx_setParameter(compression_context, ZSTD_c_windowLog, ZSTD_MAX_DEFAULT_WINDOW_LOG));
+        }
+
+        if(!success) {
+            ZSTD_freeCCtx(compression_context);
+            throw CompressionFailureException();
+        }
+
+        return compression_context;
+    }
+
+    // Size of all of the sections put together
+    static std::size_t sections_size(const MapDataSections &sections) noexcept {
+        std::size_t size = 0;
+        for(auto &s : sections) {
+            size += s.second;
+        }
+        return size;
+    }
+
+    // Get everything in the sections after the given offset
+    static MapDataSections sections_after(const MapDataSections &sections, std::size_t offset) {
+        MapDataSections after;
+        for(auto &s : sections) {
+            if(offset >= s.second) {
+                offset -= s.second;
+                continue;
+            }
+            after.emplace_back(s.first + offset, s.second - offset);
+            offset = 0;
+        }
+        return after;
+    }
+
+    // Get size bytes at the given offset in the sections, copying them into buffer only if they span more than one section
+    static const std::byte *sections_data(const MapDataSections &sections, std::size_t offset, std::size_t size, std::vector<std::byte> &buffer) {
+        buffer.clear();
+        for(auto &s : sections) {
+            if(offset >= s.second) {
+                offset -= s.second;
+                continue;
+            }
+            std::size_t available = s.second - offset;
+            if(buffer.empty() && available >= size) {
+                return s.first + offset;
+            }
+            std::size_t copied = std::min(available, size - buffer.size());
+            buffer.insert(buffer.end(), s.first + offset, s.first + offset + copied);
+            offset = 0;
+            if(buffer.size() == size) {
+                return buffer.data();
+            }
+        }
+        throw OutOfBoundsException();
+    }
+
+    // Compress everything after the header as independent frames, passing each frame to write_data in order, followed by
+    // the frame index in a skippable frame so that anything that reads plain zstd streams skips over it
+    template <typename WriteFunction> static void compress_map_frames(const MapDataSections &input, HEK::NativeCacheFileHeader &header, int compression_level, const ZstdOptions &zstd_options, WriteFunction write_data) {
+        std::size_t frame_size = zstd_options.frame_size;
+        std::size_t input_size = sections_size(input);
+        std::size_t frame_count = (input_size + frame_size - 1) / frame_size;
+        if(frame_size > UINT32_MAX || frame_count > UINT32_MAX) {
+            throw CompressionFailureException();
+        }
+
+        // Each worker takes the next frame that hasn't been taken and compresses it into a slot. A slot is reused once its
+        // frame is written, so workers can only get so far ahead of the frame being written. If no threads were asked for,
+        // frames are compressed on this thread instead.
+        std::size_t thread_count = std::min(zstd_options.threads, frame_count);
+        std::size_t slot_count = std::max<std::size_t>(thread_count * 2, 1);
+        std::size_t slot_size = ZSTD_compressBound(frame_size);
+        auto frame_options = zstd_options;
+        frame_options.threads = 0;
+
+        std::vector<ZSTD_CCtx *> contexts;
+        std::vector<std::byte> slots(slot_size * slot_count);
+        std::vector<std::size_t> output_sizes(slot_count);
+        std::vector<HEK::NativeCacheFileFrame> frames(frame_count);
+        std::size_t offset = HEADER_SIZE;
+
+        // Frames are only copied into the input buffer if they span more than one section
+        auto compress_frame = [&](ZSTD_CCtx *context, std::size_t f, std::vector<std::byte> &input_buffer) {
+            std::size_t frame_offset = f * frame_size;
+            std::size_t frame_input_size = std::min(frame_size, input_size - frame_offset);
+            std::size_t slot_index = f % slot_count;
+            const auto *frame_input = sections_data(input, frame_offset, frame_input_size, input_buffer);
+            output_sizes[slot_index] = ZSTD_compress2(context, slots.data() + slot_size * slot_index, slot_size, frame_input, frame_input_size);
+            return !ZSTD_isError(output_sizes[slot_index]);
+        };
+
+        auto write_frame = [&](std::size_t f) {
+            std::size_t slot_index = f % slot_count;
+            auto &frame = frames[f];
+            frame.offset = offset;
+            frame.size = output_sizes[slot_index];
+            write_data(slots.data() + slot_size * slot_index, output_sizes[slot_index]);
+            offset += output_sizes[slot_index];
+        };
+
+        // slot_frame holds one more than the index of the frame last compressed into each slot, and next_write is the
+        // index of the next frame to write. The mutex is only locked to wait for one of these to change.
+        std::vector<std::atomic<std::size_t>> slot_frame(slot_count);
+        std::atomic<std::size_t> next_frame = 0;
+        std::atomic<std::size_t> next_write = 0;
+        std::atomic<bool> error = false;
+        std::atomic<std::size_t> waiting = 0;
+        std::mutex mutex;
+        std::condition_variable condition;
+
+        auto wait_until = [&](auto ready) {
+            if(ready() || error) {
+                return;
+            }
+            std::unique_lock lock(mutex);
+            waiting++;
+            condition.wait(lock, [&]() { return ready() || error; });
+            waiting--;
+        };
+
+        // Call this after changing slot_frame, next_write, or error
+        auto wake = [&]() {
+            if(waiting > 0) {
+                std::scoped_lock lock(mutex);
+                condition.notify_all();
+            }
+        };
+
+        auto compress_worker = [&](ZSTD_CCtx *context) {
+            std::vector<std::byte> input_buffer;
+            while(!error) {
+                std::size_t f = next_frame++;
+                if(f >= frame_count) {
+                    break;
+                }
+
+                // If we're a whole window ahead, wait for the frame that was in this slot to be written
+                wait_until([&]() { return f < next_write + slot_count; });
+                if(error) {
+                    break;
+                }
+
+                bool compressed;
+                try {
+                    compressed = compress_frame(context, f, input_buffer);
+                }
+                catch(std::exception &) {
+                    compressed = false;
+                }
+                if(!compressed) {
+                    error = true;
+                    wake();
+                    break;
+                }
+
+                slot_frame[f % slot_count] = f + 1;
+                wake();
+            }
+        };
+
+        std::vector<std::thread> thread_list;
+        auto stop_threads = [&]() {
+            error = true;
+            wake();
+            for(auto &thread : thread_list) {
+                thread.join();
+            }
+            thread_list.clear();
+        };
+
+        try {
+            for(std::size_t t = 0; t < std::max<std::size_t>(thread_count, 1); t++) {
+                contexts.emplace_back(create_compression_context(compression_level, frame_options, frame_size));
+            }
+
+            if(thread_count == 0) {
+                std::vector<std::byte> input_buffer;
+                for(std::size_t f = 0; f < frame_count; f++) {
+                    if(!compress_frame(contexts[0], f, input_buffer)) {
+                        throw CompressionFailureException();
+                    }
+                    write_frame(f);
+                }
+            }
+            else {
+                thread_list.reserve(thread_count);
+                for(std::size_t t = 0; t < thread_count; t++) {
+                    thread_list.emplace_back(compress_worker, contexts[t]);
+                }
+
+                // Write each frame once it's done, freeing its slot
+                for(std::size_t f = 0; f < frame_count; f++) {
+                    wait_until([&]() { return slot_frame[f % slot_count] == f + 1; });
+                    if(slot_frame[f % slot_count] != f + 1) {
+                        throw CompressionFailureException();
+                    }
+                    write_frame(f);
+                    next_write = f + 1;
+                    wake();
+                }
+
+                for(auto &thread : thread_list) {
+                    thread.join();
+                }
+                thread_list.clear();
+            }
+        }
+        catch(std::exception &) {
+            stop_threads();
+            for(auto *context : contexts) {
+                ZSTD_freeCCtx(context);
+            }
+            throw;
+        }
+
+        for(auto *context : contexts) {
+            ZSTD_freeCCtx(context);
+        }
+
+        // Write the index
+        HEK::LittleEndian<std::uint32_t> skippable_header[2];
+        skippable_header[0] = ZSTD_MAGIC_SKIPPABLE_START;
+        skippable_header[1] = static_cast<std::uint32_t>(frames.size() * sizeof(frames[0]));
+        write_data(reinterpret_cast<const std::byte *>(skippable_header), sizeof(skippable_header));
+        write_data(reinterpret_cast<const std::byte *>(frames.data()), frames.size() * sizeof(frames[0]));
+
+        header.compression_type = HEK::NativeCacheFileHeader::NativeCacheFileCompressionType::NATIVE_CACHE_FILE_COMPRESSION_ZSTD_SEEKABLE;
+        header.frame_size = static_cast<std::uint32_t>(frame_size);
+        header.frame_count = static_cast<std::uint32_t>(frame_count);
+        header.frame_index_offset = offset + sizeof(skippable_header);
+    }
+
+    // Largest the output of compress_map_frames can be
+    static std::size_t compress_map_frames_bound(std::size_t data_size, std::size_t frame_size) {
+        std::size_t frame_count = (data_size - HEADER_SIZE + frame_size - 1) / frame_size;
+        return HEADER_SIZE + frame_count * (ZSTD_compressBound(frame_size) + sizeof(HEK::NativeCacheFileFrame)) + sizeof(std::uint32_t) * 2;
+    }
+
+    std::size_t compress_map_data(const std::byte *data, std::size_t data_size, std::byte *output, std::size_t output_size, int compression_level, const ZstdOptions &zstd_options) {
         // Load the data
         auto map = Map::map_with_pointer(const_cast<std::byte *>(data), data_size);
 
@@ -147,7 +443,7 @@ namespace Invader::Compression {
         auto engine = map.get_engine();
         if(engine == HEK::CacheFileEngine::CACHE_FILE_XBOX) {
             #ifndef DISABLE_ZLIB
-            compress_header<HEK::CacheFileHeader>(map, output, data_size);
+            compress_header(data, output, data_size);
 
             // Compress that!
             z_stream deflate_stream = {};
@@ -186,16 +482,25 @@ namespace Invader::Compression {
         }
         // Otherwise, we use zstandard
         else {
-            if(engine == HEK::CACHE_FILE_NATIVE) {
-                compress_header<HEK::NativeCacheFileHeader>(map, output, data_size);
-                reinterpret_cast<HEK::NativeCacheFileHeader *>(output)->timestamp = reinterpret_cast<const HEK::NativeCacheFileHeader *>(data)->timestamp;
-            }
-            else {
-                compress_header<HEK::CacheFileHeader>(map, output, data_size);
+            compress_header(data, output, data_size);
+
+            // Compress it in frames if we want to be able to decompress parts of it
+            if(engine == HEK::CACHE_FILE_NATIVE && zstd_options.frame_size > 0) {
+                std::size_t total_written = HEADER_SIZE;
+                compress_map_frames({{ data + HEADER_SIZE, data_size - HEADER_SIZE }}, *reinterpret_cast<HEK::NativeCacheFileHeader *>(output), compression_level, zstd_options, [&output, &output_size, &total_written](const std::byte *where, std::size_t size) {
+                    if(size > output_size - total_written) {
+                        throw CompressionFailureException();
+                    }
+                    std::memcpy(output + total_written, where, size);
+                    total_written += size;
+                });
+                return total_written;
             }
 
             // Immediately compress it
-            auto compressed_size = ZSTD_compress(output + HEADER_SIZE, output_size - HEADER_SIZE, data + HEADER_SIZE, data_size - HEADER_SIZE, compression_level);
+            auto *compression_context = create_compression_context(compression_level, zstd_options, data_size - HEADER_SIZE);
+            auto compressed_size = ZSTD_compress2(compression_context, output + HEADER_SIZE, output_size - HEADER_SIZE, data + HEADER_SIZE, data_size - HEADER_SIZE);
+            ZSTD_freeCCtx(compression_context);
             if(ZSTD_isError(compressed_size)) {
                 throw CompressionFailureException();
             }
@@ -205,6 +510,162 @@ namespace Invader::Compression {
         }
     }
 
+    std::size_t compress_map_data(const std::byte *data, std::size_t data_size, bool (*write_callback)(const std::byte *data, std::size_t size, std::size_t offset, void *user_data), void *user_data, int compression_level, const ZstdOptions &zstd_options) {
+        if(data_size < HEADER_SIZE) {
+            throw InvalidMapException();
+        }
+
+        // Make sure it loads
+        Map::map_with_pointer(const_cast<std::byte *>(data), data_size);
+
+        return compress_map_data({{ data, data_size }}, write_callback, user_data, compression_level, zstd_options);
+    }
+
+    std::size_t compress_map_data(const std::vector<std::pair<const std::byte *, std::size_t>> &sections, bool (*write_callback)(const std::byte *data, std::size_t size, std::size_t offset, void *user_data), void *user_data, int compression_level, const ZstdOptions &zstd_options) {
+        std::size_t data_size = sections_size(sections);
+        if(data_size < HEADER_SIZE) {
+            throw InvalidMapException();
+        }
+
+        std::vector<std::byte> header_input_buffer;
+        const auto *header_input = sections_data(sections, 0, HEADER_SIZE, header_input_buffer);
+
+        // Everything after the header gets compressed, and there's always something to compress, even if it's nothing
+        auto input = sections_after(sections, HEADER_SIZE);
+        if(input.empty()) {
+            input.emplace_back(nullptr, 0);
+        }
+
+        std::byte header[HEADER_SIZE];
+        std::size_t total_written = 0;
+        auto write_data = [&write_callback, &user_data, &total_written](const std::byte *where, std::size_t size) {
+            if(!write_callback(where, size, total_written, user_data)) {
+                throw CompressionFailureException();
+            }
+            total_written += size;
+        };
+
+        // Output is handed off in pieces this big rather than being held all at once
+        std::vector<std::byte> output_data(ZSTD_CStreamOutSize());
+
+        auto engine = compress_header(header_input, header, data_size);
+        write_data(header, sizeof(header));
+
+        // If we're Xbox, we use a DEFLATE stream
+        if(engine == HEK::CacheFileEngine::CACHE_FILE_XBOX) {
+            #ifndef DISABLE_ZLIB
+            z_stream deflate_stream = {};
+            deflate_stream.zalloc = Z_NULL;
+            deflate_stream.zfree = Z_NULL;
+            deflate_stream.opaque = Z_NULL;
+
+            // Clamp
+            if(compression_level > Z_BEST_COMPRESSION) {
+                compression_level = Z_BEST_COMPRESSION;
+            }
+            else if(compression_level < Z_NO_COMPRESSION) {
+                compression_level = Z_NO_COMPRESSION;
+            }
+
+            if(deflateInit(&deflate_stream, compression_level) != Z_OK) {
+                throw CompressionFailureException();
+            }
+
+            try {
+                for(std::size_t s = 0; s < input.size(); s++) {
+                    bool last = s + 1 == input.size();
+                    deflate_stream.avail_in = input[s].second;
+                    deflate_stream.next_in = reinterpret_cast<Bytef *>(const_cast<std::byte *>(input[s].first));
+
+                    // Keep going until this section is used up (or until the end of the stream if it's the last one)
+                    int result;
+                    do {
+                        deflate_stream.avail_out = output_data.size();
+                        deflate_stream.next_out = reinterpret_cast<Bytef *>(output_data.data());
+                        result = deflate(&deflate_stream, last ? Z_FINISH : Z_NO_FLUSH);
+                        if(result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR) {
+                            throw CompressionFailureException();
+                        }
+                        write_data(output_data.data(), output_data.size() - deflate_stream.avail_out);
+                    }
+                    while(last ? result != Z_STREAM_END : (deflate_stream.avail_in > 0 || deflate_stream.avail_out == 0));
+                }
+            }
+            catch(std::exception &) {
+                deflateEnd(&deflate_stream);
+                throw;
+            }
+
+            if(deflateEnd(&deflate_stream) != Z_OK) {
+                throw CompressionFailureException();
+            }
+
+            // Align to 4096 bytes
+            std::size_t padding_required = 4096 - ((deflate_stream.total_out + HEADER_SIZE) % 4096);
+            if(padding_required) {
+                std::vector<std::byte> padding(padding_required);
+                write_data(padding.data(), padding.size());
+                reinterpret_cast<HEK::CacheFileHeader *>(header)->compressed_padding = static_cast<std::uint32_t>(padding_required);
+
+                // Rewrite the header now that we know the padding
+                if(!write_callback(header, sizeof(header), 0, user_data)) {
+                    throw CompressionFailureException();
+                }
+            }
+
+            return total_written;
+
+            #else
+            std::terminate();
+            #endif
+        }
+        // Otherwise, we use zstandard
+        else {
+            // Compress it in frames if we want to be able to decompress parts of it, rewriting the header once we have the index
+            if(engine == HEK::CACHE_FILE_NATIVE && zstd_options.frame_size > 0) {
+                compress_map_frames(input, *reinterpret_cast<HEK::NativeCacheFileHeader *>(header), compression_level, zstd_options, write_data);
+                if(!write_callback(header, sizeof(header), 0, user_data)) {
+                    throw CompressionFailureException();
+                }
+                return total_written;
+            }
+
+            auto *compression_context = create_compression_context(compression_level, zstd_options, data_size - HEADER_SIZE);
+
+            try {
+                for(std::size_t s = 0; s < input.size(); s++) {
+                    bool last = s + 1 == input.size();
+                    ZSTD_inBuffer_s input_buffer = {};
+                    input_buffer.src = input[s].first;
+                    input_buffer.size = input[s].second;
+
+                    // Keep going until this section is used up (or until everything is flushed if it's the last one)
+                    std::size_t remaining;
+                    do {
+                        ZSTD_outBuffer_s output_buffer = {};
+                        output_buffer.dst = output_data.data();
+                        output_buffer.size = output_data.size();
+                        remaining = ZSTD_compressStream2(compression_context, &output_buffer, &input_buffer, last ? ZSTD_e_end : ZSTD_e_continue);
+                        if(ZSTD_isError(remaining)) {
+                            throw CompressionFailureException();
+                        }
+                        write_data(output_data.data(), output_buffer.pos);
+                    }
+                    while(last ? remaining > 0 : input_buffer.pos < input_buffer.size);
+                }
+            }
+            catch(std::exception &) {
+                ZSTD_freeCCtx(compression_context);
+                throw;
+            }
+
+            ZSTD_freeCCtx(compression_context);
+
+            // Done
+            return total_written;
+        }
+    }
+
     std::size_t decompress_map_data(const std::byte *data, std::size_t data_size, std::byte *output, std::size_t output_size) {
         // Check the header
         const auto *header = reinterpret_cast<const HEK::CacheFileHeader *>(data);
@@ -256,7 +717,7 @@ namespace Invader::Compression {
         return decompressed_size + HEADER_SIZE;
     }
 
-    std::vector<std::byte> compress_map_data(const std::byte *data, std::size_t data_size, int compression_level) {
+    std::vector<std::byte> compress_map_data(const std::byte *data, std::size_t data_size, int compression_level, const ZstdOptions &zstd_options) {
         // Allocate the data
         std::vector<std::byte> new_data;
         if(data_size < HEADER_SIZE) {
@@ -265,9 +726,12 @@ namespace Invader::Compression {
         
         // Allocate data
         new_data.resize(ZSTD_compressBound(data_size - HEADER_SIZE) + HEADER_SIZE);
+        if(zstd_options.frame_size > 0) {
+            new_data.resize(std::max(new_data.size(), compress_map_frames_bound(data_size, zstd_options.frame_size)));
+        }
 
         // Compress
-        auto compressed_size = compress_map_data(data, data_size, new_data.data(), new_data.size(), compression_level);
+        auto compressed_size = compress_map_data(data, data_size, new_data.data(), new_data.size(), compression_level, zstd_options);
 
         // Resize and return it
         new_data.resize(compressed_size);
@@ -297,6 +761,64 @@ namespace Invader::Compression {
         return new_data;
     }
 
+    void decompress_map_data_range(const std::byte *data, std::size_t data_size, std::byte *output, std::size_t output_size, std::size_t offset, std::size_t size) {
+        // Check the header
+        const auto *header = reinterpret_cast<const HEK::NativeCacheFileHeader *>(data);
+        if(data_size < sizeof(*header) || !header->valid() || header->engine != HEK::CacheFileEngine::CACHE_FILE_NATIVE || header->compression_type != HEK::NativeCacheFileHeader::NativeCacheFileCompressionType::NATIVE_CACHE_FILE_COMPRESSION_ZSTD_SEEKABLE) {
+            throw InvalidMapException();
+        }
+
+        std::size_t decompressed_size = header->decompressed_file_size;
+        std::size_t frame_size = header->frame_size;
+        std::size_t frame_count = header->frame_count;
+        std::size_t frame_index_offset = header->frame_index_offset;
+        if(decompressed_size < HEADER_SIZE || frame_size == 0 || (decompressed_size - HEADER_SIZE + frame_size - 1) / frame_size != frame_count || frame_index_offset > data_size || frame_count > (data_size - frame_index_offset) / sizeof(HEK::NativeCacheFileFrame)) {
+            throw InvalidMapException();
+        }
+        if(output_size < decompressed_size || offset > decompressed_size || size > decompressed_size - offset) {
+            throw OutOfBoundsException();
+        }
+
+        if(offset < HEADER_SIZE) {
+            decompress_header<HEK::NativeCacheFileHeader>(data, output);
+            reinterpret_cast<HEK::NativeCacheFileHeader *>(output)->timestamp = header->timestamp;
+        }
+
+        std::size_t end = offset + size;
+        if(end <= HEADER_SIZE) {
+            return;
+        }
+
+        // Decompress every frame the range overlaps
+        const auto *frames = reinterpret_cast<const HEK::NativeCacheFileFrame *>(data + frame_index_offset);
+        std::size_t first_frame = (std::max(offset, HEADER_SIZE) - HEADER_SIZE) / frame_size;
+        std::size_t last_frame = (end - HEADER_SIZE - 1) / frame_size;
+
+        auto *decompression_context = ZSTD_createDCtx();
+        if(!decompression_context) {
+            throw DecompressionFailureException();
+        }
+
+        for(std::size_t f = first_frame; f <= last_frame; f++) {
+            std::size_t frame_offset = frames[f].offset;
+            std::size_t frame_compressed_size = frames[f].size;
+            std::size_t frame_output_offset = HEADER_SIZE + f * frame_size;
+            std::size_t frame_output_size = std::min(frame_size, decompressed_size - frame_output_offset);
+            if(frame_offset > data_size || frame_compressed_size > data_size - frame_offset) {
+                ZSTD_freeDCtx(decompression_context);
+                throw InvalidMapException();
+            }
+
+            auto decompressed_frame_size = ZSTD_decompressDCtx(decompression_context, output + frame_output_offset, frame_output_size, data + frame_offset, frame_compressed_size);
+            if(ZSTD_isError(decompressed_frame_size) || decompressed_frame_size != frame_output_size) {
+                ZSTD_freeDCtx(decompression_context);
+                throw DecompressionFailureException();
+            }
+        }
+
+        ZSTD_freeDCtx(decompression_context);
+    }
+
     struct LowMemoryDecompression {
         /**
          * Callback for when a decompression occurs
@@ -479,7 +1001,9 @@ namespace Invader::Compression {
         return output_writer.output_position;
     }
     
-    std::vector<std::byte> ceaflate_compress(const std::byte *input, std::size_t input_size, int compression_level) {
+    // Compress the file using ceaflate, passing each chunk to write_data(data, size, offset) in order as it is done.
+    // Chunks can't be written until every chunk before them is, so only a few chunks are held at a time.
+    template <typename WriteFunction> static std::size_t ceaflate_compress_chunks(const std::byte *input, std::size_t input_size, int compression_level, std::size_t threads, WriteFunction write_data) {
         #define MAXIMUM_CEAFLATE_CHUNK_SIZE 0x20000
         
         if(compression_level > Z_BEST_COMPRESSION) {
@@ -489,85 +1013,159 @@ namespace Invader::Compression {
             compression_level = Z_NO_COMPRESSION;
         }
         
-        // Set these up
-        std::vector<std::vector<std::byte>> output_chunks;
-        output_chunks.reserve((input_size + (MAXIMUM_CEAFLATE_CHUNK_SIZE - 1)) / MAXIMUM_CEAFLATE_CHUNK_SIZE);
-        std::size_t current_offset = 0;
-        std::mutex mutex;
-        bool error = false;
+        // The chunk count and offsets go first, but we don't know the offsets until everything is compressed, so they
+        // get written again at the end
+        std::size_t chunk_count = (input_size + (MAXIMUM_CEAFLATE_CHUNK_SIZE - 1)) / MAXIMUM_CEAFLATE_CHUNK_SIZE;
+        std::vector<std::uint32_t> offsets(chunk_count + 1);
+        offsets[0] = static_cast<std::uint32_t>(chunk_count);
+        std::size_t header_size = sizeof(std::uint32_t) * offsets.size();
+        write_data(reinterpret_cast<const std::byte *>(offsets.data()), header_size, 0);
         
         // Max threads?
-        auto max_threads = std::thread::hardware_concurrency();
-        if(max_threads < 1) {
-            max_threads = 1;
+        if(threads == 0) {
+            threads = std::thread::hardware_concurrency();
+        }
+        if(threads < 1) {
+            threads = 1;
+        }
+        if(threads > chunk_count) {
+            threads = chunk_count;
         }
         
-        auto compress_worker = [](std::mutex *mutex, std::vector<std::vector<std::byte>> *output_chunks, const std::byte *input, std::size_t input_size, std::size_t *current_offset, int compression_level, bool *error) {
-            while(true) {
-                mutex->lock();
-                
-                // Check if we're done
-                if(*current_offset == input_size || *error) {
-                    mutex->unlock();
-                    return;
+        // Each chunk is compressed into a slot big enough to hold it even if it doesn't compress at all. A slot is
+        // reused once its chunk is written, so workers can only get so far ahead of the chunk being written.
+        std::size_t slot_size = sizeof(std::uint32_t) + compressBound(MAXIMUM_CEAFLATE_CHUNK_SIZE);
+        std::size_t slot_count = std::max<std::size_t>(threads * 2, 1);
+        std::vector<std::byte> slots(slot_size * slot_count);
+        std::vector<std::size_t> compressed_sizes(slot_count);
+        
+        // slot_chunk holds one more than the index of the chunk last compressed into each slot, and next_write is the
+        // index of the next chunk to write. The mutex is only locked to wait for one of these to change.
+        std::vector<std::atomic<std::size_t>> slot_chunk(slot_count);
+        std::atomic<std::size_t> next_chunk = 0;
+        std::atomic<std::size_t> next_write = 0;
+        std::atomic<bool> error = false;
+        std::atomic<std::size_t> waiting = 0;
+        std::mutex mutex;
+        std::condition_variable condition;
+        
+        auto wait_until = [&](auto ready) {
+            if(ready() || error) {
+                return;
+            }
+            std::unique_lock lock(mutex);
+            waiting++;
+            condition.wait(lock, [&]() { return ready() || error; });
+            waiting--;
+        };
+        
+        // Call this after changing slot_chunk, next_write, or error
+        auto wake = [&]() {
+            if(waiting > 0) {
+                std::scoped_lock lock(mutex);
+                condition.notify_all();
+            }
+        };
+        
+        // Each thread reuses one deflate stream for every chunk it takes
+        auto compress_worker = [&]() {
+            z_stream deflate_stream = {};
+            deflate_stream.zalloc = Z_NULL;
+            deflate_stream.zfree = Z_NULL;
+            deflate_stream.opaque = Z_NULL;
+            if(deflateInit(&deflate_stream, compression_level) != Z_OK) {
+                error = true;
+                wake();
+                return;
+            }
+            
+            while(!error) {
+                std::size_t c = next_chunk++;
+                if(c >= chunk_count) {
+                    break;
                 }
                 
-                // Reserve one for us
-                std::size_t chunk_index = output_chunks->size();
-                output_chunks->emplace_back();
+                // If we're a whole window ahead, wait for the chunk that was in this slot to be written
+                wait_until([&]() { return c < next_write + slot_count; });
+                if(error) {
+                    break;
+                }
                 
                 // Get our input
-                auto *input_data = input + *current_offset;
-                
-                // Get the chunk size
-                std::size_t remaining_size = input_size - *current_offset;
+                std::size_t chunk_offset = c * MAXIMUM_CEAFLATE_CHUNK_SIZE;
+                std::size_t remaining_size = input_size - chunk_offset;
                 std::size_t chunk_size = remaining_size > MAXIMUM_CEAFLATE_CHUNK_SIZE ? MAXIMUM_CEAFLATE_CHUNK_SIZE : remaining_size;
-                std::size_t compressed_chunk_size = MAXIMUM_CEAFLATE_CHUNK_SIZE * 4; // just in case
-                (*current_offset) += chunk_size;
-                
-                // Done for now
-                mutex->unlock();
                 
-                // Make our blob
-                auto output_blob = std::make_unique<std::byte []>(sizeof(std::uint32_t) + compressed_chunk_size);
-                auto &output_chunk_size = *reinterpret_cast<std::uint32_t *>(output_blob.get());
-                output_chunk_size = chunk_size;
-                auto *output_compressed_data = output_blob.get() + sizeof(output_chunk_size);
+                // Write the uncompressed size, then the compressed data after it
+                std::size_t slot_index = c % slot_count;
+                auto *slot = slots.data() + slot_size * slot_index;
+                *reinterpret_cast<std::uint32_t *>(slot) = static_cast<std::uint32_t>(chunk_size);
                 
-                // Compress
-                z_stream deflate_stream = {};
-                deflate_stream.zalloc = Z_NULL;
-                deflate_stream.zfree = Z_NULL;
-                deflate_stream.opaque = Z_NULL;
                 deflate_stream.avail_in = chunk_size;
-                deflate_stream.next_in = reinterpret_cast<Bytef *>(const_cast<std::byte *>(input_data));
-                deflate_stream.avail_out = compressed_chunk_size;
-                deflate_stream.next_out = reinterpret_cast<Bytef *>(output_compressed_data);
+                deflate_stream.next_in = reinterpret_cast<Bytef *>(const_cast<std::byte *>(input + chunk_offset));
+                deflate_stream.avail_out = slot_size - sizeof(std::uint32_t);
+                deflate_stream.next_out = reinterpret_cast<Bytef *>(slot + sizeof(std::uint32_t));
+                
+                if(deflate(&deflate_stream, Z_FINISH) != Z_STREAM_END) {
+                    error = true;
+                    wake();
+                    break;
+                }
+                compressed_sizes[slot_index] = sizeof(std::uint32_t) + deflate_stream.total_out;
                 
-                if((deflateInit(&deflate_stream, compression_level) != Z_OK) || (deflate(&deflate_stream, Z_FINISH) != Z_STREAM_END) || (deflateEnd(&deflate_stream) != Z_OK)) {
-                    mutex->lock();
-                    *error = true;
-                    mutex->unlock();
-                    return;
+                if(deflateReset(&deflate_stream) != Z_OK) {
+                    error = true;
+                    wake();
+                    break;
                 }
                 
-                // Be done
-                mutex->lock();
-                (*output_chunks)[chunk_index] = std::vector<std::byte>(output_blob.get(), output_blob.get() + sizeof(output_chunk_size) + deflate_stream.total_out);
-                mutex->unlock();
+                slot_chunk[slot_index] = c + 1;
+                wake();
             }
+            
+            deflateEnd(&deflate_stream);
         };
         
         // Create our threads
-        std::vector<std::thread> threads;
-        threads.reserve(max_threads);
+        std::vector<std::thread> thread_list;
+        thread_list.reserve(threads);
+        for(std::size_t i = 0; i < threads; i++) {
+            thread_list.emplace_back(compress_worker);
+        }
+        
+        auto stop_threads = [&]() {
+            error = true;
+            wake();
+            for(auto &i : thread_list) {
+                i.join();
+            }
+        };
         
-        for(unsigned int i = 0; i < max_threads; i++) {
-            threads.emplace_back(compress_worker, &mutex, &output_chunks, input, input_size, &current_offset, compression_level, &error);
+        // Write each chunk once it's done, freeing its slot
+        std::size_t output_size = header_size;
+        try {
+            for(std::size_t c = 0; c < chunk_count; c++) {
+                std::size_t slot_index = c % slot_count;
+                wait_until([&]() { return slot_chunk[slot_index] == c + 1; });
+                if(slot_chunk[slot_index] != c + 1) {
+                    break;
+                }
+                
+                offsets[c + 1] = static_cast<std::uint32_t>(output_size);
+                write_data(slots.data() + slot_size * slot_index, compressed_sizes[slot_index], output_size);
+                output_size += compressed_sizes[slot_index];
+                
+                next_write = c + 1;
+                wake();
+            }
+        }
+        catch(std::exception &) {
+            stop_threads();
+            throw;
         }
         
         // Wait for our threads to finish
-        for(auto &i : threads) {
+        for(auto &i : thread_list) {
             i.join();
         }
         
@@ -576,131 +1174,187 @@ namespace Invader::Compression {
             throw CompressionFailureException();
         }
         
-        // No? Okay. We're almost done. Just gotta recombine everything
-        std::size_t total_size = 0;
-        for(auto &i : output_chunks) {
-            total_size += i.size();
-        }
-        
-        // Initialize with a buffer to hold our offsets
-        std::size_t chunk_count = output_chunks.size();
-        std::vector<std::byte> output(sizeof(std::uint32_t) * (chunk_count + 1));
-        output.reserve(output.size() + total_size);
-        *reinterpret_cast<std::uint32_t *>(output.data()) = static_cast<std::uint32_t>(chunk_count);
-        
-        // Concatenate
-        for(std::size_t c = 0; c < chunk_count; c++) {
-            reinterpret_cast<std::uint32_t *>(output.data())[c + 1] = static_cast<std::uint32_t>(output.size());
-            auto &chunk = output_chunks[c];
-            output.insert(output.end(), chunk.begin(), chunk.end());
-        }
+        // Now that we know where everything is, write the offsets
+        write_data(reinterpret_cast<const std::byte *>(offsets.data()), header_size, 0);
         
         // Done
+        return output_size;
+    }
+    
+    std::vector<std::byte> ceaflate_compress(const std::byte *input, std::size_t input_size, int compression_level, std::size_t threads) {
+        std::vector<std::byte> output;
+        auto output_size = ceaflate_compress_chunks(input, input_size, compression_level, threads, [&output](const std::byte *data, std::size_t size, std::size_t offset) {
+            if(offset + size > output.size()) {
+                output.resize(offset + size);
+            }
+            std::copy(data, data + size, output.data() + offset);
+        });
+        output.resize(output_size);
         return output;
     }
     
-    std::vector<std::byte> ceaflate_decompress(const std::byte *input, std::size_t input_size) {
-        auto compression_size = ceaflate_compression_size(input, input_size);
-        if(!compression_size.has_value()) {
+    std::size_t ceaflate_compress(const std::byte *input, std::size_t input_size, bool (*write_callback)(const std::byte *data, std::size_t size, std::size_t offset, void *user_data), void *user_data, int compression_level, std::size_t threads) {
+        return ceaflate_compress_chunks(input, input_size, compression_level, threads, [&write_callback, &user_data](const std::byte *data, std::size_t size, std::size_t offset) {
+            if(!write_callback(data, size, offset, user_data)) {
+                throw CompressionFailureException();
+            }
+        });
+    }
+    
+    struct CeaflateChunk {
+        const std::byte *compressed_data;
+        std::size_t compressed_size;
+        std::byte *output;
+        std::size_t uncompressed_size;
+    };
+
+    // Find where the given chunks are and where they go, starting at output, checking only the offsets of those chunks
+    static std::vector<CeaflateChunk> find_ceaflate_chunks(const std::byte *input, std::size_t input_size, std::size_t first_chunk, std::size_t chunk_count, std::byte *output, std::size_t output_size) {
+        if(input_size < sizeof(std::uint32_t)) {
             throw DecompressionFailureException();
         }
-        
-        // Allocate
-        std::vector<std::byte> output(*compression_size);
-        
+        std::size_t total_chunk_count = *reinterpret_cast<const std::uint32_t *>(input);
+        const auto *offsets = reinterpret_cast<const std::uint32_t *>(input) + 1;
+        if(input_size / sizeof(std::uint32_t) < total_chunk_count + 1) {
+            throw DecompressionFailureException();
+        }
+        if(first_chunk > total_chunk_count || chunk_count > total_chunk_count - first_chunk) {
+            throw OutOfBoundsException();
+        }
+
+        std::vector<CeaflateChunk> chunks(chunk_count);
+        std::size_t total_written = 0;
+        for(std::size_t c = 0; c < chunk_count; c++) {
+            std::size_t chunk_index = first_chunk + c;
+            std::size_t chunk_offset = offsets[chunk_index];
+            std::size_t chunk_end = chunk_index + 1 < total_chunk_count ? offsets[chunk_index + 1] : input_size;
+            if(chunk_end > input_size || chunk_offset + sizeof(std::uint32_t) > chunk_end) {
+                throw DecompressionFailureException();
+            }
+
+            auto &chunk = chunks[c];
+            chunk.uncompressed_size = *reinterpret_cast<const std::uint32_t *>(input + chunk_offset);
+            chunk.compressed_data = input + chunk_offset + sizeof(std::uint32_t);
+            chunk.compressed_size = chunk_end - chunk_offset - sizeof(std::uint32_t);
+            chunk.output = output + total_written;
+            total_written += chunk.uncompressed_size;
+        }
+
+        if(total_written > output_size) {
+            throw OutOfBoundsException();
+        }
+
+        return chunks;
+    }
+
+    // Threads are only worth starting if each one has at least this many chunks to inflate
+    #define MINIMUM_CEAFLATE_CHUNKS_PER_THREAD 8
+
+    // Inflate each chunk into place on up to the given number of threads (or the CPU thread count if 0)
+    static void inflate_ceaflate_chunks(const std::vector<CeaflateChunk> &chunks, std::size_t max_threads) {
         // Max threads?
-        auto max_threads = std::thread::hardware_concurrency();
+        if(max_threads == 0) {
+            max_threads = std::thread::hardware_concurrency();
+        }
+        max_threads = std::min(max_threads, chunks.size() / MINIMUM_CEAFLATE_CHUNKS_PER_THREAD);
         if(max_threads < 1) {
             max_threads = 1;
         }
         
-        // Begin
-        std::vector<std::thread> threads;
-        std::mutex mutex;
-        std::size_t current_offset = 0;
-        std::size_t current_chunk = 0;
-        std::size_t total_written = 0;
-        bool error = false;
+        std::atomic<std::size_t> next_chunk = 0;
+        std::atomic<bool> error = false;
         
-        // Let's do it!
-        auto decompress_worker = [](std::mutex *mutex, std::size_t *current_chunk, std::size_t *current_offset, std::size_t *total_written, const std::byte *input, std::size_t input_size, std::byte *write_to, bool *error) {
-            // Get chunk information
-            auto chunk_count = *reinterpret_cast<const std::uint32_t *>(input);
-            const auto *offsets = reinterpret_cast<const std::uint32_t *>(input) + 1;
+        // Let's do it! Each thread reuses one inflate stream for every chunk it takes.
+        auto decompress_worker = [&chunks, &next_chunk, &error]() {
+            z_stream inflate_stream = {};
+            inflate_stream.zalloc = Z_NULL;
+            inflate_stream.zfree = Z_NULL;
+            inflate_stream.opaque = Z_NULL;
+            if(inflateInit(&inflate_stream) != Z_OK) {
+                error = true;
+                return;
+            }
             
-            while(true) {
-                mutex->lock();
-                
-                // Are we done?
-                if(*current_offset == input_size || *error) {
-                    mutex->unlock();
-                    return;
-                }
-                
-                // Get our chunk
-                const std::byte *chunk_start = input + offsets[*current_chunk];
-                auto uncompressed_chunk_size = *reinterpret_cast<const std::uint32_t *>(chunk_start);
-                chunk_start += sizeof(uncompressed_chunk_size);
-                
-                // Increment chunk count
-                (*current_chunk)++;
-                
-                // Get the end
-                const std::byte *chunk_end = input + input_size;
-                if(*current_chunk < chunk_count) { // if we aren't at the end, get the offset of the next chunk
-                    chunk_end = input + offsets[*current_chunk];
+            while(!error) {
+                std::size_t c = next_chunk++;
+                if(c >= chunks.size()) {
+                    break;
                 }
-                (*current_offset) = chunk_end - input;
-                
-                // Where are we writing to?
-                std::byte *write_to_this_chunk = write_to + *total_written;
-                
-                // And of course, increment this
-                (*total_written) += uncompressed_chunk_size;
-                
-                // We no longer need this locked
-                mutex->unlock();
                 
-                // All right. Here's the size of the compressed data
-                std::size_t compressed_chunk_size = chunk_end - chunk_start;
-                
-                // Do it!
-                z_stream inflate_stream = {};
-                inflate_stream.zalloc = Z_NULL;
-                inflate_stream.zfree = Z_NULL;
-                inflate_stream.opaque = Z_NULL;
-                inflate_stream.avail_in = compressed_chunk_size;
-                inflate_stream.next_in = reinterpret_cast<Bytef *>(const_cast<std::byte *>(chunk_start));
-                inflate_stream.avail_out = uncompressed_chunk_size;
-                inflate_stream.next_out = reinterpret_cast<Bytef *>(write_to_this_chunk);
-                if((inflateInit(&inflate_stream) != Z_OK) || (inflate(&inflate_stream, Z_FINISH) != Z_STREAM_END) || (inflateEnd(&inflate_stream) != Z_OK)) {
-                    mutex->lock();
-                    *error = true;
-                    mutex->unlock();
-                    return;
+                auto &chunk = chunks[c];
+                inflate_stream.avail_in = chunk.compressed_size;
+                inflate_stream.next_in = reinterpret_cast<Bytef *>(const_cast<std::byte *>(chunk.compressed_data));
+                inflate_stream.avail_out = chunk.uncompressed_size;
+                inflate_stream.next_out = reinterpret_cast<Bytef *>(chunk.output);
+                if(inflate(&inflate_stream, Z_FINISH) != Z_STREAM_END || inflateReset(&inflate_stream) != Z_OK) {
+                    error = true;
+                    break;
                 }
             }
+            
+            inflateEnd(&inflate_stream);
         };
         
-        // Create our threads
-        threads.reserve(max_threads);
-        for(unsigned int i = 0; i < max_threads; i++) {
-            threads.emplace_back(decompress_worker, &mutex, &current_chunk, &current_offset, &total_written, input, input_size, output.data(), &error);
+        // Don't bother with threads if there aren't enough chunks for more than one
+        if(max_threads <= 1) {
+            decompress_worker();
         }
-        
-        // Wait for our threads to finish
-        for(auto &i : threads) {
-            i.join();
+        else {
+            // Create our threads
+            std::vector<std::thread> threads;
+            threads.reserve(max_threads);
+            for(std::size_t i = 0; i < max_threads; i++) {
+                threads.emplace_back(decompress_worker);
+            }
+            
+            // Wait for our threads to finish
+            for(auto &i : threads) {
+                i.join();
+            }
         }
         
         // Did it fail?
         if(error) {
             throw DecompressionFailureException();
         }
+    }
+
+    std::vector<std::byte> ceaflate_decompress(const std::byte *input, std::size_t input_size, std::size_t threads) {
+        auto compression_size = ceaflate_compression_size(input, input_size);
+        if(!compression_size.has_value()) {
+            throw DecompressionFailureException();
+        }
+        
+        // Allocate
+        std::vector<std::byte> output(*compression_size);
+        
+        // Find where each chunk is and where it goes in the output so every chunk can be inflated on its own
+        std::size_t chunk_count = *reinterpret_cast<const std::uint32_t *>(input);
+        inflate_ceaflate_chunks(find_ceaflate_chunks(input, input_size, 0, chunk_count, output.data(), output.size()), threads);
         
         // No? Okay. We're done!
         return output;
     }
+
+    void ceaflate_decompress_chunks(const std::byte *input, std::size_t input_size, std::size_t first_chunk, std::size_t chunk_count, std::byte *output, std::size_t output_size, std::size_t threads) {
+        inflate_ceaflate_chunks(find_ceaflate_chunks(input, input_size, first_chunk, chunk_count, output, output_size), threads);
+    }
+
+    std::optional<std::vector<std::size_t>> ceaflate_chunk_offsets(const std::byte *input, std::size_t input_size) {
+        if(!ceaflate_compression_size(input, input_size).has_value()) {
+            return std::nullopt;
+        }
+
+        std::size_t chunk_count = *reinterpret_cast<const std::uint32_t *>(input);
+        const auto *offsets = reinterpret_cast<const std::uint32_t *>(input) + 1;
+        std::vector<std::size_t> chunk_offsets(chunk_count);
+        std::size_t total_size = 0;
+        for(std::size_t c = 0; c < chunk_count; c++) {
+            chunk_offsets[c] = total_size;
+            total_size += *reinterpret_cast<const std::uint32_t *>(input + offsets[c]);
+        }
+        return chunk_offsets;
+    }
     
     std::optional<std::size_t> ceaflate_compression_size(const std::byte *input, std::size_t input_size) noexcept {
         // Can we hold the count?
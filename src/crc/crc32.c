@@ -4,9 +4,27 @@
 // - added GPL version 3 only identifier (the original code to this uses the below license, but my modifications are GPL version 3 only, as is Invader itself)
 // - added "crc32.h" include
 // - removed platform specific includes <sys/param.h> and <sys/systm.h>
+// - added slice-by-16, PCLMULQDQ (x86), and ARMv8 CRC32 implementations which are chosen at runtime based on what the
+//   CPU supports, falling back to the original one-byte-at-a-time loop
+// - added crc32_merge for combining CRC32s of adjacent blocks
 
 #include "crc32.h"
 
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define INVADER_CRC32_PCLMUL
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && (defined(__linux__) || defined(__APPLE__))
+#define INVADER_CRC32_ARMV8
+#include <arm_acle.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
 /*-
  *  COPYRIGHT (C) 1986 Gary S. Brown.  You may use this program, or
  *  code or tables extracted from it, as desired without restriction.
@@ -98,15 +116,293 @@ static uint32_t crc32_tab[] = {
 	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
-uint32_t crc32(uint32_t crc, const void *buf, size_t size)
+/*
+ * Every implementation below takes and returns the CRC without the initial
+ * and final inversion, which crc32() does.
+ */
+typedef uint32_t (*crc32_function)(uint32_t crc, const uint8_t *p, size_t size);
+
+static uint32_t crc32_bytes(uint32_t crc, const uint8_t *p, size_t size)
 {
-	const uint8_t *p;
+	while (size--)
+		crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
 
-	p = buf;
-	crc = crc ^ ~0U;
+	return crc;
+}
+
+/*
+ * Slice-by-16: crc32_slice_tab[k][n] is the CRC of byte n followed by k zero
+ * bytes, so 16 bytes can be looked up independently and combined. This needs
+ * the tables built (by crc32_init) and a little endian CPU.
+ */
+static uint32_t crc32_slice_tab[16][256];
+
+static uint32_t crc32_slice16(uint32_t crc, const uint8_t *p, size_t size)
+{
+	while (size >= 16) {
+		uint32_t one, two, three, four;
+		memcpy(&one, p, sizeof(one));
+		memcpy(&two, p + 4, sizeof(two));
+		memcpy(&three, p + 8, sizeof(three));
+		memcpy(&four, p + 12, sizeof(four));
+		one ^= crc;
+
+		crc = crc32_slice_tab[0][four >> 24] ^
+		      crc32_slice_tab[1][(four >> 16) & 0xFF] ^
+		      crc32_slice_tab[2][(four >> 8) & 0xFF] ^
+		      crc32_slice_tab[3][four & 0xFF] ^
+		      crc32_slice_tab[4][three >> 24] ^
+		      crc32_slice_tab[5][(three >> 16) & 0xFF] ^
+		      crc32_slice_tab[6][(three >> 8) & 0xFF] ^
+		      crc32_slice_tab[7][three & 0xFF] ^
+		      crc32_slice_tab[8][two >> 24] ^
+		      crc32_slice_tab[9][(two >> 16) & 0xFF] ^
+		      crc32_slice_tab[10][(two >> 8) & 0xFF] ^
+		      crc32_slice_tab[11][two & 0xFF] ^
+		      crc32_slice_tab[12][one >> 24] ^
+		      crc32_slice_tab[13][(one >> 16) & 0xFF] ^
+		      crc32_slice_tab[14][(one >> 8) & 0xFF] ^
+		      crc32_slice_tab[15][one & 0xFF];
+
+		p += 16;
+		size -= 16;
+	}
+
+	return crc32_bytes(crc, p, size);
+}
+
+#ifdef INVADER_CRC32_PCLMUL
+/*
+ * Fold 64 bytes at a time with carry-less multiplication, then reduce to 32
+ * bits with a Barrett reduction, as described in Intel's "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction". Note that
+ * the SSE 4.2 crc32 instruction can't be used, as it uses the Castagnoli
+ * polynomial rather than this one.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t *p, size_t size)
+{
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+	size_t folded_size;
+
+	if (size < 64)
+		return crc32_slice16(crc, p, size);
+
+	folded_size = size & ~(size_t)15;
+
+	x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	x0 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	p += 64;
+	folded_size -= 64;
+
+	/* Fold four blocks of 128 bits at a time */
+	while (folded_size >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		y5 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+		y6 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+		y7 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+		y8 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+		p += 64;
+		folded_size -= 64;
+	}
+
+	/* Fold those into 128 bits */
+	x0 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	/* Fold any remaining blocks of 128 bits */
+	while (folded_size >= 16) {
+		x2 = _mm_loadu_si128((const __m128i *)p);
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+		p += 16;
+		folded_size -= 16;
+	}
+
+	/* Fold 128 bits into 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+	x0 = _mm_set_epi64x(0, 0x0163cd6124);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduce that to 32 bits */
+	x0 = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	crc = (uint32_t)_mm_extract_epi32(x1, 1);
+
+	/* Do anything left over that doesn't fill a block */
+	return crc32_slice16(crc, p, size & 15);
+}
+#endif
+
+#ifdef INVADER_CRC32_ARMV8
+/*
+ * ARMv8's optional CRC32 instructions use this polynomial, so these can do 8
+ * bytes per instruction.
+ */
+#ifdef __clang__
+__attribute__((target("crc")))
+#else
+__attribute__((target("+crc")))
+#endif
+static uint32_t crc32_armv8(uint32_t crc, const uint8_t *p, size_t size)
+{
+	while (size >= 8) {
+		uint64_t value;
+		memcpy(&value, p, sizeof(value));
+		crc = __crc32d(crc, value);
+		p += 8;
+		size -= 8;
+	}
 
 	while (size--)
-		crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+		crc = __crc32b(crc, *p++);
+
+	return crc;
+}
+#endif
+
+#ifdef INVADER_CRC32_PCLMUL
+static int crc32_pclmul_supported(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+#endif
+
+#ifdef INVADER_CRC32_ARMV8
+static int crc32_armv8_supported(void)
+{
+#ifdef __linux__
+	return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+	return 1;
+#endif
+}
+#endif
+
+/*
+ * The original loop is used until crc32_init picks something faster, which
+ * happens when the program is loaded (before anything could be running on
+ * another thread). Compilers that can't do that just use the original loop.
+ */
+static crc32_function crc32_implementation = crc32_bytes;
+
+#ifdef __GNUC__
+__attribute__((constructor))
+static void crc32_init(void)
+{
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		crc32_slice_tab[0][i] = crc32_tab[i];
+	}
+	for (k = 1; k < 16; k++) {
+		for (i = 0; i < 256; i++) {
+			uint32_t previous = crc32_slice_tab[k - 1][i];
+			crc32_slice_tab[k][i] = (previous >> 8) ^ crc32_tab[previous & 0xFF];
+		}
+	}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	crc32_implementation = crc32_slice16;
+#endif
+
+#ifdef INVADER_CRC32_PCLMUL
+	if (crc32_pclmul_supported()) {
+		crc32_implementation = crc32_pclmul;
+	}
+#endif
+
+#ifdef INVADER_CRC32_ARMV8
+	if (crc32_armv8_supported()) {
+		crc32_implementation = crc32_armv8;
+	}
+#endif
+}
+#endif
+
+uint32_t crc32(uint32_t crc, const void *buf, size_t size)
+{
+	return crc32_implementation(crc ^ ~0U, buf, size) ^ ~0U;
+}
+
+/*
+ * x^(2^n) mod P for n = 0...31 in the same reflected representation as
+ * crc32_tab, used to shift a CRC32 past len2 zero bytes in crc32_merge
+ */
+static const uint32_t crc32_x2n_tab[32] = {
+	0x40000000, 0x20000000, 0x08000000, 0x00800000, 0x00008000, 0xedb88320,
+	0xb1e6b092, 0xa06a2517, 0xed627dae, 0x88d14467, 0xd7bbfe6a, 0xec447f11,
+	0x8e7ea170, 0x6427800e, 0x4d47bae0, 0x09fe548f, 0x83852d0f, 0x30362f1a,
+	0x7b5a9cc3, 0x31fec169, 0x9fec022a, 0x6c8dedc4, 0x15d6874d, 0x5fde7a4e,
+	0xbad90e37, 0x2e4e5eef, 0x4eaba214, 0xa8a472c0, 0x429a969e, 0x148d302a,
+	0xc40ba6d0, 0xc4e22c3c
+};
+
+/* Multiply a and b modulo P over GF(2) */
+static uint32_t crc32_multiply(uint32_t a, uint32_t b)
+{
+	uint32_t m = (uint32_t)1 << 31, p = 0;
+
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+		m >>= 1;
+		b = (b & 1) ? (b >> 1) ^ 0xEDB88320 : b >> 1;
+	}
+
+	return p;
+}
+
+uint32_t crc32_merge(uint32_t crc1, uint32_t crc2, size_t len2)
+{
+	uint32_t shift = (uint32_t)1 << 31; /* x^0 */
+	unsigned int k = 3; /* bytes -> bits */
+
+	/* shift = x^(8 * len2) mod P */
+	while (len2) {
+		if (len2 & 1)
+			shift = crc32_multiply(crc32_x2n_tab[k & 31], shift);
+		len2 >>= 1;
+		k++;
+	}
 
-	return crc ^ ~0U;
+	return crc32_multiply(shift, crc1) ^ crc2;
 }
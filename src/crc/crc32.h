@@ -11,6 +11,9 @@ extern "C" {
 #include <stdlib.h>
 uint32_t crc32(uint32_t crc, const void *buf, size_t size);
 
+/* Get the CRC32 of A followed by B from the CRC32 of A (crc1), the CRC32 of B (crc2), and the length of B (len2) */
+uint32_t crc32_merge(uint32_t crc1, uint32_t crc2, size_t len2);
+
 #ifdef __cplusplus
 }
 #endif
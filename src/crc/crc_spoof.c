@@ -4,6 +4,7 @@
 // - added GPL version 3 only identifier (the original code to this uses the below license, but my modifications are GPL version 3 only, as is Invader itself)
 // - commented out main function
 // - added a fake file handle data type and functions so this can be done with data in memory
+// - added crc_spoof_calculate_patch so the patch can be calculated from a CRC-32 and length without reading the data again
 
 /*
  * CRC-32 forcer (C)
@@ -291,6 +292,14 @@ static int get_degree(uint64_t x) {
 
 
 // Begin Invader-added functions
+// Returns the value to XOR the 4 bytes at offset with (as a little endian integer) so that data of the given length with
+// the CRC-32 crc gets the CRC-32 newcrc instead. Both CRC-32 values are the same as what crc32() returns.
+uint32_t crc_spoof_calculate_patch(uint32_t crc, uint64_t length, uint64_t offset, uint32_t newcrc) {
+    uint32_t delta = crc_spoof_reverse_bits(crc) ^ crc_spoof_reverse_bits(newcrc);
+    delta = (uint32_t)multiply_mod(reciprocal_mod(pow_mod(2, (length - offset) * 8)), delta);
+    return crc_spoof_reverse_bits(delta);
+}
+
 void crc_spoof_fake_fclose(FakeFileHandle *f) {
 }
 
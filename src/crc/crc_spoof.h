@@ -28,6 +28,7 @@ size_t crc_spoof_fake_fread(void *ptr, size_t size, size_t count, FakeFileHandle
 
 const char *crc_spoof_modify_file_crc32(FakeFileHandle *f, uint64_t offset, uint32_t newcrc, bool printstatus);
 uint32_t crc_spoof_reverse_bits(uint32_t x);
+uint32_t crc_spoof_calculate_patch(uint32_t crc, uint64_t length, uint64_t offset, uint32_t newcrc);
 
 #ifdef __cplusplus
 }
@@ -1,6 +1,9 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include "../crc32.h"
 #include "../crc_spoof.h"
 #include <invader/tag/hek/definition.hpp>
@@ -8,20 +11,101 @@
 #include <invader/map/map.hpp>
 
 namespace Invader {
-    std::uint32_t calculate_map_crc(Invader::Map &map, const std::uint32_t *new_crc, std::uint32_t *new_random, bool *check_dirty) {
-        // Reassign variables if needed
-        auto *data = map.get_data();
-        auto size = map.get_data_length();
-        
-        std::vector<std::byte> data_crc;
+    // Regions are split into chunks this big so they can be CRC'd on separate threads and then merged
+    static constexpr std::size_t CRC_CHUNK_SIZE = 4 * 1024 * 1024;
+
+    static std::uint32_t crc32_regions(const std::vector<std::pair<const std::byte *, std::size_t>> &regions, std::size_t max_threads) {
+        struct Chunk {
+            const std::byte *data;
+            std::size_t size;
+            std::uint32_t crc;
+        };
+
+        std::vector<Chunk> chunks;
+        for(auto &r : regions) {
+            for(std::size_t offset = 0; offset < r.second; offset += CRC_CHUNK_SIZE) {
+                chunks.push_back(Chunk { r.first + offset, std::min(CRC_CHUNK_SIZE, r.second - offset), 0 });
+            }
+        }
+
+        std::atomic<std::size_t> next_chunk = 0;
+        auto crc_chunks = [&chunks, &next_chunk]() {
+            for(std::size_t c; (c = next_chunk++) < chunks.size();) {
+                chunks[c].crc = crc32(0, chunks[c].data, chunks[c].size);
+            }
+        };
+
+        // Use every thread we can get (or are allowed), but don't bother making threads if there isn't enough to split up
+        if(max_threads == 0) {
+            max_threads = std::thread::hardware_concurrency();
+        }
+        std::size_t thread_count = std::min(max_threads, chunks.size());
+        if(thread_count <= 1) {
+            crc_chunks();
+        }
+        else {
+            std::vector<std::thread> threads;
+            threads.reserve(thread_count);
+            for(std::size_t t = 0; t < thread_count; t++) {
+                threads.emplace_back(crc_chunks);
+            }
+            for(auto &t : threads) {
+                t.join();
+            }
+        }
+
         std::uint32_t crc = 0;
+        for(auto &c : chunks) {
+            crc = crc32_merge(crc, c.crc, c.size);
+        }
+        return crc;
+    }
 
+    std::uint32_t calculate_map_crc(const std::vector<std::pair<const std::byte *, std::size_t>> &regions, const std::byte *tag_file_checksums, const std::uint32_t *new_crc, std::uint32_t *new_random, std::size_t max_threads) {
         if(new_crc && !new_random) {
             std::terminate();
         }
 
+        // Find out where we're going to be doing CRC32 stuff
+        std::size_t crc_length = 0;
+        std::optional<std::size_t> tag_file_checksums_offset_in_memory;
+        for(auto &r : regions) {
+            if(tag_file_checksums >= r.first && tag_file_checksums + sizeof(std::uint32_t) <= r.first + r.second) {
+                tag_file_checksums_offset_in_memory = crc_length + (tag_file_checksums - r.first);
+            }
+            crc_length += r.second;
+        }
+        if(!tag_file_checksums_offset_in_memory.has_value()) {
+            throw OutOfBoundsException();
+        }
+
+        std::uint32_t crc = crc32_regions(regions, max_threads);
+
+        // Overwrite with new CRC32
         if(new_crc) {
-            data_crc.reserve(size);
+            // The tag file checksums value is the only thing changed, so the new CRC32 only depends on the old one and how
+            // much data comes after it, thus nothing needs to be copied or read again
+            std::uint32_t patch = crc_spoof_calculate_patch(crc, crc_length, *tag_file_checksums_offset_in_memory, ~*new_crc);
+            *new_random = reinterpret_cast<const HEK::LittleEndian<std::uint32_t> *>(tag_file_checksums)->read() ^ patch;
+
+            // Work out the CRC32 with the patch applied, since it's what was actually written
+            std::byte patch_bytes[sizeof(patch)];
+            const std::byte zero_bytes[sizeof(patch)] = {};
+            *reinterpret_cast<HEK::LittleEndian<std::uint32_t> *>(patch_bytes) = patch;
+            std::uint32_t patch_crc = crc32(0, patch_bytes, sizeof(patch_bytes)) ^ crc32(0, zero_bytes, sizeof(zero_bytes));
+            crc ^= crc32_merge(patch_crc, 0, crc_length - *tag_file_checksums_offset_in_memory - sizeof(patch));
+        }
+
+        return ~crc;
+    }
+
+    std::uint32_t calculate_map_crc(Invader::Map &map, const std::uint32_t *new_crc, std::uint32_t *new_random, bool *check_dirty, std::size_t max_threads) {
+        // Reassign variables if needed
+        auto *data = map.get_data();
+        auto size = map.get_data_length();
+
+        if(new_crc && !new_random) {
+            std::terminate();
         }
         
         auto engine = map.get_engine();
@@ -29,13 +113,8 @@ namespace Invader {
             return 0;
         }
 
-        #define CRC_DATA(data_start, data_end) \
-            if(new_crc) { \
-                data_crc.insert(data_crc.end(), data + data_start, data + data_end); \
-            } \
-            else { \
-                crc = crc32(crc, data + data_start, data_end - data_start); \
-            }
+        // Regions of the map that get CRC'd, in order
+        std::vector<std::pair<std::size_t, std::size_t>> regions;
 
         auto &scenario_tag = map.get_tag(map.get_scenario_tag_id());
         auto &scenario = scenario_tag.get_base_struct<HEK::Scenario>();
@@ -54,7 +133,7 @@ namespace Invader {
                 }
                 
                 // Add it
-                CRC_DATA(start, end);
+                regions.emplace_back(start, end);
             }
         }
 
@@ -64,43 +143,30 @@ namespace Invader {
         if(model_start >= size || model_end > size) {
             throw OutOfBoundsException();
         }
-        CRC_DATA(model_start, model_end);
+        regions.emplace_back(model_start, model_end);
 
         // Lastly, do tag data
-        auto *tag_data = map.get_tag_data_at_offset(0);
         std::size_t tag_data_start = map.get_tag_data_at_offset(0) - map.get_data_at_offset(0);
         std::size_t tag_data_end = tag_data_start + map.get_tag_data_length();
         if(tag_data_start >= size || tag_data_end > size) {
             throw OutOfBoundsException();
         }
+        regions.emplace_back(tag_data_start, tag_data_end);
 
-        // Find out where we're going to be doing CRC32 stuff
-        auto *tag_file_checksums = &reinterpret_cast<HEK::CacheFileTagDataHeader *>(map.get_tag_data_at_offset(0, sizeof(HEK::CacheFileTagDataHeader)))->tag_file_checksums;
-        const std::byte *tag_file_checksums_ptr = reinterpret_cast<const std::byte *>(tag_file_checksums);
-        std::size_t tag_file_checksums_offset_in_memory = tag_file_checksums_ptr - tag_data + data_crc.size();
-        CRC_DATA(tag_data_start, tag_data_end);
+        std::vector<std::pair<const std::byte *, std::size_t>> region_data;
+        region_data.reserve(regions.size());
+        for(auto &r : regions) {
+            region_data.emplace_back(data + r.first, r.second - r.first);
+        }
 
-        // Overwrite with new CRC32
-        if(new_crc) {
-            FakeFileHandle handle = { reinterpret_cast<std::uint8_t *>(data_crc.data()), data_crc.size(), 0 };
-            std::uint32_t newcrc = ~crc_spoof_reverse_bits(*new_crc);
-            crc_spoof_modify_file_crc32(&handle, tag_file_checksums_offset_in_memory, newcrc, false);
-            *new_random = *reinterpret_cast<std::uint32_t *>(data_crc.data() + tag_file_checksums_offset_in_memory);
-
-            // We have no way of knowing if the map was dirty or not because we just forged the CRC
-            if(check_dirty) {
-                *check_dirty = false;
-            }
+        auto *tag_file_checksums = &reinterpret_cast<HEK::CacheFileTagDataHeader *>(map.get_tag_data_at_offset(0, sizeof(HEK::CacheFileTagDataHeader)))->tag_file_checksums;
+        std::uint32_t crc_value = calculate_map_crc(region_data, reinterpret_cast<const std::byte *>(tag_file_checksums), new_crc, new_random, max_threads);
 
-            return ~crc32(0, data_crc.data(), data_crc.size());
-        }
-        else {
-            std::uint32_t crc_value = ~crc;
-            if(check_dirty) {
-                *check_dirty = crc_value != map.get_header_crc32();
-            }
-            return crc_value;
+        // We have no way of knowing if the map was dirty or not if we just forged the CRC
+        if(check_dirty) {
+            *check_dirty = !new_crc && crc_value != map.get_header_crc32();
         }
+        return crc_value;
     }
     
     std::uint32_t calculate_map_crc(const std::byte *data, std::size_t size, const std::uint32_t *new_crc, std::uint32_t *new_random, bool *check_dirty, bool allow_compressed) {
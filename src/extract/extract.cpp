@@ -11,6 +11,7 @@
 #include <invader/build/build_workload.hpp>
 #include <invader/tag/parser/parser.hpp>
 #include <regex>
+#include <thread>
 
 int main(int argc, const char **argv) {
     using namespace Invader;
@@ -26,6 +27,7 @@ int main(int argc, const char **argv) {
         bool overwrite = false;
         bool non_mp_globals = false;
         bool ignore_resource_maps = false;
+        std::size_t max_threads = std::thread::hardware_concurrency() < 1 ? 1 : std::thread::hardware_concurrency();
     } extract_options;
 
     // Command line options
@@ -38,6 +40,7 @@ int main(int argc, const char **argv) {
     options.emplace_back("info", 'i', 0, "Show credits, source info, and other info");
     options.emplace_back("search", 's', 1, "Search for tags (* and ? are wildcards); use multiple times for multiple queries", "<expr>");
     options.emplace_back("non-mp-globals", 'n', 0, "Enable extraction of non-multiplayer .globals");
+    options.emplace_back("threads", 'j', 1, "Set the number of threads to use for extracting tags. Default: CPU thread count", "<#>");
 
     static constexpr char DESCRIPTION[] = "Extract data from cache files.";
     static constexpr char USAGE[] = "[options] <map>";
@@ -67,6 +70,19 @@ int main(int argc, const char **argv) {
             case 'n':
                 extract_options.non_mp_globals = true;
                 break;
+            case 'j':
+                try {
+                    auto max_threads = std::stoi(args[0]);
+                    if(max_threads < 1) {
+                        throw std::exception();
+                    }
+                    extract_options.max_threads = static_cast<std::size_t>(max_threads);
+                }
+                catch(std::exception &) {
+                    eprintf_error("Invalid number of threads %s\n", args[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
             case 's':
                 extract_options.search_queries.emplace_back(args[0]);
                 extract_options.search_all_tags = false;
@@ -94,7 +110,7 @@ int main(int argc, const char **argv) {
         return EXIT_FAILURE;
     }
 
-    std::vector<std::byte> loc, bitmaps, sounds;
+    File::MappedFile loc, bitmaps, sounds;
 
     // Find the asset data
     if(!extract_options.maps_directory.has_value()) {
@@ -108,16 +124,16 @@ int main(int argc, const char **argv) {
     // Load resource maps
     if(extract_options.maps_directory.has_value() && !extract_options.ignore_resource_maps) {
         std::filesystem::path maps_directory(*extract_options.maps_directory);
-        auto open_map_possibly = [&maps_directory](const char *map, const char *map_alt, auto &open_map_possibly) -> std::vector<std::byte> {
-            auto potential_map = Invader::File::open_file(maps_directory / map);
+        auto open_map_possibly = [&maps_directory](const char *map, const char *map_alt, auto &open_map_possibly) -> File::MappedFile {
+            auto potential_map = Invader::File::map_file(maps_directory / map);
             if(potential_map.has_value()) {
-                return *potential_map;
+                return std::move(*potential_map);
             }
             else if(map_alt) {
                 return open_map_possibly(map_alt, nullptr, open_map_possibly);
             }
             else {
-                return std::vector<std::byte>();
+                return File::MappedFile();
             }
         };
 
@@ -166,13 +182,20 @@ int main(int argc, const char **argv) {
     // Load map
     std::unique_ptr<Map> map;
     try {
-        auto file = File::open_file(remaining_arguments[0]).value();
-        map = std::make_unique<Map>(Map::map_with_move(std::move(file), std::move(bitmaps), std::move(loc), std::move(sounds)));
+        auto file = File::map_file(remaining_arguments[0]).value();
+        map = std::make_unique<Map>(Map::map_with_lazy_decompression(std::move(file), std::move(bitmaps), std::move(loc), std::move(sounds)));
+        map->set_decompression_max_threads(extract_options.max_threads);
     }
     catch (std::exception &e) {
         eprintf_error("Failed to parse %s: %s", remaining_arguments[0], e.what());
         return EXIT_FAILURE;
     }
 
-    ExtractionWorkload::extract_map(*map, *extract_options.tags_directory, extract_options.search_queries, extract_options.recursive, extract_options.overwrite, extract_options.non_mp_globals);
+    try {
+        ExtractionWorkload::extract_map(*map, *extract_options.tags_directory, extract_options.search_queries, extract_options.recursive, extract_options.overwrite, extract_options.non_mp_globals, ErrorHandler::ReportingLevel::REPORTING_LEVEL_ALL, extract_options.max_threads);
+    }
+    catch (std::exception &e) {
+        eprintf_error("Failed to extract from %s: %s", remaining_arguments[0], e.what());
+        return EXIT_FAILURE;
+    }
 }
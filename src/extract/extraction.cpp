@@ -1,13 +1,18 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include <regex>
+#include <cctype>
+#include <unordered_map>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <invader/build/build_workload.hpp>
 #include <invader/extract/extraction.hpp>
 #include <invader/tag/hek/header.hpp>
 #include <invader/tag/parser/parser.hpp>
 
 namespace Invader {
-    void ExtractionWorkload::extract_map(const Map &map, const std::string &tags, const std::vector<std::string> &queries, bool recursive, bool overwrite, bool non_mp_globals, ReportingLevel reporting_level) {
+    void ExtractionWorkload::extract_map(const Map &map, const std::string &tags, const std::vector<std::string> &queries, bool recursive, bool overwrite, bool non_mp_globals, ReportingLevel reporting_level, std::size_t max_threads) {
         // There's no need to extract recursively if we're extracting all tags
         if(queries.size() == 0) {
             recursive = false;
@@ -15,7 +20,7 @@ namespace Invader {
         
         ExtractionWorkload workload(map, reporting_level);
         auto start = std::chrono::steady_clock::now();
-        auto success = workload.perform_extraction(queries, tags, recursive, overwrite, non_mp_globals);
+        auto success = workload.perform_extraction(queries, tags, recursive, overwrite, non_mp_globals, max_threads);
         auto matched = workload.matched_tags.size();
         auto warnings = workload.get_warnings();
         auto errors = workload.get_errors();
@@ -47,19 +52,33 @@ namespace Invader {
         }
     }
     
-    std::size_t ExtractionWorkload::perform_extraction(const std::vector<std::string> &queries, const std::filesystem::path &tags, bool recursive, bool overwrite, bool non_mp_globals) {
+    std::size_t ExtractionWorkload::perform_extraction(const std::vector<std::string> &queries, const std::filesystem::path &tags, bool recursive, bool overwrite, bool non_mp_globals, std::size_t max_threads) {
         // Set these variables up
         auto *map = &this->map;
         auto type = map->get_type();
         auto tag_count = map->get_tag_count();
-        std::vector<bool> extracted_tags(tag_count);
-        std::deque<std::size_t> all_tags_to_extract;
         auto &workload = *this;
+        
+        // Tags are extracted on worker threads, but what happened to each tag is reported in the same order as if they
+        // were extracted one at a time, so errors are held onto until then
+        struct ExtractedTag {
+            bool extracted = false;
+            std::vector<std::size_t> dependencies;
+            std::vector<std::pair<ErrorType, std::string>> errors;
 
-        auto extract_tag = [&extracted_tags, &map, &tags, &all_tags_to_extract, &type, &recursive, &overwrite, &non_mp_globals, &workload](std::size_t tag_index) -> bool {
-            // Do it
-            extracted_tags[tag_index] = true;
+            /** Anything printed while extracting it on a worker thread */
+            std::string output;
+            bool done = false;
+        };
+        std::vector<ExtractedTag> extracted_tags(tag_count);
+        
+        #define REPORT_EXTRACTION_ERROR(type, ...) { \
+            char report_error_message[2048]; \
+            std::snprintf(report_error_message, sizeof(report_error_message), __VA_ARGS__); \
+            result.errors.emplace_back(ErrorType::type, report_error_message); \
+        }
 
+        auto extract_tag_unchecked = [&map, &tags, &type, &recursive, &overwrite, &non_mp_globals](std::size_t tag_index, ExtractedTag &result) -> bool {
             // Get the tag path
             const auto &tag = map->get_tag(tag_index);
 
@@ -73,7 +92,7 @@ namespace Invader {
             // Get the path
             auto path = Invader::File::halo_path_to_preferred_path(tag.get_path());
             if(path.size() == 0) {
-                workload.report_error(ErrorType::ERROR_TYPE_ERROR, "Tag path is invalid", tag_index);
+                REPORT_EXTRACTION_ERROR(ERROR_TYPE_ERROR, "Tag path is invalid");
                 return false;
             }
 
@@ -85,7 +104,7 @@ namespace Invader {
 
             // Skip globals
             if(tag_class_int == Invader::TagClassInt::TAG_CLASS_GLOBALS && !non_mp_globals && type != Invader::HEK::CacheFileType::SCENARIO_TYPE_MULTIPLAYER) {
-                workload.report_error(ErrorType::ERROR_TYPE_WARNING_PEDANTIC, "Skipping the non-multiplayer map's globals tag", tag_index);
+                REPORT_EXTRACTION_ERROR(ERROR_TYPE_WARNING_PEDANTIC, "Skipping the non-multiplayer map's globals tag");
                 return false;
             }
 
@@ -106,14 +125,14 @@ namespace Invader {
                     }
                     for(auto &d : dependencies) {
                         auto tag_index = map->find_tag(d.first->c_str(), d.second);
-                        if(tag_index.has_value() && extracted_tags[*tag_index] == false) {
-                            all_tags_to_extract.push_back(*tag_index);
+                        if(tag_index.has_value()) {
+                            result.dependencies.push_back(*tag_index);
                         }
                     }
                 }
             }
             catch (std::exception &e) {
-                REPORT_ERROR_PRINTF(workload, ERROR_TYPE_ERROR, tag_index, "Failed to extract %s.%s: %s", Invader::File::halo_path_to_preferred_path(tag.get_path()).c_str(), tag_extension, e.what());
+                REPORT_EXTRACTION_ERROR(ERROR_TYPE_ERROR, "Failed to extract %s.%s: %s", Invader::File::halo_path_to_preferred_path(tag.get_path()).c_str(), tag_extension, e.what());
                 return false;
             }
 
@@ -160,92 +179,232 @@ namespace Invader {
                 }
                 
                 if(changed) {
-                    REPORT_ERROR_PRINTF(workload, ERROR_TYPE_WARNING_PEDANTIC, tag_index, "%s.%s was changed due to being altered in singleplayer", Invader::File::halo_path_to_preferred_path(tag.get_path()).c_str(), tag_extension);
+                    REPORT_EXTRACTION_ERROR(ERROR_TYPE_WARNING_PEDANTIC, "%s.%s was changed due to being altered in singleplayer", Invader::File::halo_path_to_preferred_path(tag.get_path()).c_str(), tag_extension);
                 }
             }
 
-            // Create directories along the way
+            // Create directories along the way (another thread may be making the same directories, so only fail if it
+            // still doesn't exist)
             try {
                 if(!std::filesystem::exists(tag_path_to_write_to.parent_path())) {
                     std::filesystem::create_directories(tag_path_to_write_to.parent_path());
                 }
             }
             catch(std::exception &e) {
-                REPORT_ERROR_PRINTF(workload, ERROR_TYPE_ERROR, tag_index, "Failed to create a directory: %s", e.what());
-                return false;
+                std::error_code ec;
+                if(!std::filesystem::is_directory(tag_path_to_write_to.parent_path(), ec)) {
+                    REPORT_EXTRACTION_ERROR(ERROR_TYPE_ERROR, "Failed to create a directory: %s", e.what());
+                    return false;
+                }
             }
 
             // Save it
             auto tag_path_str = tag_path_to_write_to.string();
             if(!Invader::File::save_file(tag_path_str.c_str(), new_tag)) {
-                REPORT_ERROR_PRINTF(workload, ERROR_TYPE_ERROR, tag_index, "Failed to save %s", tag_path_str.c_str());
+                REPORT_EXTRACTION_ERROR(ERROR_TYPE_ERROR, "Failed to save %s", tag_path_str.c_str());
                 return false;
             }
 
             return true;
         };
+        
+        // This runs on worker threads, so anything that fails while reading the tag (such as the map failing to
+        // decompress) has to be reported with the tag instead of being thrown
+        auto extract_tag = [&extract_tag_unchecked](std::size_t tag_index, ExtractedTag &result) -> bool {
+            try {
+                return extract_tag_unchecked(tag_index, result);
+            }
+            catch(std::exception &e) {
+                REPORT_EXTRACTION_ERROR(ERROR_TYPE_ERROR, "Failed to extract tag #%zu: %s", tag_index, e.what());
+                return false;
+            }
+        };
+        
+        #undef REPORT_EXTRACTION_ERROR
 
+        // Tags are extracted in tag index order, followed by the dependencies of each tag in the order the tags were
+        // extracted. This is the same regardless of thread count.
+        std::vector<std::size_t> extraction_order;
+        std::vector<bool> matched(tag_count);
+        extraction_order.reserve(tag_count);
+        
         // Extract each tag?
         if(queries.size() == 0) {
-            for(std::size_t t = 0; t < tag_count; t++) {
-                all_tags_to_extract.push_back(t);
-            }
+            matched.assign(tag_count, true);
         }
-
         else {
-            std::size_t tag_count = map->get_tag_count();
-            for(std::size_t t = 0; t < tag_count; t++) {
-                // See if we already added
-                bool already_added = false;
-                for(auto &tag : all_tags_to_extract) {
-                    if(tag == t) {
-                        already_added = true;
-                        break;
-                    }
+            // Each query only has to check tags that start with everything before its first wildcard
+            for(auto &query : queries) {
+                for(auto t : map->find_tags(query.c_str())) {
+                    matched[t] = true;
                 }
-                if(already_added) {
+            }
+        }
+        for(std::size_t t = 0; t < tag_count; t++) {
+            if(matched[t]) {
+                extraction_order.push_back(t);
+            }
+        }
+        
+        if(queries.size() != 0 && extraction_order.size() == 0) {
+            workload.report_error(ErrorType::ERROR_TYPE_ERROR, "No tags were found with the given search parameter(s).");
+            return 0;
+        }
+
+        // Tags that would be written to the same file as another tag are extracted in order on this thread to make sure
+        // the same one ends up being written. Paths that only differ by case or slashes are the same file on some
+        // filesystems, so they're compared without either.
+        std::vector<bool> shares_path(tag_count);
+        std::unordered_map<std::string, std::size_t> output_paths;
+        output_paths.reserve(tag_count);
+        for(std::size_t t = 0; t < tag_count; t++) {
+            try {
+                auto [tag_path, tag_class_int] = map->get_tag_path_and_class(t);
+                auto path = Invader::File::halo_path_to_preferred_path(tag_path);
+                if(path.size() == 0) {
                     continue;
                 }
-
-                const auto &tag = map->get_tag(t);
-                auto full_tag_path = Invader::File::halo_path_to_preferred_path(tag.get_path()) + "." + HEK::tag_class_to_extension(tag.get_tag_class_int());
-
-                for(auto &query : queries) {
-                    if(File::path_matches(full_tag_path.c_str(), query.c_str())) {
-                        all_tags_to_extract.emplace_back(t);
-                        break;
-                    }
+                auto output_path = std::filesystem::path(path + "." + Invader::HEK::tag_class_to_extension(tag_class_int)).lexically_normal().generic_string();
+                for(auto &c : output_path) {
+                    c = c == '\\' ? '/' : static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+                }
+                auto [first, inserted] = output_paths.emplace(std::move(output_path), t);
+                if(!inserted) {
+                    shares_path[t] = true;
+                    shares_path[first->second] = true;
                 }
             }
-
-            if(all_tags_to_extract.size() == 0) {
-                workload.report_error(ErrorType::ERROR_TYPE_ERROR, "No tags were found with the given search parameter(s).");
-                return 0;
+            catch(std::exception &) {
+                continue;
             }
         }
-
-        // Extract tags
-        std::size_t total = 0;
-        std::size_t extracted = 0;
-        while(all_tags_to_extract.size() > 0) {
-            std::size_t tag = all_tags_to_extract[0];
-            all_tags_to_extract.erase(all_tags_to_extract.begin());
-            if(extracted_tags[tag]) {
-                continue;
+        
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::deque<std::size_t> pending;
+        std::vector<bool> queued(tag_count);
+        bool stopping = false;
+        
+        // Queue a tag for the worker threads if nobody has queued it yet (mutex must be locked)
+        auto queue_tag = [&queued, &shares_path, &pending, &condition](std::size_t tag_index) {
+            if(!queued[tag_index]) {
+                queued[tag_index] = true;
+                if(!shares_path[tag_index]) {
+                    pending.push_back(tag_index);
+                    condition.notify_all();
+                }
+            }
+        };
+        
+        auto extract_worker = [&mutex, &condition, &pending, &stopping, &extracted_tags, &extract_tag, &queue_tag]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(true) {
+                condition.wait(lock, [&stopping, &pending]() { return stopping || !pending.empty(); });
+                if(stopping) {
+                    return;
+                }
+                
+                auto tag_index = pending.front();
+                pending.pop_front();
+                lock.unlock();
+                
+                ExtractedTag result;
+                {
+                    EprintfBufferScope buffer_output(result.output);
+                    result.extracted = extract_tag(tag_index, result);
+                }
+                
+                lock.lock();
+                for(auto d : result.dependencies) {
+                    queue_tag(d);
+                }
+                extracted_tags[tag_index] = std::move(result);
+                extracted_tags[tag_index].done = true;
+                condition.notify_all();
             }
-            const auto &tag_map = map->get_tag(tag);
-            if(extract_tag(tag)) {
-                oprintf_success("Extracted %s.%s", Invader::File::halo_path_to_preferred_path(tag_map.get_path()).c_str(), HEK::tag_class_to_extension(tag_map.get_tag_class_int()));
-                extracted++;
+        };
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(auto t : extraction_order) {
+                queue_tag(t);
             }
-            else {
-                eprintf("Skipped %s.%s\n", Invader::File::halo_path_to_preferred_path(tag_map.get_path()).c_str(), HEK::tag_class_to_extension(tag_map.get_tag_class_int()));
+        }
+        
+        std::vector<std::thread> threads;
+        threads.reserve(max_threads);
+        
+        // Stop the worker threads, which also has to be done before anything thrown here leaves this function
+        auto stop_workers = [&mutex, &stopping, &condition, &threads]() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
             }
+            condition.notify_all();
+            for(auto &t : threads) {
+                t.join();
+            }
+        };
+        
+        std::size_t extracted = 0;
+        try {
+            for(std::size_t i = 0; i < max_threads; i++) {
+                threads.emplace_back(extract_worker);
+            }
+            
+            // Extract tags
+            for(std::size_t i = 0; i < extraction_order.size(); i++) {
+                std::size_t tag = extraction_order[i];
+                auto &result = extracted_tags[tag];
+            
+                if(shares_path[tag]) {
+                    result.extracted = extract_tag(tag, result);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for(auto d : result.dependencies) {
+                        queue_tag(d);
+                    }
+                }
+                else {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait(lock, [&result]() { return result.done; });
+                }
+            
+                eprintf("%s", result.output.c_str());
+                for(auto &e : result.errors) {
+                    workload.report_error(e.first, e.second.c_str(), tag);
+                }
+            
+                const auto &tag_map = map->get_tag(tag);
+                if(result.extracted) {
+                    oprintf_success("Extracted %s.%s", Invader::File::halo_path_to_preferred_path(tag_map.get_path()).c_str(), HEK::tag_class_to_extension(tag_map.get_tag_class_int()));
+                    extracted++;
+                }
+                else {
+                    eprintf("Skipped %s.%s\n", Invader::File::halo_path_to_preferred_path(tag_map.get_path()).c_str(), HEK::tag_class_to_extension(tag_map.get_tag_class_int()));
+                }
+            
+                for(auto d : result.dependencies) {
+                    if(!matched[d]) {
+                        matched[d] = true;
+                        extraction_order.push_back(d);
+                    }
+                }
+            
+                // We don't need these anymore
+                result.dependencies = {};
+                result.errors = {};
+                result.output = {};
+            }
+        }
+        catch(...) {
+            stop_workers();
+            throw;
         }
+        stop_workers();
         
-        this->matched_tags.reserve(total);
+        this->matched_tags.reserve(extraction_order.size());
         for(std::size_t i = 0; i < tag_count; i++) {
-            if(extracted_tags[i]) {
+            if(matched[i]) {
                 this->matched_tags.push_back(i);
             }
         }
@@ -258,8 +417,8 @@ namespace Invader {
         auto tag_count = map.get_tag_count();
         paths.reserve(tag_count);
         for(std::size_t i = 0; i < tag_count; i++) {
-            auto &tag = map.get_tag(i);
-            paths.emplace_back(tag.get_path(), tag.get_tag_class_int());
+            auto [path, tag_class_int] = map.get_tag_path_and_class(i);
+            paths.emplace_back(path, tag_class_int);
         }
     }
     
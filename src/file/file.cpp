@@ -2,6 +2,11 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #include <invader/file/file.hpp>
@@ -11,6 +16,7 @@
 #include <filesystem>
 #include <cstring>
 #include <climits>
+#include <cstdint>
 
 namespace Invader::File {
     std::optional<std::vector<std::byte>> open_file(const std::filesystem::path &path) {
@@ -67,6 +73,131 @@ namespace Invader::File {
         return file_data;
     }
 
+    MappedFile::MappedFile(MappedFile &&move) noexcept : file_data(move.file_data), file_size(move.file_size) {
+        move.file_data = nullptr;
+        move.file_size = 0;
+    }
+
+    MappedFile &MappedFile::operator=(MappedFile &&move) noexcept {
+        if(this != &move) {
+            this->unmap();
+            this->file_data = move.file_data;
+            this->file_size = move.file_size;
+            move.file_data = nullptr;
+            move.file_size = 0;
+        }
+        return *this;
+    }
+
+    MappedFile::~MappedFile() {
+        this->unmap();
+    }
+
+    void MappedFile::unmap() noexcept {
+        if(this->file_data) {
+            #ifdef _WIN32
+            UnmapViewOfFile(this->file_data);
+            #else
+            munmap(this->file_data, this->file_size);
+            #endif
+        }
+        this->file_data = nullptr;
+        this->file_size = 0;
+    }
+
+    std::optional<MappedFile> map_file(const std::filesystem::path &path) {
+        MappedFile file;
+
+        #ifdef _WIN32
+        HANDLE handle = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(handle == INVALID_HANDLE_VALUE) {
+            return std::nullopt;
+        }
+
+        LARGE_INTEGER size;
+        if(!GetFileSizeEx(handle, &size) || static_cast<ULONGLONG>(size.QuadPart) > SIZE_MAX) {
+            CloseHandle(handle);
+            return std::nullopt;
+        }
+
+        // Empty files can't be mapped, but there's nothing to map anyway
+        if(size.QuadPart > 0) {
+            // Copy-on-write, so the data can be modified without touching the file
+            HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+            if(!mapping) {
+                CloseHandle(handle);
+                return std::nullopt;
+            }
+            auto *data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+            CloseHandle(mapping);
+            if(!data) {
+                CloseHandle(handle);
+                return std::nullopt;
+            }
+            file.file_data = reinterpret_cast<std::byte *>(data);
+            file.file_size = static_cast<std::size_t>(size.QuadPart);
+        }
+        CloseHandle(handle);
+        #else
+        int fd = open(path.string().c_str(), O_RDONLY);
+        if(fd == -1) {
+            return std::nullopt;
+        }
+
+        struct stat file_stat;
+        if(fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || static_cast<std::uintmax_t>(file_stat.st_size) > SIZE_MAX) {
+            close(fd);
+            return std::nullopt;
+        }
+
+        // Empty files can't be mapped, but there's nothing to map anyway
+        if(file_stat.st_size > 0) {
+            // Copy-on-write, so the data can be modified without touching the file
+            auto size = static_cast<std::size_t>(file_stat.st_size);
+            auto *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if(data == MAP_FAILED) {
+                close(fd);
+                return std::nullopt;
+            }
+            file.file_data = reinterpret_cast<std::byte *>(data);
+            file.file_size = size;
+        }
+        close(fd);
+        #endif
+
+        return file;
+    }
+
+    std::optional<MappedFile> map_memory(std::size_t size) {
+        MappedFile memory;
+        if(size == 0) {
+            return memory;
+        }
+
+        #ifdef _WIN32
+        // Backed by the page file, which is only committed as pages are touched
+        auto size_64 = static_cast<std::uint64_t>(size);
+        HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size_64 >> 32), static_cast<DWORD>(size_64 & 0xFFFFFFFF), nullptr);
+        if(!mapping) {
+            return std::nullopt;
+        }
+        auto *data = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+        CloseHandle(mapping);
+        if(!data) {
+            return std::nullopt;
+        }
+        #else
+        auto *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(data == MAP_FAILED) {
+            return std::nullopt;
+        }
+        #endif
+
+        memory.file_data = reinterpret_cast<std::byte *>(data);
+        memory.file_size = size;
+        return memory;
+    }
+
     bool save_file(const std::filesystem::path &path, const std::vector<std::byte> &data) {
         // Open the file
         std::FILE *f = std::fopen(path.string().c_str(), "wb");
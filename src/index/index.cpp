@@ -39,7 +39,7 @@ int main(int argc, const char **argv) {
     const char *output = remaining_arguments[1];
     const char *input = remaining_arguments[0];
 
-    auto input_map_data = File::open_file(input);
+    auto input_map_data = File::map_file(input);
 
     // Open input map
     if(!input_map_data.has_value()) {
@@ -99,7 +99,7 @@ int main(int argc, const char **argv) {
     // If not, it's probably a cache file
     else {
         try {
-            auto map = Map::map_with_move(std::move(input_map));
+            auto map = Map::map_with_lazy_decompression(std::move(input_map));
 
             // Open output
             std::FILE *f = std::fopen(output, "wb");
@@ -1,14 +1,22 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include <optional>
+#include <algorithm>
+#include <condition_variable>
+#include <filesystem>
+#include <cmath>
+#include <mutex>
+#include <thread>
 #include <invader/map/map.hpp>
 #include <invader/file/file.hpp>
+#include <invader/json.hpp>
 #include <invader/command_line_option.hpp>
 #include <invader/crc/hek/crc.hpp>
 #include <invader/version.hpp>
 #include <invader/tag/parser/parser.hpp>
 #include <invader/hek/map.hpp>
 #include <invader/compress/compression.hpp>
+#include <invader/error.hpp>
 
 #include "language/language.hpp"
 #include "info_def.hpp"
@@ -17,13 +25,10 @@
 
 struct DisplayValue {
     const char * const name;
-    void (* const calculate_value)(const Invader::Map &map);
+    Invader::Info::Value (* const calculate_value)(const Invader::Map &map, std::size_t file_size);
 };
 
-#define MAKE_DISPLAY_VALUE(name) {# name, Invader::Info::name }
-
-static std::byte header_cache[sizeof(Invader::HEK::NativeCacheFileHeader)];
-static std::size_t file_size = 0;
+#define MAKE_DISPLAY_VALUE(name) {# name, [](const Invader::Map &map, std::size_t) { return Invader::Info::name(map); } }
 
 // Calculating compression ratio:
 //
@@ -32,18 +37,18 @@ static std::size_t file_size = 0;
 //
 //        So, if a map is 15 MiB compressed and 20 MiB uncompressed, the compression ratio is 0.75.
 //
-static double calculate_compression_ratio(const Invader::Map &map) {
+static double calculate_compression_ratio(const Invader::Map &map, std::size_t file_size) {
     auto uncompressed_length = map.get_data_length() - sizeof(Invader::HEK::CacheFileHeader);
     auto compressed_length = file_size - sizeof(Invader::HEK::CacheFileHeader);
     return static_cast<double>(compressed_length) / uncompressed_length;
 }
 
 namespace Invader::Info {
-    void compression_ratio(const Invader::Map &map) {
-        oprintf("%f\n", calculate_compression_ratio(map));
+    static Value compression_ratio(const Invader::Map &map, std::size_t file_size) {
+        return calculate_compression_ratio(map, file_size);
     }
     
-    void overview(const Invader::Map &map) {
+    void overview(const Invader::Map &map, std::size_t file_size) {
         #define PRINT_LINE(function, key, format, ...) function("%-19s" format, key, __VA_ARGS__)
         
         // Basic metadata
@@ -53,7 +58,7 @@ namespace Invader::Info {
         PRINT_LINE(oprintf, "Engine:", "%s\n", engine_name(engine));
         
         if(engine == HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
-            PRINT_LINE(oprintf, "Timestamp:", "%s\n", reinterpret_cast<Invader::HEK::NativeCacheFileHeader *>(header_cache)->timestamp.string);
+            PRINT_LINE(oprintf, "Timestamp:", "%s\n", reinterpret_cast<const Invader::HEK::NativeCacheFileHeader *>(map.get_data_at_offset(0, sizeof(Invader::HEK::NativeCacheFileHeader)))->timestamp.string);
         }
         
         PRINT_LINE(oprintf, "Map type:", "%s\n", type_name(map.get_type()));
@@ -166,7 +171,7 @@ namespace Invader::Info {
                     break;
             }
             
-            PRINT_LINE(oprintf, "Compressed:", "Yes (%.02f %%) via %s\n", calculate_compression_ratio(map) * 100.0, compression_algorithm);
+            PRINT_LINE(oprintf, "Compressed:", "Yes (%.02f %%) via %s\n", calculate_compression_ratio(map, file_size) * 100.0, compression_algorithm);
         }
         else {
             PRINT_LINE(oprintf, "Compressed:", "%s\n", "No");
@@ -204,10 +209,9 @@ namespace Invader::Info {
 }
 
 static DisplayValue all_values[] = {
-    MAKE_DISPLAY_VALUE(overview),
     MAKE_DISPLAY_VALUE(build),
     MAKE_DISPLAY_VALUE(compressed),
-    MAKE_DISPLAY_VALUE(compression_ratio),
+    {"compression_ratio", Invader::Info::compression_ratio},
     MAKE_DISPLAY_VALUE(crc32),
     MAKE_DISPLAY_VALUE(crc32_mismatched),
     MAKE_DISPLAY_VALUE(dirty),
@@ -236,44 +240,111 @@ static DisplayValue all_values[] = {
     MAKE_DISPLAY_VALUE(uncompressed_size)
 };
 
+// Types are shown with hyphens, but underscores are accepted, too
+static std::string display_type_name(const char *name) {
+    std::string type = name;
+    std::replace(type.begin(), type.end(), '_', '-');
+    return type;
+}
+
+static std::string json_value(const Invader::Info::Value &value) {
+    if(auto *b = std::get_if<bool>(&value)) {
+        return *b ? "true" : "false";
+    }
+    else if(auto *n = std::get_if<std::size_t>(&value)) {
+        return std::to_string(*n);
+    }
+    else if(auto *d = std::get_if<double>(&value)) {
+        if(!std::isfinite(*d)) {
+            return "null";
+        }
+        char number[64];
+        std::snprintf(number, sizeof(number), "%f", *d);
+        return number;
+    }
+    else if(auto *s = std::get_if<std::string>(&value)) {
+        return Invader::json_string(*s);
+    }
+    else {
+        std::string list = "[";
+        for(auto &i : std::get<std::vector<std::string>>(value)) {
+            list += list.size() == 1 ? "" : ", ";
+            list += Invader::json_string(i);
+        }
+        return list + "]";
+    }
+}
+
+static void print_text_value(const char *prefix, const Invader::Info::Value &value) {
+    if(auto *b = std::get_if<bool>(&value)) {
+        oprintf("%s%i\n", prefix, *b);
+    }
+    else if(auto *n = std::get_if<std::size_t>(&value)) {
+        oprintf("%s%zu\n", prefix, *n);
+    }
+    else if(auto *d = std::get_if<double>(&value)) {
+        oprintf("%s%f\n", prefix, *d);
+    }
+    else if(auto *s = std::get_if<std::string>(&value)) {
+        oprintf("%s%s\n", prefix, s->c_str());
+    }
+    else for(auto &i : std::get<std::vector<std::string>>(value)) {
+        oprintf("%s%s\n", prefix, i.c_str());
+    }
+}
+
 int main(int argc, const char **argv) {
     using namespace Invader;
+    
+    enum OutputFormat {
+        OUTPUT_FORMAT_TEXT,
+        OUTPUT_FORMAT_JSON,
+        OUTPUT_FORMAT_NDJSON
+    };
 
     // Options struct
     struct MapInfoOptions {
-        const DisplayValue *type = &all_values[0];
+        bool overview = false;
+        std::vector<const DisplayValue *> types;
+        OutputFormat format = OUTPUT_FORMAT_TEXT;
+        std::size_t max_threads = std::thread::hardware_concurrency() < 1 ? 1 : std::thread::hardware_concurrency();
     } map_info_options;
     
     // Form the options list
-    std::string options_list;
-    bool overview_added = false;
+    std::string options_list = "Set the type of data to show. This can be used multiple times. Can be overview (default; shows all other types if the format is json or ndjson)";
     for(auto &i : all_values) {
-        if(!overview_added) {
-            options_list += "Set the type of data to show. Can be overview (default)";
-        }
-        else {
-            options_list += ", ";
-            options_list += i.name;
-        }
+        options_list += ", ";
+        options_list += display_type_name(i.name);
     }
 
     // Command line options
     std::vector<Invader::CommandLineOption> options;
     options.emplace_back("type", 'T', 1, options_list.c_str(), "<type>");
+    options.emplace_back("format", 'f', 1, "Set the output format. Can be text (default), json (an array with an object for each map), or ndjson (an object for each map on its own line).", "<format>");
+    options.emplace_back("threads", 'j', 1, "Set the number of threads to use for reading maps in parallel. Default: CPU thread count", "<#>");
     options.emplace_back("info", 'i', 0, "Show credits, source info, and other info.");
 
-    static constexpr char DESCRIPTION[] = "Display map metadata.";
-    static constexpr char USAGE[] = "[option] <map>";
+    static constexpr char DESCRIPTION[] = "Display map metadata. If a directory is given, all of the maps in it are shown.";
+    static constexpr char USAGE[] = "[options] <map | directory> [...]";
 
     // Do it!
-    auto remaining_arguments = Invader::CommandLineOption::parse_arguments<MapInfoOptions &>(argc, argv, options, USAGE, DESCRIPTION, 1, 1, map_info_options, [](char opt, const auto &args, auto &map_info_options) {
+    auto remaining_arguments = Invader::CommandLineOption::parse_arguments<MapInfoOptions &>(argc, argv, options, USAGE, DESCRIPTION, 1, 65535, map_info_options, [](char opt, const auto &args, auto &map_info_options) {
         switch(opt) {
             case 'T': {
-                bool found = false;
+                std::string type = args[0];
+                std::replace(type.begin(), type.end(), '-', '_');
+                
+                if(type == "overview") {
+                    map_info_options.overview = true;
+                    break;
+                }
                 
+                bool found = false;
                 for(auto &i : all_values) {
-                    if(std::strcmp(args[0], i.name) == 0) {
-                        map_info_options.type = &i;
+                    if(type == i.name) {
+                        if(std::find(map_info_options.types.begin(), map_info_options.types.end(), &i) == map_info_options.types.end()) {
+                            map_info_options.types.emplace_back(&i);
+                        }
                         found = true;
                         break;
                     }
@@ -285,29 +356,250 @@ int main(int argc, const char **argv) {
                 }
                 break;
             }
+            case 'f':
+                if(std::strcmp(args[0], "text") == 0) {
+                    map_info_options.format = OUTPUT_FORMAT_TEXT;
+                }
+                else if(std::strcmp(args[0], "json") == 0) {
+                    map_info_options.format = OUTPUT_FORMAT_JSON;
+                }
+                else if(std::strcmp(args[0], "ndjson") == 0) {
+                    map_info_options.format = OUTPUT_FORMAT_NDJSON;
+                }
+                else {
+                    eprintf_error("Unknown format %s", args[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
+            case 'j':
+                try {
+                    auto max_threads = std::stoi(args[0]);
+                    if(max_threads < 1) {
+                        throw std::exception();
+                    }
+                    map_info_options.max_threads = static_cast<std::size_t>(max_threads);
+                }
+                catch(std::exception &) {
+                    eprintf_error("Invalid number of threads %s\n", args[0]);
+                    std::exit(EXIT_FAILURE);
+                }
+                break;
             case 'i':
                 Invader::show_version_info();
                 std::exit(EXIT_SUCCESS);
         }
     });
-
-    // Load it
-    std::unique_ptr<Map> map;
-    try {
-        auto file = File::open_file(remaining_arguments[0]).value();
-        file_size = file.size();
-        if(file_size >= sizeof(header_cache)) {
-            std::memcpy(header_cache, file.data(), sizeof(header_cache));
+    
+    bool text = map_info_options.format == OUTPUT_FORMAT_TEXT;
+    auto &types = map_info_options.types;
+    
+    // Overview is the default. It can only be shown as text, so JSON gets everything instead.
+    if(types.empty()) {
+        map_info_options.overview = true;
+    }
+    if(!text && map_info_options.overview) {
+        types.clear();
+        for(auto &i : all_values) {
+            types.emplace_back(&i);
+        }
+        map_info_options.overview = false;
+    }
+    
+    // Find our maps
+    struct MapInfo {
+        std::filesystem::path path;
+        std::size_t file_size = 0;
+        std::unique_ptr<Map> map;
+        std::vector<Info::Value> values;
+        std::string error;
+        bool done = false;
+    };
+    std::vector<MapInfo> maps;
+    for(auto *argument : remaining_arguments) {
+        std::filesystem::path path = argument;
+        std::error_code ec;
+        if(std::filesystem::is_directory(path, ec)) {
+            std::vector<std::filesystem::path> directory_maps;
+            for(auto &i : std::filesystem::directory_iterator(path, ec)) {
+                if(i.path().extension() == ".map" && i.is_regular_file(ec)) {
+                    directory_maps.emplace_back(i.path());
+                }
+            }
+            if(ec) {
+                eprintf_error("Failed to read %s: %s", argument, ec.message().c_str());
+                return EXIT_FAILURE;
+            }
+            std::sort(directory_maps.begin(), directory_maps.end());
+            for(auto &i : directory_maps) {
+                maps.emplace_back().path = std::move(i);
+            }
+        }
+        else {
+            maps.emplace_back().path = std::move(path);
+        }
+    }
+    
+    // Load each map and calculate everything we need to show for it. Maps are shown in the order they were given as
+    // soon as they (and everything before them) are done. Workers can only get so far ahead of the map being shown so
+    // finished maps don't pile up waiting to be shown.
+    std::size_t thread_count = std::min(map_info_options.max_threads, maps.size());
+    std::size_t max_maps_ahead = thread_count * 2;
+    
+    // Each map's CRC32 is calculated (and MCC-compressed data is decompressed) on multiple threads, so split the CPU's
+    // threads between the maps being read
+    std::size_t cpu_threads = std::thread::hardware_concurrency() < 1 ? 1 : std::thread::hardware_concurrency();
+    std::size_t crc32_threads = thread_count <= 1 ? 0 : std::max<std::size_t>(cpu_threads / thread_count, 1);
+    
+    std::mutex map_mutex;
+    std::condition_variable map_done;
+    std::size_t next_map = 0;
+    std::size_t maps_shown = 0;
+    auto info_worker = [&maps, &map_mutex, &map_done, &next_map, &maps_shown, &max_maps_ahead, &crc32_threads, &types, &map_info_options]() {
+        while(true) {
+            std::size_t m;
+            {
+                std::unique_lock<std::mutex> lock(map_mutex);
+                map_done.wait(lock, [&]() { return next_map >= maps.size() || next_map < maps_shown + max_maps_ahead; });
+                if(next_map >= maps.size()) {
+                    return;
+                }
+                m = next_map++;
+            }
+            
+            auto &info = maps[m];
+            std::unique_ptr<Map> map;
+            std::vector<Info::Value> values;
+            std::string error;
+            
+            try {
+                auto file_maybe = File::map_file(info.path);
+                if(!file_maybe.has_value()) {
+                    throw FailedToOpenFileException();
+                }
+                auto file = std::move(*file_maybe);
+                auto file_size = file.size();
+                map = std::make_unique<Map>(Map::map_with_lazy_decompression(std::move(file)));
+                map->set_crc32_max_threads(crc32_threads);
+                map->set_decompression_max_threads(crc32_threads);
+                
+                // Everything that depends on the CRC32 shares the same one, so it's calculated once per map
+                values.reserve(types.size());
+                for(auto *t : types) {
+                    values.emplace_back(t->calculate_value(*map, file_size));
+                }
+                
+                // Only the overview needs the map itself once the values are calculated
+                if(map_info_options.overview) {
+                    map->get_crc32();
+                }
+                else {
+                    map.reset();
+                }
+                
+                info.file_size = file_size;
+            }
+            catch(std::exception &e) {
+                error = e.what();
+                map.reset();
+                values.clear();
+            }
+            
+            std::lock_guard<std::mutex> lock(map_mutex);
+            info.map = std::move(map);
+            info.values = std::move(values);
+            info.error = std::move(error);
+            info.done = true;
+            map_done.notify_all();
         }
-        map = std::make_unique<Map>(Map::map_with_move(std::move(file)));
+    };
+    
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for(std::size_t i = 0; i < thread_count; i++) {
+        threads.emplace_back(info_worker);
     }
-    catch (std::exception &e) {
-        eprintf_error("Failed to parse %s: %s", remaining_arguments[0], e.what());
-        return EXIT_FAILURE;
+    
+    // Show it!
+    bool multiple_maps = maps.size() > 1;
+    bool multiple_types = types.size() + map_info_options.overview > 1;
+    bool success = true;
+    
+    if(map_info_options.format == OUTPUT_FORMAT_JSON) {
+        oprintf("[");
     }
     
-    // Do it!
-    map_info_options.type->calculate_value(*map);
+    for(std::size_t m = 0; m < maps.size(); m++) {
+        auto &info = maps[m];
+        {
+            std::unique_lock<std::mutex> lock(map_mutex);
+            map_done.wait(lock, [&info]() { return info.done; });
+        }
+        
+        auto path = info.path.string();
+        
+        if(!info.error.empty()) {
+            eprintf_error("Failed to parse %s: %s", path.c_str(), info.error.c_str());
+            success = false;
+        }
+        
+        if(!text) {
+            std::string record = "{ \"path\": " + json_string(path);
+            if(!info.error.empty()) {
+                record += ", \"error\": " + json_string(info.error);
+            }
+            else for(std::size_t t = 0; t < types.size(); t++) {
+                record += ", " + json_string(display_type_name(types[t]->name)) + ": " + json_value(info.values[t]);
+            }
+            record += " }";
+            
+            if(map_info_options.format == OUTPUT_FORMAT_JSON) {
+                oprintf("%s\n    %s", m == 0 ? "" : ",", record.c_str());
+            }
+            else {
+                oprintf("%s\n", record.c_str());
+            }
+        }
+        else if(info.error.empty()) {
+            if(map_info_options.overview) {
+                if(multiple_maps) {
+                    oprintf("%s:\n", path.c_str());
+                }
+                try {
+                    Info::overview(*info.map, info.file_size);
+                }
+                catch(std::exception &e) {
+                    eprintf_error("Failed to parse %s: %s", path.c_str(), e.what());
+                    success = false;
+                }
+            }
+            for(std::size_t t = 0; t < types.size(); t++) {
+                std::string prefix;
+                if(multiple_maps) {
+                    prefix += path + ": ";
+                }
+                if(multiple_types) {
+                    prefix += display_type_name(types[t]->name) + ": ";
+                }
+                print_text_value(prefix.c_str(), info.values[t]);
+            }
+        }
+        
+        // We don't need it anymore, so let the workers move on
+        info.map.reset();
+        info.values.clear();
+        
+        std::lock_guard<std::mutex> lock(map_mutex);
+        maps_shown = m + 1;
+        map_done.notify_all();
+    }
+    
+    if(map_info_options.format == OUTPUT_FORMAT_JSON) {
+        oprintf("%s]\n", maps.empty() ? "" : "\n");
+    }
+    
+    for(auto &i : threads) {
+        i.join();
+    }
     
-    return EXIT_SUCCESS;
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
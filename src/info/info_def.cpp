@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <cstdio>
 #include <invader/map/map.hpp>
 #include <invader/printf.hpp>
 #include <invader/file/file.hpp>
@@ -205,131 +206,149 @@ namespace Invader::Info {
         return languages;
     }
     
-    void build(const Invader::Map &map) {
-        oprintf("%s\n", map.get_build());
+    Value build(const Invader::Map &map) {
+        return std::string(map.get_build());
     }
     
-    void compressed(const Invader::Map &map) {
-        oprintf("%i\n", map.get_compression_algorithm());
+    Value compressed(const Invader::Map &map) {
+        return static_cast<std::size_t>(map.get_compression_algorithm());
     }
     
-    void crc32(const Invader::Map &map) {
-        oprintf("%08X\n", map.get_crc32());
+    Value crc32(const Invader::Map &map) {
+        char crc[9];
+        std::snprintf(crc, sizeof(crc), "%08X", map.get_crc32());
+        return std::string(crc);
     }
-    void crc32_mismatched(const Invader::Map &map) {
-        oprintf("%i\n", map.get_crc32() != map.get_header_crc32());
+    Value crc32_mismatched(const Invader::Map &map) {
+        return map.get_crc32() != map.get_header_crc32();
     }
     
-    void dirty(const Invader::Map &map) {
-        oprintf("%i\n", !map.is_clean());
+    Value dirty(const Invader::Map &map) {
+        return !map.is_clean();
     }
     
-    void engine(const Invader::Map &map) {
-        oprintf("%s\n", engine_name(map.get_engine()));
+    Value engine(const Invader::Map &map) {
+        return std::string(engine_name(map.get_engine()));
     }
     
-    void external_bitmap_indices(const Invader::Map &map) {
-        oprintf("%zu\n", find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, true, false).size());
+    Value external_bitmap_indices(const Invader::Map &map) {
+        return find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, true, false).size();
     }
-    void external_bitmaps(const Invader::Map &map) {
-        oprintf("%zu\n", find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, true, true).size());
+    Value external_bitmaps(const Invader::Map &map) {
+        return find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, true, true).size();
     }
     
-    void external_loc_indices(const Invader::Map &map) {
-        oprintf("%zu\n", find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, true, false).size());
+    Value external_loc_indices(const Invader::Map &map) {
+        return find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, true, false).size();
     }
     
-    void external_sound_indices(const Invader::Map &map) {
-        oprintf("%zu\n", find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, true, false).size());
+    Value external_sound_indices(const Invader::Map &map) {
+        return find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, true, false).size();
     }
-    void external_sounds(const Invader::Map &map) {
-        oprintf("%zu\n", find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, true, true).size());
+    Value external_sounds(const Invader::Map &map) {
+        return find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, true, true).size();
     }
     
-    void external_tags(const Invader::Map &map) {
-        oprintf("%zu\n", find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, true, true).size() + find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, true, true).size() + find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, true, true).size());
+    Value external_tags(const Invader::Map &map) {
+        return find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, true, true).size() + find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, true, true).size() + find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, true, true).size();
     }
-    void external_indices(const Invader::Map &map) {
-        oprintf("%zu\n", find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, true, true).size() + find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, true, false).size() + find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, true, false).size());
+    Value external_indices(const Invader::Map &map) {
+        return find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, true, true).size() + find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, true, false).size() + find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, true, false).size();
     }
-    void external_pointers(const Invader::Map &map) {
-        oprintf("%i\n", (find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, false, true).size() + find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, false, true).size() + find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, false, true).size()) > 0);
+    Value external_pointers(const Invader::Map &map) {
+        return (find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, false, true).size() + find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, false, true).size() + find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, false, true).size()) > 0;
     }
     
-    void languages(const Invader::Map &map) {
+    Value languages(const Invader::Map &map) {
         bool all;
         auto languages = find_languages_for_map(map, all);
         if(all) {
-            oprintf("all\n");
+            return std::vector<std::string> { "all" };
         }
         else if(languages.size() == 0) {
-            oprintf("unknown\n");
+            return std::vector<std::string> { "unknown" };
         }
-        else for(auto &i : languages) {
-            oprintf("%s\n", i.c_str());
+        else {
+            return languages;
         }
     }
     
-    void map_type(const Invader::Map &map) {
-        oprintf("%s\n", type_name(map.get_type()));
+    Value map_type(const Invader::Map &map) {
+        return std::string(type_name(map.get_type()));
     }
     
-    void protection(const Invader::Map &map) {
-        oprintf("%i\n", map.is_protected());
+    Value protection(const Invader::Map &map) {
+        return map.is_protected();
     }
     
-    void scenario(const Invader::Map &map) {
-        oprintf("%s\n", map.get_scenario_name());
+    Value scenario(const Invader::Map &map) {
+        return std::string(map.get_scenario_name());
     }
     
-    void scenario_path(const Invader::Map &map) {
-        oprintf("%s\n", File::halo_path_to_preferred_path(map.get_tag(map.get_scenario_tag_id()).get_path()).c_str());
+    Value scenario_path(const Invader::Map &map) {
+        return File::halo_path_to_preferred_path(map.get_tag(map.get_scenario_tag_id()).get_path());
     }
     
-    void tag_count(const Invader::Map &map) {
-        oprintf("%zu\n", map.get_tag_count());
+    Value tag_count(const Invader::Map &map) {
+        return map.get_tag_count();
     }
     
-    void stub_count(const Invader::Map &map) {
-        oprintf("%zu\n", calculate_stub_count(map));
+    Value stub_count(const Invader::Map &map) {
+        return calculate_stub_count(map);
     }
     
-    void tags(const Invader::Map &map) {
+    static void add_tag_path(const Invader::Map &map, std::size_t index, std::vector<std::string> &paths) {
+        auto &tag = map.get_tag(index);
+        paths.emplace_back(File::halo_path_to_preferred_path(tag.get_path()) + "." + HEK::tag_class_to_extension(tag.get_tag_class_int()));
+    }
+    
+    Value tags(const Invader::Map &map) {
         auto tag_count = map.get_tag_count();
+        std::vector<std::string> paths;
+        paths.reserve(tag_count);
         for(std::size_t i = 0; i < tag_count; i++) {
-            auto &tag = map.get_tag(i);
-            oprintf("%s.%s\n", File::halo_path_to_preferred_path(tag.get_path()).c_str(), HEK::tag_class_to_extension(tag.get_tag_class_int()));
+            add_tag_path(map, i, paths);
         }
+        return paths;
     }
     
-    static void print_all_indices(const Invader::Map &map, const std::vector<std::size_t> &indices) {
+    static void add_all_indices(const Invader::Map &map, const std::vector<std::size_t> &indices, std::vector<std::string> &paths) {
         for(auto i : indices) {
-            auto &tag = map.get_tag(i);
-            oprintf("%s.%s\n", File::halo_path_to_preferred_path(tag.get_path()).c_str(), HEK::tag_class_to_extension(tag.get_tag_class_int()));
+            add_tag_path(map, i, paths);
         }
     }
     
-    void tags_external_bitmap_indices(const Invader::Map &map) {
-        print_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, true, false));
-    }
-    void tags_external_loc_indices(const Invader::Map &map) {
-        print_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, true, false));
-    }
-    void tags_external_pointers(const Invader::Map &map) {
-        print_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, false, true));
-        print_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, false, true));
-        print_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, false, true));
-    }
-    void tags_external_sound_indices(const Invader::Map &map) {
-        print_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, false, true));
-    }
-    void tags_external_indices(const Invader::Map &map) {
-        print_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, true, false));
-        print_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, true, false));
-        print_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, true, false));
+    Value tags_external_bitmap_indices(const Invader::Map &map) {
+        std::vector<std::string> paths;
+        add_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, true, false), paths);
+        return paths;
+    }
+    Value tags_external_loc_indices(const Invader::Map &map) {
+        std::vector<std::string> paths;
+        add_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, true, false), paths);
+        return paths;
+    }
+    Value tags_external_pointers(const Invader::Map &map) {
+        std::vector<std::string> paths;
+        add_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, false, true), paths);
+        add_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, false, true), paths);
+        add_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, false, true), paths);
+        return paths;
+    }
+    Value tags_external_sound_indices(const Invader::Map &map) {
+        std::vector<std::string> paths;
+        add_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, false, true), paths);
+        return paths;
+    }
+    Value tags_external_indices(const Invader::Map &map) {
+        std::vector<std::string> paths;
+        add_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_BITMAP, true, false), paths);
+        add_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_LOC, true, false), paths);
+        add_all_indices(map, find_external_tags_indices(map, Map::DataMapType::DATA_MAP_SOUND, true, false), paths);
+        return paths;
     }
     
-    void uncompressed_size(const Invader::Map &map) {
-        oprintf("%zu\n", map.get_data_length());
+    Value uncompressed_size(const Invader::Map &map) {
+        return map.get_data_length();
     }
 }
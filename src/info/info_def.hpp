@@ -5,6 +5,8 @@
 
 #include <vector>
 #include <optional>
+#include <string>
+#include <variant>
 
 namespace Invader {
     class Map;
@@ -43,35 +45,47 @@ namespace Invader::Info {
      */
     std::vector<std::string> find_languages_for_map(const Invader::Map &map, bool &all);
     
-    void overview(const Invader::Map &);
-    void build(const Invader::Map &);
-    void compressed(const Invader::Map &);
-    void crc32(const Invader::Map &);
-    void crc32_mismatched(const Invader::Map &);
-    void dirty(const Invader::Map &);
-    void engine(const Invader::Map &);
-    void external_bitmap_indices(const Invader::Map &);
-    void external_bitmaps(const Invader::Map &);
-    void external_indices(const Invader::Map &);
-    void external_loc_indices(const Invader::Map &);
-    void external_pointers(const Invader::Map &);
-    void external_sound_indices(const Invader::Map &);
-    void external_sounds(const Invader::Map &);
-    void external_tags(const Invader::Map &);
-    void languages(const Invader::Map &);
-    void map_type(const Invader::Map &);
-    void protection(const Invader::Map &);
-    void scenario(const Invader::Map &);
-    void scenario_path(const Invader::Map &);
-    void tag_count(const Invader::Map &);
-    void stub_count(const Invader::Map &);
-    void tags(const Invader::Map &);
-    void tags_external_bitmap_indices(const Invader::Map &);
-    void tags_external_loc_indices(const Invader::Map &);
-    void tags_external_pointers(const Invader::Map &);
-    void tags_external_sound_indices(const Invader::Map &);
-    void tags_external_indices(const Invader::Map &);
-    void uncompressed_size(const Invader::Map &);
+    /**
+     * Value of a property of a map. When shown as text, booleans are shown as 0 or 1, and lists are shown one item per
+     * line.
+     */
+    using Value = std::variant<bool, std::size_t, double, std::string, std::vector<std::string>>;
+    
+    /**
+     * Show an overview of the map
+     * @param map       map to show
+     * @param file_size size of the map file
+     */
+    void overview(const Invader::Map &map, std::size_t file_size);
+    
+    Value build(const Invader::Map &);
+    Value compressed(const Invader::Map &);
+    Value crc32(const Invader::Map &);
+    Value crc32_mismatched(const Invader::Map &);
+    Value dirty(const Invader::Map &);
+    Value engine(const Invader::Map &);
+    Value external_bitmap_indices(const Invader::Map &);
+    Value external_bitmaps(const Invader::Map &);
+    Value external_indices(const Invader::Map &);
+    Value external_loc_indices(const Invader::Map &);
+    Value external_pointers(const Invader::Map &);
+    Value external_sound_indices(const Invader::Map &);
+    Value external_sounds(const Invader::Map &);
+    Value external_tags(const Invader::Map &);
+    Value languages(const Invader::Map &);
+    Value map_type(const Invader::Map &);
+    Value protection(const Invader::Map &);
+    Value scenario(const Invader::Map &);
+    Value scenario_path(const Invader::Map &);
+    Value tag_count(const Invader::Map &);
+    Value stub_count(const Invader::Map &);
+    Value tags(const Invader::Map &);
+    Value tags_external_bitmap_indices(const Invader::Map &);
+    Value tags_external_loc_indices(const Invader::Map &);
+    Value tags_external_pointers(const Invader::Map &);
+    Value tags_external_sound_indices(const Invader::Map &);
+    Value tags_external_indices(const Invader::Map &);
+    Value uncompressed_size(const Invader::Map &);
 }
 
 #endif
@@ -79,7 +79,10 @@ set(INVADER_SOURCE_FILES
     src/map/map.cpp
     src/map/tag.cpp
     src/file/file.cpp
+    src/json.cpp
     src/build/build_workload.cpp
+    src/build/build_cache.cpp
+    src/build/build_stats.cpp
     src/bitmap/s3tc/s3tc.cpp
     src/bitmap/swizzle.cpp
     src/bitmap/bitmap_encode.cpp
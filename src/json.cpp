@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cstdint>
+#include <cstdio>
+#include <invader/json.hpp>
+
+namespace Invader {
+    std::string json_string(const std::string &string) {
+        std::string escaped = "\"";
+        for(char c : string) {
+            auto latin1 = static_cast<std::uint8_t>(c);
+            if(c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if(latin1 < ' ' || latin1 >= 0x7F) {
+                char code[7];
+                std::snprintf(code, sizeof(code), "\\u%04x", latin1);
+                escaped += code;
+            }
+            else {
+                escaped += c;
+            }
+        }
+        escaped += '"';
+        return escaped;
+    }
+}
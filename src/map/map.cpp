@@ -9,6 +9,10 @@
 #include <invader/file/file.hpp>
 #include <invader/crc/hek/crc.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
 namespace Invader {
     Map Map::map_with_copy(const std::byte *data, std::size_t data_size,
                            const std::byte *bitmaps_data, std::size_t bitmaps_data_size,
@@ -42,20 +46,20 @@ namespace Invader {
             data.clear();
         }
         else {
-            map.data_m = data;
+            map.data_m = std::move(data);
         }
         map.data = map.data_m.data();
         map.data_length = map.data_m.size();
 
-        map.bitmap_data_m = bitmaps_data;
+        map.bitmap_data_m = std::move(bitmaps_data);
         map.bitmap_data = map.bitmap_data_m.data();
         map.bitmap_data_length = map.bitmap_data_m.size();
 
-        map.sound_data_m = sounds_data;
+        map.sound_data_m = std::move(sounds_data);
         map.sound_data = map.sound_data_m.data();
         map.sound_data_length = map.sound_data_m.size();
 
-        map.loc_data_m = loc_data;
+        map.loc_data_m = std::move(loc_data);
         map.loc_data = map.loc_data_m.data();
         map.loc_data_length = map.loc_data_m.size();
         
@@ -63,6 +67,151 @@ namespace Invader {
         return map;
     }
 
+    Map Map::map_with_move(std::vector<std::byte> &&data,
+                           File::MappedFile &&bitmaps_file,
+                           File::MappedFile &&loc_file,
+                           File::MappedFile &&sounds_file) {
+        Map map;
+        if(map.decompress_if_needed(data.data(), data.size())) {
+            data.clear();
+        }
+        else {
+            map.data_m = std::move(data);
+        }
+        map.data = map.data_m.data();
+        map.data_length = map.data_m.size();
+
+        map.bitmap_file_m = std::move(bitmaps_file);
+        map.bitmap_data = map.bitmap_file_m.data();
+        map.bitmap_data_length = map.bitmap_file_m.size();
+
+        map.sound_file_m = std::move(sounds_file);
+        map.sound_data = map.sound_file_m.data();
+        map.sound_data_length = map.sound_file_m.size();
+
+        map.loc_file_m = std::move(loc_file);
+        map.loc_data = map.loc_file_m.data();
+        map.loc_data_length = map.loc_file_m.size();
+        
+        map.load_map();
+        return map;
+    }
+
+    Map Map::map_with_lazy_decompression(File::MappedFile &&data,
+                                         File::MappedFile &&bitmaps_file,
+                                         File::MappedFile &&loc_file,
+                                         File::MappedFile &&sounds_file) {
+        using namespace Invader::HEK;
+
+        Map map;
+        const auto *header = reinterpret_cast<const NativeCacheFileHeader *>(data.data());
+
+        // If there's no valid header, it might be an MCC map
+        std::optional<std::vector<std::size_t>> chunk_offsets;
+        if(data.size() < sizeof(*header) || !header->valid()) {
+            chunk_offsets = Compression::ceaflate_chunk_offsets(data.data(), data.size());
+        }
+
+        if(data.size() >= sizeof(*header) && header->valid() && header->engine == CacheFileEngine::CACHE_FILE_NATIVE && header->compression_type == NativeCacheFileHeader::NativeCacheFileCompressionType::NATIVE_CACHE_FILE_COMPRESSION_ZSTD_SEEKABLE) {
+            // Only decompress the header for now; everything else is decompressed when it's accessed
+            auto decompressed_data = File::map_memory(header->decompressed_file_size);
+            if(!decompressed_data.has_value()) {
+                throw DecompressionFailureException();
+            }
+            map.data_file_m = *std::move(decompressed_data);
+            map.data = map.data_file_m.data();
+            map.data_length = map.data_file_m.size();
+            Compression::decompress_map_data_range(data.data(), data.size(), map.data, map.data_length, 0, sizeof(*header));
+
+            std::size_t frame_count = header->frame_count;
+            std::size_t frame_size = header->frame_size;
+            map.frame_offsets.reserve(frame_count);
+            for(std::size_t f = 0; f < frame_count; f++) {
+                map.frame_offsets.emplace_back(sizeof(*header) + f * frame_size);
+            }
+            map.decompressed_frames.resize(frame_count);
+            map.decompression_mutex = std::make_unique<std::mutex>();
+            map.compressed_file_m = std::move(data);
+            map.compressed = CompressionType::COMPRESSION_TYPE_ZSTANDARD;
+        }
+        else if(chunk_offsets.has_value()) {
+            // Same for MCC maps, but with chunks, and the header is in the first chunk
+            auto decompressed_data = File::map_memory(*Compression::ceaflate_compression_size(data.data(), data.size()));
+            if(!decompressed_data.has_value()) {
+                throw DecompressionFailureException();
+            }
+            map.data_file_m = *std::move(decompressed_data);
+            map.data = map.data_file_m.data();
+            map.data_length = map.data_file_m.size();
+
+            map.frame_offsets = *std::move(chunk_offsets);
+            map.decompressed_frames.resize(map.frame_offsets.size());
+            map.decompression_mutex = std::make_unique<std::mutex>();
+            map.compressed_file_m = std::move(data);
+            map.compressed = CompressionType::COMPRESSION_TYPE_MCC_DEFLATE;
+
+            // Check the header
+            if(map.data_length < sizeof(CacheFileHeader) || !reinterpret_cast<const CacheFileHeader *>(map.get_data_at_offset(0, sizeof(CacheFileHeader)))->valid()) {
+                eprintf_error("mcc-compressed map did not have a valid retail/custom edition header");
+                throw InvalidMapException();
+            }
+
+            // Don't support it if we can't
+            switch(reinterpret_cast<const CacheFileHeader *>(map.data)->engine) {
+                case CacheFileEngine::CACHE_FILE_CUSTOM_EDITION:
+                case CacheFileEngine::CACHE_FILE_RETAIL:
+                    break;
+                default:
+                    eprintf_error("mcc-compressed map has an unsupported engine");
+                    throw InvalidMapException();
+            }
+        }
+        else if(map.decompress_if_needed(data.data(), data.size())) {
+            map.data = map.data_m.data();
+            map.data_length = map.data_m.size();
+        }
+        else {
+            map.data_file_m = std::move(data);
+            map.data = map.data_file_m.data();
+            map.data_length = map.data_file_m.size();
+        }
+
+        map.bitmap_file_m = std::move(bitmaps_file);
+        map.bitmap_data = map.bitmap_file_m.data();
+        map.bitmap_data_length = map.bitmap_file_m.size();
+
+        map.sound_file_m = std::move(sounds_file);
+        map.sound_data = map.sound_file_m.data();
+        map.sound_data_length = map.sound_file_m.size();
+
+        map.loc_file_m = std::move(loc_file);
+        map.loc_data = map.loc_file_m.data();
+        map.loc_data_length = map.loc_file_m.size();
+
+        map.populate_tags_lazily = true;
+        map.load_map();
+        return map;
+    }
+
+    Map Map::map_with_mmap(const std::filesystem::path &path,
+                           const std::optional<std::filesystem::path> &bitmaps_path,
+                           const std::optional<std::filesystem::path> &loc_path,
+                           const std::optional<std::filesystem::path> &sounds_path) {
+        auto map_file = [](const std::optional<std::filesystem::path> &path) -> File::MappedFile {
+            if(!path.has_value()) {
+                return File::MappedFile();
+            }
+            auto file = File::map_file(*path);
+            if(!file.has_value()) {
+                eprintf_error("Failed to map %s", path->string().c_str());
+                throw FailedToOpenFileException();
+            }
+            return *std::move(file);
+        };
+
+        return map_with_lazy_decompression(map_file(path), map_file(bitmaps_path), map_file(loc_path), map_file(sounds_path));
+    }
+
     Map Map::map_with_pointer(std::byte *data, std::size_t data_size,
                               std::byte *bitmaps_data, std::size_t bitmaps_data_size,
                               std::byte *loc_data, std::size_t loc_data_size,
@@ -90,12 +239,13 @@ namespace Invader {
             if(potential_header->valid()) {
                 switch(potential_header->engine.read()) {
                     case CacheFileEngine::CACHE_FILE_NATIVE: {
-                        auto *header = reinterpret_cast<const NativeCacheFileHeader *>(&potential_header);
+                        auto *header = reinterpret_cast<const NativeCacheFileHeader *>(potential_header);
                         switch(header->compression_type) {
                             case NativeCacheFileHeader::NativeCacheFileCompressionType::NATIVE_CACHE_FILE_COMPRESSION_UNCOMPRESSED:
                                 compression_type = CompressionType::COMPRESSION_TYPE_NONE;
                                 break;
                             case NativeCacheFileHeader::NativeCacheFileCompressionType::NATIVE_CACHE_FILE_COMPRESSION_ZSTD:
+                            case NativeCacheFileHeader::NativeCacheFileCompressionType::NATIVE_CACHE_FILE_COMPRESSION_ZSTD_SEEKABLE:
                                 compression_type = CompressionType::COMPRESSION_TYPE_ZSTANDARD;
                                 break;
                         }
@@ -166,22 +316,74 @@ namespace Invader {
 
     std::byte *Map::get_data_at_offset(std::size_t offset, std::size_t minimum_size, DataMapType map_type) {
         std::size_t max_length = this->get_data_length(map_type);
-        std::byte *data_ptr = this->get_data(map_type);
+        std::byte *data_ptr = map_type == DATA_MAP_CACHE ? this->data : this->get_data(map_type);
 
         if(offset >= max_length || offset + minimum_size > max_length) {
             throw OutOfBoundsException();
         }
         else {
+            // Without a size, there's no telling where the caller will stop reading, so decompress everything after it
+            if(map_type == DATA_MAP_CACHE) {
+                this->decompress_range_if_needed(offset, minimum_size == 0 ? max_length - offset : minimum_size);
+            }
             return data_ptr + offset;
         }
     }
 
+    void Map::decompress_range_if_needed(std::size_t offset, std::size_t size) {
+        if(!this->decompression_mutex || this->frame_offsets.empty()) {
+            return;
+        }
+
+        // Anything before the first frame (i.e. a native map's header) is decompressed when the map is loaded
+        std::size_t end = offset + std::max(size, static_cast<std::size_t>(1));
+        if(end <= this->frame_offsets[0]) {
+            return;
+        }
+
+        auto frame_containing = [this](std::size_t offset) -> std::size_t {
+            auto next_frame = std::upper_bound(this->frame_offsets.begin(), this->frame_offsets.end(), offset);
+            return next_frame == this->frame_offsets.begin() ? 0 : (next_frame - this->frame_offsets.begin()) - 1;
+        };
+        std::size_t first_frame = frame_containing(offset);
+        std::size_t last_frame = frame_containing(end - 1);
+        std::size_t frame_count = this->frame_offsets.size();
+
+        // Decompress each run of frames that hasn't been decompressed yet
+        std::lock_guard<std::mutex> lock(*this->decompression_mutex);
+        for(std::size_t f = first_frame; f <= last_frame; f++) {
+            if(this->decompressed_frames[f]) {
+                continue;
+            }
+
+            std::size_t run_end = f;
+            while(run_end < last_frame && !this->decompressed_frames[run_end + 1]) {
+                run_end++;
+            }
+
+            std::size_t run_offset = this->frame_offsets[f];
+            std::size_t run_end_offset = run_end + 1 < frame_count ? this->frame_offsets[run_end + 1] : this->data_length;
+            if(this->compressed == CompressionType::COMPRESSION_TYPE_MCC_DEFLATE) {
+                Compression::ceaflate_decompress_chunks(this->compressed_file_m.data(), this->compressed_file_m.size(), f, run_end - f + 1, this->data + run_offset, this->data_length - run_offset, this->decompression_max_threads);
+            }
+            else {
+                Compression::decompress_map_data_range(this->compressed_file_m.data(), this->compressed_file_m.size(), this->data, this->data_length, run_offset, run_end_offset - run_offset);
+            }
+
+            for(std::size_t r = f; r <= run_end; r++) {
+                this->decompressed_frames[r] = true;
+            }
+            f = run_end;
+        }
+    }
+
     std::byte *Map::get_data(DataMapType map_type) {
         if(map_type != DATA_MAP_CACHE && this->get_data_length(map_type) == 0) {
             throw ResourceMapRequiredException();
         }
         switch(map_type) {
             case DATA_MAP_CACHE:
+                this->decompress_range_if_needed(0, this->data_length);
                 return this->data;
             case DATA_MAP_BITMAP:
                 return this->bitmap_data;
@@ -245,6 +447,11 @@ namespace Invader {
             throw OutOfBoundsException();
         }
         else {
+            if(this->populated_tags) {
+                std::call_once(this->populated_tags[index], [this, &index]() {
+                    this->populate_tag(index);
+                });
+            }
             return this->tags[index];
         }
     }
@@ -260,6 +467,8 @@ namespace Invader {
     void Map::load_map() {
         using namespace Invader::HEK;
 
+        this->crc32_calculated = std::make_unique<std::once_flag>();
+
         // Get header
         auto *header_maybe = reinterpret_cast<const CacheFileHeader *>(this->get_data_at_offset(0, sizeof(CacheFileHeader)));
         auto &data_length = this->data_length;
@@ -343,8 +552,11 @@ namespace Invader {
         this->populate_tag_array();
     }
     
-    std::uint32_t Map::get_crc32() const noexcept {
-        return calculate_map_crc(*const_cast<Map *>(this));
+    std::uint32_t Map::get_crc32() const {
+        std::call_once(*this->crc32_calculated, [this]() {
+            this->crc32 = calculate_map_crc(*const_cast<Map *>(this), nullptr, nullptr, nullptr, this->crc32_max_threads);
+        });
+        return this->crc32;
     }
 
     void Map::populate_tag_array() {
@@ -352,6 +564,12 @@ namespace Invader {
 
         auto &map = *this;
 
+        // Tag lookups are indexed the first time they're needed
+        this->tag_indices.clear();
+        this->sorted_tag_paths.clear();
+        this->tag_indices_built = std::make_unique<std::once_flag>();
+        this->sorted_tag_paths_built = std::make_unique<std::once_flag>();
+
         // Preallocate tags
         const auto &header = *reinterpret_cast<const CacheFileTagDataHeader *>(this->get_tag_data_at_offset(0, sizeof(CacheFileTagDataHeader)));
         std::size_t tag_count = header.tag_count;
@@ -378,181 +596,252 @@ namespace Invader {
             set_model_stuff(*reinterpret_cast<const CacheFileTagDataHeaderPC *>(this->get_tag_data_at_offset(0, sizeof(CacheFileTagDataHeaderPC))));
         }
 
-        auto do_populate_the_array = [&map, &tag_count](auto *tags) {
-            // Have a pointer for the end of the tag data so we can check to make sure things aren't null terminated
-            const char *tag_data_end = reinterpret_cast<const char *>(map.tag_data) + map.tag_data_length;
+        // Add every tag first so they can be read in any order
+        this->tags.clear();
+        for(std::size_t i = 0; i < tag_count; i++) {
+            this->tags.push_back(Tag(map));
+        }
 
-            for(std::size_t i = 0; i < tag_count; i++) {
-                map.tags.push_back(Tag(map));
-                auto &tag = map.tags[i];
-                tag.tag_class_int = tags[i].primary_class;
-                tag.tag_data_index_offset = reinterpret_cast<const std::byte *>(tags + i) - map.tag_data;
-                tag.tag_index = i;
+        if(this->populate_tags_lazily) {
+            this->populated_tags = std::make_unique<std::once_flag[]>(tag_count);
 
-                try {
-                    const auto *path = reinterpret_cast<const char *>(map.resolve_tag_data_pointer(tags[i].tag_path));
-
-                    // Make sure the path is null-terminated and it doesn't contain whitespace that isn't an ASCII space (0x20) or forward slash characters
-                    bool null_terminated = false;
-                    for(auto *path_test = path; path < tag_data_end; path_test++) {
-                        if(*path_test == 0) {
-                            null_terminated = true;
-                            
-                            // Did we even start?
-                            if(path_test == path) {
-                                throw InvalidTagPathException();
-                            }
-                            
-                            break;
-                        }
-                        else if(*path_test == '/') {
-                            throw InvalidTagPathException();
-                        }
-                        else {
-                            // Control characters?
-                            auto latin1 = static_cast<std::uint8_t>(*path_test);
-                            if(latin1 < 0x20 || (latin1 > 0x7E && latin1 < 0xA0)) {
-                                throw InvalidTagPathException();
-                            }
+            // Make sure reading a tag later can't fail. Everything but indexed tags is read from the tag array and tag data
+            // (which is already decompressed), so just check the tag array. Indexed tags are looked up in the resource maps,
+            // which can fail, so read those now (this doesn't read any of their tag data).
+            try {
+                if(this->engine == HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
+                    this->resolve_tag_data_pointer(header.tag_array_address, sizeof(NativeCacheFileTagDataTag) * tag_count);
+                }
+                else {
+                    auto *tag_array = reinterpret_cast<const CacheFileTagDataTag *>(this->resolve_tag_data_pointer(header.tag_array_address, sizeof(CacheFileTagDataTag) * tag_count));
+                    for(std::size_t i = 0; i < tag_count; i++) {
+                        if(tag_array[i].indexed) {
+                            this->get_tag(i);
                         }
                     }
+                }
+            }
+            catch(std::exception &) {
+                eprintf_error("Failed to populate the tag array");
+                throw;
+            }
+        }
+        else {
+            this->populated_tags.reset();
+            try {
+                for(std::size_t i = 0; i < tag_count; i++) {
+                    this->populate_tag(i);
+                }
+            }
+            catch(std::exception &) {
+                eprintf_error("Failed to populate the tag array");
+                throw;
+            }
+        }
 
-                    // If it was null terminated and it does NOT start with a dot, use it. Otherwise, don't.
-                    if(null_terminated && *path != '.') {
-                        tag.path = Invader::File::remove_duplicate_slashes(path);
-                    }
-                    else {
+        if(this->engine != HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
+            try {
+                this->get_bsps();
+            }
+            catch(std::exception &) {
+                eprintf_error("Failed to read BSPs");
+                throw;
+            }
+        }
+    }
+
+    std::string Map::read_tag_path(std::uint64_t path_pointer, std::size_t index) const {
+        // Have a pointer for the end of the tag data so we can check to make sure things aren't null terminated
+        const char *tag_data_end = reinterpret_cast<const char *>(this->tag_data) + this->tag_data_length;
+
+        std::string tag_path;
+        try {
+            const auto *path = reinterpret_cast<const char *>(this->resolve_tag_data_pointer(path_pointer));
+
+            // Make sure the path is null-terminated and it doesn't contain whitespace that isn't an ASCII space (0x20) or forward slash characters
+            bool null_terminated = false;
+            for(auto *path_test = path; path_test < tag_data_end; path_test++) {
+                if(*path_test == 0) {
+                    null_terminated = true;
+                    
+                    // Did we even start?
+                    if(path_test == path) {
                         throw InvalidTagPathException();
                     }
                     
-                    // Lowercase everything
-                    for(char &c : tag.path) {
-                        c = std::tolower(c);
+                    break;
+                }
+                else if(*path_test == '/') {
+                    throw InvalidTagPathException();
+                }
+                else {
+                    // Control characters?
+                    auto latin1 = static_cast<std::uint8_t>(*path_test);
+                    if(latin1 < 0x20 || (latin1 > 0x7E && latin1 < 0xA0)) {
+                        throw InvalidTagPathException();
                     }
                 }
-                catch (std::exception &) {
-                    char new_path[64];
-                    std::snprintf(new_path, sizeof(new_path), "corrupted\\tag_%zu", i);
-                    map.invalid_paths_detected = true;
-                    tag.path = new_path;
+            }
+
+            // If it was null terminated and it does NOT start with a dot, use it. Otherwise, don't.
+            if(null_terminated && *path != '.') {
+                tag_path = Invader::File::remove_duplicate_slashes(path);
+            }
+            else {
+                throw InvalidTagPathException();
+            }
+            
+            // Lowercase everything
+            for(char &c : tag_path) {
+                c = std::tolower(c);
+            }
+        }
+        catch (std::exception &) {
+            char new_path[64];
+            std::snprintf(new_path, sizeof(new_path), "corrupted\\tag_%zu", index);
+            this->invalid_paths_detected = true;
+            tag_path = new_path;
+        }
+        return tag_path;
+    }
+
+    std::pair<std::string, TagClassInt> Map::get_tag_path_and_class(std::size_t index) const {
+        using namespace Invader::HEK;
+
+        if(index >= this->get_tag_count()) {
+            throw OutOfBoundsException();
+        }
+
+        // If it's already been read, there's nothing to do
+        if(!this->populated_tags) {
+            auto &tag = this->tags[index];
+            return { tag.get_path(), tag.get_tag_class_int() };
+        }
+
+        // Otherwise, just read what we need from the tag array (this was bounds checked when the map was loaded)
+        const auto &header = *reinterpret_cast<const CacheFileTagDataHeader *>(this->get_tag_data_at_offset(0, sizeof(CacheFileTagDataHeader)));
+        auto tag_count = this->get_tag_count();
+        auto read_tag = [this, &index](auto *tags) -> std::pair<std::string, TagClassInt> {
+            return { this->read_tag_path(tags[index].tag_path, index), tags[index].primary_class };
+        };
+        if(this->engine == HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
+            return read_tag(reinterpret_cast<const NativeCacheFileTagDataTag *>(this->resolve_tag_data_pointer(header.tag_array_address, sizeof(NativeCacheFileTagDataTag) * tag_count)));
+        }
+        else {
+            return read_tag(reinterpret_cast<const CacheFileTagDataTag *>(this->resolve_tag_data_pointer(header.tag_array_address, sizeof(CacheFileTagDataTag) * tag_count)));
+        }
+    }
+
+    void Map::populate_tag(std::size_t i) {
+        using namespace Invader::HEK;
+
+        auto &map = *this;
+        const auto &header = *reinterpret_cast<const CacheFileTagDataHeader *>(this->get_tag_data_at_offset(0, sizeof(CacheFileTagDataHeader)));
+        std::size_t tag_count = this->tags.size();
+
+        auto populate_the_tag = [&map, &i](auto *tags) {
+            auto &tag = map.tags[i];
+            tag.tag_class_int = tags[i].primary_class;
+            tag.tag_data_index_offset = reinterpret_cast<const std::byte *>(tags + i) - map.tag_data;
+            tag.tag_index = i;
+            tag.path = map.read_tag_path(tags[i].tag_path, i);
+
+            if(tag.tag_class_int == TagClassInt::TAG_CLASS_SCENARIO_STRUCTURE_BSP && map.engine != HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
+                return;
+            }
+            else if(sizeof(tags->tag_data) == sizeof(HEK::Pointer) && reinterpret_cast<const CacheFileTagDataTag *>(tags)[i].indexed) {
+                tag.indexed = true;
+
+                // Indexed sound tags still use tag data (until you use reflexives)
+                if(tag.tag_class_int == TagClassInt::TAG_CLASS_SOUND) {
+                    tag.base_struct_pointer = tags[i].tag_data;
+                }
+                else {
+                    tag.base_struct_pointer = 0;
+                    tag.resource_index = tags[i].tag_data;
                 }
 
-                if(tag.tag_class_int == TagClassInt::TAG_CLASS_SCENARIO_STRUCTURE_BSP && map.engine != HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
-                    continue;
+                // Find where it's located
+                DataMapType type;
+                switch(tag.tag_class_int) {
+                    case TagClassInt::TAG_CLASS_BITMAP:
+                        type = DataMapType::DATA_MAP_BITMAP;
+                        break;
+                    case TagClassInt::TAG_CLASS_SOUND:
+                        type = DataMapType::DATA_MAP_SOUND;
+                        break;
+                    default:
+                        type = DataMapType::DATA_MAP_LOC;
+                        break;
                 }
-                else if(sizeof(tags->tag_data) == sizeof(HEK::Pointer) && reinterpret_cast<const CacheFileTagDataTag *>(tags)[i].indexed) {
-                    tag.indexed = true;
 
-                    // Indexed sound tags still use tag data (until you use reflexives)
-                    if(tag.tag_class_int == TagClassInt::TAG_CLASS_SOUND) {
-                        tag.base_struct_pointer = tags[i].tag_data;
-                    }
-                    else {
-                        tag.base_struct_pointer = 0;
-                        tag.resource_index = tags[i].tag_data;
-                    }
+                // Next, check if we have that
+                if(type == DataMapType::DATA_MAP_BITMAP && map.bitmap_data_length == 0) {
+                    return;
+                }
+                else if(type == DataMapType::DATA_MAP_SOUND && map.sound_data_length == 0) {
+                    return;
+                }
+                else if(type == DataMapType::DATA_MAP_LOC && map.loc_data_length == 0) {
+                    return;
+                }
 
-                    // Find where it's located
-                    DataMapType type;
-                    switch(tag.tag_class_int) {
-                        case TagClassInt::TAG_CLASS_BITMAP:
-                            type = DataMapType::DATA_MAP_BITMAP;
-                            break;
-                        case TagClassInt::TAG_CLASS_SOUND:
-                            type = DataMapType::DATA_MAP_SOUND;
-                            break;
-                        default:
-                            type = DataMapType::DATA_MAP_LOC;
+                // Let's begin.
+                auto &header = *reinterpret_cast<ResourceMapHeader *>(map.get_data_at_offset(0, sizeof(ResourceMapHeader), type));
+                auto count = header.resource_count.read();
+                auto *indices = reinterpret_cast<ResourceMapResource *>(map.get_data_at_offset(header.resources, count * sizeof(ResourceMapResource), type));
+
+                // Find that index if we're a sounds.map file
+                if(!tag.resource_index.has_value()) {
+                    auto *paths = reinterpret_cast<const char *>(map.get_data_at_offset(header.paths, 0, type));
+                    for(std::uint32_t i = 1; i < count; i+=2) {
+                        auto *path = paths + indices[i].path_offset;
+                        if(tag.path == path) {
+                            tag.resource_index = i;
                             break;
-                    }
-
-                    // Next, check if we have that
-                    if(type == DataMapType::DATA_MAP_BITMAP && map.bitmap_data_length == 0) {
-                        continue;
-                    }
-                    else if(type == DataMapType::DATA_MAP_SOUND && map.sound_data_length == 0) {
-                        continue;
-                    }
-                    else if(type == DataMapType::DATA_MAP_LOC && map.loc_data_length == 0) {
-                        continue;
-                    }
-
-                    // Let's begin.
-                    auto &header = *reinterpret_cast<ResourceMapHeader *>(map.get_data_at_offset(0, sizeof(ResourceMapHeader), type));
-                    auto count = header.resource_count.read();
-                    auto *indices = reinterpret_cast<ResourceMapResource *>(map.get_data_at_offset(header.resources, count * sizeof(ResourceMapResource), type));
-
-                    // Find that index if we're a sounds.map file
-                    if(!tag.resource_index.has_value()) {
-                        auto *paths = reinterpret_cast<const char *>(map.get_data_at_offset(header.paths, 0, type));
-                        for(std::uint32_t i = 1; i < count; i+=2) {
-                            auto *path = paths + indices[i].path_offset;
-                            if(tag.path == path) {
-                                tag.resource_index = i;
-                                break;
-                            }
                         }
                     }
-                    
-                    // Do we even have an index?
-                    if(!tag.resource_index.has_value()) {
-                        eprintf_error("Tag %s.%s could not be found in the resource map file", File::halo_path_to_preferred_path(tag.path).c_str(), HEK::tag_class_to_extension(tag.tag_class_int));
-                        throw OutOfBoundsException();
-                    }
+                }
+                
+                // Do we even have an index?
+                if(!tag.resource_index.has_value()) {
+                    eprintf_error("Tag %s.%s could not be found in the resource map file", File::halo_path_to_preferred_path(tag.path).c_str(), HEK::tag_class_to_extension(tag.tag_class_int));
+                    throw OutOfBoundsException();
+                }
 
-                    // Make sure it's valid
-                    if(*tag.resource_index >= count) {
-                        eprintf_error("Tag %s.%s is out-of-bounds for the resource map(s) provided (%zu >= %zu)", File::halo_path_to_preferred_path(tag.path).c_str(), HEK::tag_class_to_extension(tag.tag_class_int), *tag.resource_index, static_cast<std::size_t>(count));
-                        throw OutOfBoundsException();
-                    }
+                // Make sure it's valid
+                if(*tag.resource_index >= count) {
+                    eprintf_error("Tag %s.%s is out-of-bounds for the resource map(s) provided (%zu >= %zu)", File::halo_path_to_preferred_path(tag.path).c_str(), HEK::tag_class_to_extension(tag.tag_class_int), *tag.resource_index, static_cast<std::size_t>(count));
+                    throw OutOfBoundsException();
+                }
 
-                    // Set it all
-                    auto &index = indices[*tag.resource_index];
-                    tag.tag_data_size = index.size;
-                    if(tag.tag_class_int == TagClassInt::TAG_CLASS_SOUND) {
-                        tag.base_struct_offset = index.data_offset + sizeof(HEK::Sound<HEK::LittleEndian>);
-                    }
-                    else {
-                        tag.base_struct_offset = index.data_offset;
-                    }
+                // Set it all
+                auto &index = indices[*tag.resource_index];
+                tag.tag_data_size = index.size;
+                if(tag.tag_class_int == TagClassInt::TAG_CLASS_SOUND) {
+                    tag.base_struct_offset = index.data_offset + sizeof(HEK::Sound<HEK::LittleEndian>);
                 }
                 else {
-                    tag.base_struct_pointer = tags[i].tag_data;
+                    tag.base_struct_offset = index.data_offset;
                 }
             }
+            else {
+                tag.base_struct_pointer = tags[i].tag_data;
+            }
         };
 
         if(this->engine == HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
-            try {
-                do_populate_the_array(reinterpret_cast<const NativeCacheFileTagDataTag *>(this->resolve_tag_data_pointer(header.tag_array_address, sizeof(CacheFileTagDataTag) * tag_count)));
-            }
-            catch(std::exception &) {
-                eprintf_error("Failed to populate the tag array");
-                throw;
-            }
+            populate_the_tag(reinterpret_cast<const NativeCacheFileTagDataTag *>(this->resolve_tag_data_pointer(header.tag_array_address, sizeof(NativeCacheFileTagDataTag) * tag_count)));
         }
         else {
-            try {
-                do_populate_the_array(reinterpret_cast<const CacheFileTagDataTag *>(this->resolve_tag_data_pointer(header.tag_array_address, sizeof(CacheFileTagDataTag) * tag_count)));
-            }
-            catch(std::exception &) {
-                eprintf_error("Failed to populate the tag array");
-                throw;
-            }
-            try {
-                this->get_bsps();
-            }
-            catch(std::exception &) {
-                eprintf_error("Failed to read BSPs");
-                throw;
-            }
+            populate_the_tag(reinterpret_cast<const CacheFileTagDataTag *>(this->resolve_tag_data_pointer(header.tag_array_address, sizeof(CacheFileTagDataTag) * tag_count)));
         }
     }
 
     void Map::get_bsps() {
         using namespace Invader::HEK;
 
-        auto &scenario_tag = this->tags[this->scenario_tag_id];
+        auto &scenario_tag = this->get_tag(this->scenario_tag_id);
         auto &tag = scenario_tag.get_base_struct<Scenario>();
         std::size_t bsp_count = tag.structure_bsps.count;
         auto *bsps = scenario_tag.resolve_reflexive(tag.structure_bsps);
@@ -560,12 +849,8 @@ namespace Invader {
         for(std::size_t i = 0; i < bsp_count; i++) {
             auto &bsp = bsps[i];
             std::size_t bsp_id = bsp.structure_bsp.tag_id.read().index;
-            if(bsp_id >= this->tags.size()) {
-                throw OutOfBoundsException();
-            }
-
             // Add the BSP stuff here
-            auto &bsp_tag = this->tags[bsp_id];
+            auto &bsp_tag = this->get_tag(bsp_id);
             bsp_tag.tag_data_size = bsp.bsp_size;
             bsp_tag.base_struct_offset = bsp.bsp_start;
             bsp_tag.base_struct_pointer = bsp.bsp_address;
@@ -579,6 +864,18 @@ namespace Invader {
     bool Map::is_protected() const noexcept {
         using namespace HEK;
         
+        // Tags that are read as they are accessed all need to be read to know if any paths are invalid
+        if(this->populated_tags) {
+            try {
+                for(std::size_t t = 0; t < this->tags.size(); t++) {
+                    this->get_tag(t);
+                }
+            }
+            catch(std::exception &) {
+                return true;
+            }
+        }
+
         // Invalid paths?
         if(this->invalid_paths_detected) {
             return true;
@@ -589,12 +886,15 @@ namespace Invader {
             return true;
         }
 
-        // Go through each tag
+        // Go through each tag backwards so we know which paths and classes come after each tag
         auto tag_count = this->get_tag_count();
-        for(std::size_t t = 0; t < tag_count; t++) {
-            auto &tag = this->get_tag(t);
+        std::unordered_set<std::pair<std::string_view, TagClassInt>, TagIndexKeyHash> later_tags;
+        later_tags.reserve(tag_count);
+        for(std::size_t t = tag_count; t > 0; t--) {
+            auto &tag = this->get_tag(t - 1);
             auto tag_class = tag.get_tag_class_int();
             auto &tag_path = tag.get_path();
+            bool duplicate = !later_tags.emplace(tag_path, tag_class).second;
 
             // If the tag has no data, but it's not because it's indexed, keep going
             if(!tag.data_is_available() && !tag.is_indexed()) {
@@ -611,27 +911,76 @@ namespace Invader {
                 return true;
             }
 
-            // Go through each tag and see if we have any duplicates
-            for(std::size_t t2 = t + 1; t2 < tag_count; t2++) {
-                auto &tag2 = this->get_tag(t2);
-                if(tag_class != tag2.get_tag_class_int()) {
-                    continue;
-                }
-                if(tag2.get_path() == tag_path) {
-                    return true;
-                }
+            // Is there another tag after this one with the same path and class?
+            if(duplicate) {
+                return true;
             }
         }
         return false;
     }
 
     std::optional<std::size_t> Map::find_tag(const char *tag_path, TagClassInt tag_class_int) const noexcept {
-        for(auto &tag : tags) {
-            if(tag.get_tag_class_int() == tag_class_int && tag.get_path() == tag_path) {
-                return &tag - tags.data();
+        std::call_once(*this->tag_indices_built, [this]() {
+            auto tag_count = this->tags.size();
+            this->tag_indices.reserve(tag_count);
+
+            // emplace() doesn't replace existing keys, so the lowest index is kept like a linear search would find
+            for(std::size_t t = 0; t < tag_count; t++) {
+                // Tags that can't be read can't be found, either
+                try {
+                    auto &tag = this->get_tag(t);
+                    this->tag_indices.emplace(std::make_pair(std::string_view(tag.get_path()), tag.get_tag_class_int()), t);
+                }
+                catch(std::exception &) {
+                    continue;
+                }
+            }
+        });
+
+        auto tag = this->tag_indices.find(std::make_pair(std::string_view(tag_path), tag_class_int));
+        if(tag == this->tag_indices.end()) {
+            return std::nullopt;
+        }
+        return tag->second;
+    }
+
+    // Use \ for all path separators so paths that are matched the same way are sorted the same way
+    static std::string normalize_path_separators(std::string path) {
+        for(auto &c : path) {
+            if(c == '/' || c == INVADER_PREFERRED_PATH_SEPARATOR) {
+                c = '\\';
             }
         }
-        return std::nullopt;
+        return path;
+    }
+
+    std::vector<std::size_t> Map::find_tags(const char *pattern) const {
+        std::call_once(*this->sorted_tag_paths_built, [this]() {
+            // Start over if reading a tag failed last time
+            auto tag_count = this->tags.size();
+            this->sorted_tag_paths.clear();
+            this->sorted_tag_paths.reserve(tag_count);
+            for(std::size_t t = 0; t < tag_count; t++) {
+                auto [path, tag_class_int] = this->get_tag_path_and_class(t);
+                this->sorted_tag_paths.emplace_back(normalize_path_separators(path + "." + HEK::tag_class_to_extension(tag_class_int)), t);
+            }
+            std::sort(this->sorted_tag_paths.begin(), this->sorted_tag_paths.end());
+        });
+
+        // Only tags that start with everything before the first wildcard can match
+        std::string prefix = normalize_path_separators(std::string(pattern, std::strcspn(pattern, "*?")));
+        auto tag = std::lower_bound(this->sorted_tag_paths.begin(), this->sorted_tag_paths.end(), prefix, [](const auto &tag, const std::string &prefix) {
+            return tag.first < prefix;
+        });
+
+        std::vector<std::size_t> found;
+        for(; tag != this->sorted_tag_paths.end() && tag->first.compare(0, prefix.size(), prefix) == 0; tag++) {
+            if(File::path_matches(tag->first.c_str(), pattern)) {
+                found.push_back(tag->second);
+            }
+        }
+        std::sort(found.begin(), found.end());
+        return found;
     }
 
     Map::Map(Map &&move) {
@@ -639,12 +988,15 @@ namespace Invader {
         this->data = move.data;
         this->data_length = move.data_length;
         this->bitmap_data_m = std::move(move.bitmap_data_m);
+        this->bitmap_file_m = std::move(move.bitmap_file_m);
         this->bitmap_data = move.bitmap_data;
         this->bitmap_data_length = move.bitmap_data_length;
         this->loc_data_m = std::move(move.loc_data_m);
+        this->loc_file_m = std::move(move.loc_file_m);
         this->loc_data = move.loc_data;
         this->loc_data_length = move.loc_data_length;
         this->sound_data_m = std::move(move.sound_data_m);
+        this->sound_file_m = std::move(move.sound_file_m);
         this->sound_data = move.sound_data;
         this->sound_data_length = move.sound_data_length;
         this->engine = move.engine;
@@ -653,6 +1005,15 @@ namespace Invader {
         this->model_index_offset = move.model_index_offset;
         this->model_data_size = move.model_data_size;
         this->asset_indices_offset = move.asset_indices_offset;
+        this->data_file_m = std::move(move.data_file_m);
+        this->compressed_file_m = std::move(move.compressed_file_m);
+        this->frame_offsets = std::move(move.frame_offsets);
+        this->decompressed_frames = std::move(move.decompressed_frames);
+        this->decompression_mutex = std::move(move.decompression_mutex);
+        this->compressed = move.compressed;
+        this->populate_tags_lazily = move.populate_tags_lazily;
+        this->crc32_max_threads = move.crc32_max_threads;
+        this->decompression_max_threads = move.decompression_max_threads;
 
         if(this->data_m.size()) {
             this->data = this->data_m.data();
@@ -668,9 +1029,11 @@ namespace Invader {
         }
 
         move.tags.clear();
+        move.populated_tags.reset();
+        move.tag_indices.clear();
+        move.sorted_tag_paths.clear();
 
         this->load_map();
-        this->compressed = move.compressed;
     }
 
     std::byte *Map::get_internal_asset(std::size_t offset, std::size_t minimum_size) {
@@ -683,21 +1046,27 @@ namespace Invader {
     }
     
     bool Map::is_clean() const noexcept {
-        if(this->get_crc32() != this->get_header_crc32() || this->is_protected()) {
-            return false;
-        }
-        else if(this->get_engine() != HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
-            auto tag_count = this->get_tag_count();
-            for(std::size_t i = 0; i < tag_count; i++) {
-                auto &tag = this->get_tag(i);
-                auto &index = tag.get_tag_data_index();
-                
-                // BSP tags are NOT supposed to have this set
-                if(tag.get_tag_class_int() == HEK::TagClassInt::TAG_CLASS_SCENARIO_STRUCTURE_BSP && index.tag_data != 0) {
-                    return false;
+        // If we can't even read it (e.g. it fails to decompress), it definitely isn't clean
+        try {
+            if(this->get_crc32() != this->get_header_crc32() || this->is_protected()) {
+                return false;
+            }
+            else if(this->get_engine() != HEK::CacheFileEngine::CACHE_FILE_NATIVE) {
+                auto tag_count = this->get_tag_count();
+                for(std::size_t i = 0; i < tag_count; i++) {
+                    auto &tag = this->get_tag(i);
+                    auto &index = tag.get_tag_data_index();
+                    
+                    // BSP tags are NOT supposed to have this set
+                    if(tag.get_tag_class_int() == HEK::TagClassInt::TAG_CLASS_SCENARIO_STRUCTURE_BSP && index.tag_data != 0) {
+                        return false;
+                    }
                 }
             }
         }
+        catch(std::exception &) {
+            return false;
+        }
         return true;
     }
 }
@@ -73,6 +73,11 @@ namespace Invader {
                 throw OutOfBoundsException();
             }
 
+            // If no size was given, the caller may read up to the end of the tag, so that all has to be decompressed
+            if(minimum == 0) {
+                minimum = edge - offset;
+            }
+
             Map::DataMapType type;
             if(this->indexed) {
                 switch(this->tag_class_int) {
@@ -58,7 +58,7 @@ namespace Invader {
 
             Resource resource;
             resource.path = Invader::File::remove_duplicate_slashes(resource_path);
-            resource.data = std::vector<std::byte>(resource_data, resource_data + resource_data_size);
+            resource.data = ResourceData(resource_data, resource_data_size);
             resource.path_offset = resource_path_offset;
             resource.data_offset = resource_data_offset;
 
@@ -67,4 +67,16 @@ namespace Invader {
 
         return returned_resources;
     }
+
+    std::optional<ResourceMap> ResourceMap::open_resource_map(const std::filesystem::path &path) {
+        auto file = File::map_file(path);
+        if(!file.has_value()) {
+            return std::nullopt;
+        }
+
+        ResourceMap map;
+        map.resources = load_resource_map(file->data(), file->size());
+        map.file = std::move(*file);
+        return map;
+    }
 }
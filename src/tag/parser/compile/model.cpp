@@ -743,6 +743,48 @@ namespace Invader::Parser {
         pre_compile_model(*this, workload, tag_index);
     }
     
+    std::uint32_t add_model_indices(BuildWorkload &workload, const HEK::Index *indices, std::size_t count) {
+        std::size_t indices_count = workload.model_indices.size();
+
+        if(indices_count >= count) {
+            auto &last = indices[count - 1];
+            std::size_t check_size = count - 1;
+
+            for(std::size_t i = 0; i <= indices_count - count; i++) {
+                auto *model_data = workload.model_indices.data() + i;
+
+                // Check the last index, first, since it's most likely to be different
+                if(model_data[count - 1] != last) {
+                    continue;
+                }
+
+                // If triangles match, use this offset instead
+                if(std::memcmp(indices, model_data, sizeof(workload.model_indices[0]) * check_size) == 0) {
+                    return static_cast<std::uint32_t>(i * sizeof(workload.model_indices[0]));
+                }
+            }
+        }
+
+        workload.model_indices.insert(workload.model_indices.end(), indices, indices + count);
+        return static_cast<std::uint32_t>(indices_count * sizeof(workload.model_indices[0]));
+    }
+
+    std::uint32_t add_model_vertices(BuildWorkload &workload, const ModelVertexUncompressed::struct_little *vertices, std::size_t count) {
+        std::size_t vertices_count = workload.model_vertices.size();
+
+        if(vertices_count >= count) {
+            for(std::size_t i = 0; i <= vertices_count - count; i++) {
+                // If vertices match, use this offset instead
+                if(std::memcmp(workload.model_vertices.data() + i, vertices, sizeof(workload.model_vertices[0]) * count) == 0) {
+                    return static_cast<std::uint32_t>(i * sizeof(workload.model_vertices[0]));
+                }
+            }
+        }
+
+        workload.model_vertices.insert(workload.model_vertices.end(), vertices, vertices + count);
+        return static_cast<std::uint32_t>(vertices_count * sizeof(workload.model_vertices[0]));
+    }
+
     template<class P> static void pre_compile_model_geometry_part(P &what, BuildWorkload &workload, std::size_t tag_index) {
         std::vector<HEK::Index> triangle_indices;
 
@@ -790,36 +832,7 @@ namespace Invader::Parser {
         }
 
         // See if we can find a copy of this
-        std::size_t this_indices_count = triangle_indices_size;
-        std::size_t indices_count = workload.model_indices.size();
-        bool found = false;
-
-        if(indices_count >= this_indices_count) {
-            auto &first = triangle_indices[0];
-            auto &last = triangle_indices[triangle_indices_size - 1];
-            std::size_t check_size = this_indices_count - 1;
-
-            for(std::size_t i = 0; i <= indices_count - this_indices_count; i++) {
-                auto *model_data = workload.model_indices.data() + i;
-
-                // Check the last index, first, since it's most likely to be different
-                if(model_data[triangle_indices_size - 1] != last) {
-                    continue;
-                }
-
-                // If triangles match, set the triangle offset to this instead
-                if(std::memcmp(&first, model_data, sizeof(workload.model_indices[0]) * check_size) == 0) {
-                    found = true;
-                    what.triangle_offset = i * sizeof(workload.model_indices[0]);
-                    break;
-                }
-            }
-        }
-
-        if(!found) {
-            what.triangle_offset = indices_count * sizeof(workload.model_indices[0]);
-            workload.model_indices.insert(workload.model_indices.end(), triangle_indices.begin(), triangle_indices.end());
-        }
+        what.triangle_offset = add_model_indices(workload, triangle_indices.data(), triangle_indices_size);
         what.triangle_offset_2 = what.triangle_offset;
 
         // Add the vertices, next
@@ -845,25 +858,7 @@ namespace Invader::Parser {
         }
 
         // Let's see if we can also dedupe this
-        std::size_t this_vertices_count = vertices_of_fun.size();
-        std::size_t vertices_count = workload.model_vertices.size();
-        found = false;
-
-        if(vertices_count >= this_vertices_count) {
-            for(std::size_t i = 0; i <= vertices_count - this_vertices_count; i++) {
-                // If vertices match, set the vertices offset to this instead
-                if(std::memcmp(workload.model_vertices.data() + i, vertices_of_fun.data(), sizeof(workload.model_vertices[0]) * this_vertices_count) == 0) {
-                    found = true;
-                    what.vertex_offset = i * sizeof(workload.model_vertices[0]);
-                    break;
-                }
-            }
-        }
-
-        if(!found) {
-            what.vertex_offset = vertices_count * sizeof(workload.model_vertices[0]);
-            workload.model_vertices.insert(workload.model_vertices.end(), vertices_of_fun.begin(), vertices_of_fun.end());
-        }
+        what.vertex_offset = add_model_vertices(workload, vertices_of_fun.data(), vertices_of_fun.size());
 
         // Don't forget to set these memes
         what.do_not_crash_the_game = 1;
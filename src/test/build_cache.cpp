@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <invader/build/build_workload.hpp>
+#include <invader/printf.hpp>
+#include <invader/error.hpp>
+#include "test_tags.hpp"
+
+using namespace Invader;
+
+// Builds a scenario with and without the build cache and checks that loading tags from the cache gives the same map
+// as compiling them. The scenery and biped add pathfinding spheres to their collision models when they're compiled,
+// so this also checks that changes made to one tag by another are not lost when either is loaded from the cache.
+
+int main(int argc, const char **argv) {
+    if(argc != 2) {
+        eprintf("Usage: %s <directory>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::path directory = argv[1];
+    std::error_code ec;
+    std::filesystem::remove_all(directory, ec);
+
+    try {
+        auto tags = directory / "tags";
+        Test::make_tags(tags);
+
+        BuildWorkload::BuildParameters parameters("levels\\test\\test", { tags }, HEK::CacheFileEngine::CACHE_FILE_RETAIL);
+        parameters.details.build_raw_data_handling = BuildWorkload::BuildParameters::BuildParametersDetails::RawDataHandling::RAW_DATA_HANDLING_RETAIN_ALL;
+        parameters.verbosity = BuildWorkload::BuildParameters::BuildVerbosity::BUILD_VERBOSITY_QUIET;
+        auto fresh = BuildWorkload::compile_map(parameters);
+
+        bool passed = true;
+        auto check = [&fresh, &passed](const std::vector<std::byte> &map, const char *description) {
+            if(map != fresh) {
+                eprintf_error("Map built %s does not match the map built without a cache", description);
+                passed = false;
+            }
+        };
+
+        // The first build fills the cache, and the second one loads from it
+        BuildWorkload::BuildCacheMemory cache_memory;
+        parameters.cache_memory = &cache_memory;
+        check(BuildWorkload::compile_map(parameters), "while filling the memory cache");
+        check(BuildWorkload::compile_map(parameters), "from the memory cache");
+
+        parameters.cache_memory = nullptr;
+        parameters.cache_directory = directory / "cache";
+        check(BuildWorkload::compile_map(parameters), "while filling the cache directory");
+        check(BuildWorkload::compile_map(parameters), "from the cache directory");
+
+        if(!passed) {
+            return EXIT_FAILURE;
+        }
+    }
+    catch(std::exception &e) {
+        eprintf_error("Failed to build: %s", e.what());
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::remove_all(directory, ec);
+    oprintf_success("Cached builds match");
+    return EXIT_SUCCESS;
+}
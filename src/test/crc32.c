@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+// Checks each CRC32 implementation the CPU supports, and crc32_merge, against the original one-byte-at-a-time loop
+// using random data, lengths, and alignments. Pass --benchmark to also show how fast each implementation is.
+//
+// The implementations are static, so crc32.c is included here rather than linked.
+
+#include "../crc/crc32.c"
+
+#include <stdio.h>
+#include <time.h>
+
+#define TEST_BUFFER_SIZE (256 * 1024)
+#define TEST_ITERATIONS 4000
+
+struct crc32_kernel {
+	const char *name;
+	crc32_function function;
+};
+
+static uint64_t random_state = 0x9E3779B97F4A7C15;
+
+static uint32_t random_value(void)
+{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return (uint32_t)(random_state >> 32);
+}
+
+// Mostly short lengths, since that's where the tails and block boundaries are, but some long ones too
+static size_t random_length(size_t maximum)
+{
+	size_t length;
+	switch (random_value() % 4) {
+		case 0:
+			length = random_value() % 256;
+			break;
+		case 1:
+			length = random_value() % 4096;
+			break;
+		default:
+			length = random_value() % (maximum + 1);
+			break;
+	}
+	return length > maximum ? maximum : length;
+}
+
+static size_t get_kernels(struct crc32_kernel *kernels)
+{
+	size_t count = 0;
+
+#ifdef __GNUC__
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	kernels[count].name = "slice-by-16";
+	kernels[count++].function = crc32_slice16;
+#endif
+
+#ifdef INVADER_CRC32_PCLMUL
+	if (crc32_pclmul_supported()) {
+		kernels[count].name = "PCLMULQDQ";
+		kernels[count++].function = crc32_pclmul;
+	}
+#endif
+
+#ifdef INVADER_CRC32_ARMV8
+	if (crc32_armv8_supported()) {
+		kernels[count].name = "ARMv8";
+		kernels[count++].function = crc32_armv8;
+	}
+#endif
+#endif
+
+	kernels[count].name = "selected";
+	kernels[count++].function = crc32_implementation;
+
+	return count;
+}
+
+static int test_kernel(const struct crc32_kernel *kernel, const uint8_t *buffer)
+{
+	size_t i;
+	for (i = 0; i < TEST_ITERATIONS; i++) {
+		size_t offset = random_value() % 64;
+		size_t length = random_length(TEST_BUFFER_SIZE - offset);
+		uint32_t initial = (i & 1) ? random_value() : ~0U;
+
+		uint32_t expected = crc32_bytes(initial, buffer + offset, length);
+		uint32_t actual = kernel->function(initial, buffer + offset, length);
+		if (actual != expected) {
+			fprintf(stderr, "%s: got 0x%08X instead of 0x%08X for %zu bytes at offset %zu\n", kernel->name, actual, expected, length, offset);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int test_merge(const uint8_t *buffer)
+{
+	size_t i;
+	for (i = 0; i < TEST_ITERATIONS; i++) {
+		size_t offset = random_value() % 64;
+		size_t length = random_length(TEST_BUFFER_SIZE - offset);
+		size_t split = length ? random_value() % (length + 1) : 0;
+
+		uint32_t expected = crc32(0, buffer + offset, length);
+		uint32_t first = crc32(0, buffer + offset, split);
+		uint32_t second = crc32(0, buffer + offset + split, length - split);
+		uint32_t actual = crc32_merge(first, second, length - split);
+		if (actual != expected) {
+			fprintf(stderr, "crc32_merge: got 0x%08X instead of 0x%08X for %zu bytes split at %zu\n", actual, expected, length, split);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void benchmark_kernel(const struct crc32_kernel *kernel, const uint8_t *buffer)
+{
+	size_t passes = 0;
+	uint32_t crc = 0;
+	clock_t start = clock(), elapsed;
+	do {
+		crc = kernel->function(crc, buffer, TEST_BUFFER_SIZE);
+		passes++;
+		elapsed = clock() - start;
+	}
+	while (elapsed < CLOCKS_PER_SEC / 4);
+
+	double seconds = (double)elapsed / CLOCKS_PER_SEC;
+	printf("%-12s %10.1f MiB/s (0x%08X)\n", kernel->name, (double)passes * TEST_BUFFER_SIZE / 1048576.0 / seconds, crc);
+}
+
+int main(int argc, const char **argv)
+{
+	static uint8_t buffer[TEST_BUFFER_SIZE];
+	struct crc32_kernel kernels[8];
+	size_t kernel_count, i;
+	int passed = 1;
+
+	int benchmark = argc == 2 && strcmp(argv[1], "--benchmark") == 0;
+	if (argc > 1 && !benchmark) {
+		fprintf(stderr, "Usage: %s [--benchmark]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < sizeof(buffer); i++) {
+		buffer[i] = (uint8_t)random_value();
+	}
+
+	// Check a known value first
+	if (crc32(0, "123456789", 9) != 0xCBF43926) {
+		fprintf(stderr, "crc32: wrong CRC32 for \"123456789\"\n");
+		passed = 0;
+	}
+
+	kernel_count = get_kernels(kernels);
+	for (i = 0; i < kernel_count; i++) {
+		if (test_kernel(&kernels[i], buffer)) {
+			printf("%s: OK\n", kernels[i].name);
+		}
+		else {
+			passed = 0;
+		}
+	}
+
+	if (test_merge(buffer)) {
+		printf("crc32_merge: OK\n");
+	}
+	else {
+		passed = 0;
+	}
+
+	if (benchmark) {
+		kernels[kernel_count].name = "bytes";
+		kernels[kernel_count].function = crc32_bytes;
+		for (i = 0; i <= kernel_count; i++) {
+			benchmark_kernel(&kernels[i], buffer);
+		}
+	}
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
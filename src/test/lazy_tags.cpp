@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <invader/build/build_workload.hpp>
+#include <invader/map/map.hpp>
+#include <invader/map/tag.hpp>
+#include <invader/resource/hek/resource_map.hpp>
+#include <invader/printf.hpp>
+#include <invader/error.hpp>
+#include "test_tags.hpp"
+
+using namespace Invader;
+
+// Builds a scenario and checks that a map that reads tags as they are accessed gives the same paths before reading
+// them and can read all of them, and that a map with an indexed tag that isn't in its resource map fails to load the
+// same way it does when every tag is read up front, rather than failing later when the tag is accessed.
+
+int main(int argc, const char **argv) {
+    if(argc != 2) {
+        eprintf("Usage: %s <directory>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::path directory = argv[1];
+    std::error_code ec;
+    std::filesystem::remove_all(directory, ec);
+
+    bool passed = true;
+
+    try {
+        auto tags = directory / "tags";
+        Test::make_tags(tags);
+
+        BuildWorkload::BuildParameters parameters("levels\\test\\test", { tags }, HEK::CacheFileEngine::CACHE_FILE_RETAIL);
+        parameters.details.build_raw_data_handling = BuildWorkload::BuildParameters::BuildParametersDetails::RawDataHandling::RAW_DATA_HANDLING_RETAIN_ALL;
+        parameters.verbosity = BuildWorkload::BuildParameters::BuildVerbosity::BUILD_VERBOSITY_QUIET;
+        auto map_data = BuildWorkload::compile_map(parameters);
+
+        // A bitmaps.map with no bitmaps in it
+        std::vector<std::byte> bitmaps_data(sizeof(HEK::ResourceMapHeader) * 2);
+        auto &bitmaps_header = *reinterpret_cast<HEK::ResourceMapHeader *>(bitmaps_data.data());
+        bitmaps_header.type = HEK::ResourceMapType::RESOURCE_MAP_BITMAP;
+        bitmaps_header.paths = sizeof(HEK::ResourceMapHeader);
+        bitmaps_header.resources = sizeof(HEK::ResourceMapHeader);
+        bitmaps_header.resource_count = 0;
+
+        // The same map, but with a bitmap that's indexed to a bitmap that isn't in bitmaps.map
+        auto broken_map_data = map_data;
+        {
+            auto map = Map::map_with_pointer(broken_map_data.data(), broken_map_data.size());
+            auto bitmap = map.find_tag("ui\\shell\\bitmaps\\background", TagClassInt::TAG_CLASS_BITMAP);
+            if(!bitmap.has_value()) {
+                eprintf_error("The built map is missing its bitmap");
+                return EXIT_FAILURE;
+            }
+            auto &index = map.get_tag(*bitmap).get_tag_data_index();
+            index.indexed = 1;
+            index.tag_data = 1000;
+        }
+
+        auto map_path = directory / "test.map";
+        auto broken_map_path = directory / "broken.map";
+        auto bitmaps_path = directory / "bitmaps.map";
+        if(!File::save_file(map_path, map_data) || !File::save_file(broken_map_path, broken_map_data) || !File::save_file(bitmaps_path, bitmaps_data)) {
+            eprintf_error("Failed to save the maps");
+            return EXIT_FAILURE;
+        }
+
+        // Every tag should be readable from the valid map, and it should still be clean
+        {
+            auto map = Map::map_with_mmap(map_path, bitmaps_path);
+            auto eager_map = Map::map_with_copy(map_data.data(), map_data.size(), bitmaps_data.data(), bitmaps_data.size());
+            for(std::size_t t = 0; t < map.get_tag_count(); t++) {
+                auto &tag = eager_map.get_tag(t);
+                if(map.get_tag_path_and_class(t) != std::make_pair(tag.get_path(), tag.get_tag_class_int())) {
+                    eprintf_error("Tag #%zu has a different path or class when it hasn't been read yet", t);
+                    passed = false;
+                }
+            }
+            for(std::size_t t = 0; t < map.get_tag_count(); t++) {
+                map.get_tag(t);
+            }
+            if(!map.is_clean()) {
+                eprintf_error("The map isn't clean when read as it is accessed");
+                passed = false;
+            }
+        }
+
+        // The broken map should fail to load either way
+        auto fails_to_load = [](auto load, const char *description) {
+            try {
+                load();
+            }
+            catch(std::exception &) {
+                return true;
+            }
+            eprintf_error("The map with a broken indexed tag loaded %s", description);
+            return false;
+        };
+        passed = fails_to_load([&broken_map_data, &bitmaps_data]() {
+            Map::map_with_copy(broken_map_data.data(), broken_map_data.size(), bitmaps_data.data(), bitmaps_data.size());
+        }, "when reading every tag up front") && passed;
+        passed = fails_to_load([&broken_map_path, &bitmaps_path]() {
+            Map::map_with_mmap(broken_map_path, bitmaps_path);
+        }, "when reading tags as they are accessed") && passed;
+    }
+    catch(std::exception &e) {
+        eprintf_error("Failed to test: %s", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if(!passed) {
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::remove_all(directory, ec);
+    oprintf_success("Broken tags are found when maps are loaded");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,24 @@
+# SPDX-License-Identifier: GPL-3.0-only
+
+option(INVADER_TEST "Build tests for libinvader (run with ctest)" OFF)
+
+if(INVADER_TEST)
+    enable_testing()
+
+    add_executable(invader-test-build-cache
+        src/test/build_cache.cpp
+    )
+    target_link_libraries(invader-test-build-cache invader)
+    add_test(NAME build-cache COMMAND invader-test-build-cache ${CMAKE_CURRENT_BINARY_DIR}/test/build-cache)
+
+    add_executable(invader-test-lazy-tags
+        src/test/lazy_tags.cpp
+    )
+    target_link_libraries(invader-test-lazy-tags invader)
+    add_test(NAME lazy-tags COMMAND invader-test-lazy-tags ${CMAKE_CURRENT_BINARY_DIR}/test/lazy-tags)
+
+    add_executable(invader-test-crc32
+        src/test/crc32.c
+    )
+    add_test(NAME crc32 COMMAND invader-test-crc32)
+endif()
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef INVADER__TEST__TEST_TAGS_HPP
+#define INVADER__TEST__TEST_TAGS_HPP
+
+#include <filesystem>
+#include <invader/tag/parser/parser.hpp>
+#include <invader/file/file.hpp>
+#include <invader/printf.hpp>
+#include <invader/error.hpp>
+
+namespace Invader::Test {
+    template <typename T> void save_tag(const std::filesystem::path &tags, T tag, const char *path, TagClassInt tag_class_int) {
+        auto tag_path = tags / (std::string(path) + "." + HEK::tag_class_to_extension(tag_class_int));
+        std::filesystem::create_directories(tag_path.parent_path());
+        if(!File::save_file(tag_path, tag.generate_hek_tag_data(tag_class_int))) {
+            eprintf_error("Failed to save %s", tag_path.string().c_str());
+            throw FailedToSaveFileException();
+        }
+    }
+
+    // Tags for a small singleplayer scenario (levels\test\test) with everything a map needs to build, plus a scenery
+    // and a biped that add pathfinding spheres to their collision models when they're compiled
+    inline void make_tags(const std::filesystem::path &tags) {
+        auto scenario = Parser::Scenario();
+        scenario.type = HEK::ScenarioType::SCENARIO_TYPE_SINGLEPLAYER;
+        auto &scenery_type = scenario.scenery_palette.emplace_back();
+        scenery_type.name.path = "scenery\\rock\\rock";
+        scenery_type.name.tag_class_int = TagClassInt::TAG_CLASS_SCENERY;
+        save_tag(tags, scenario, "levels/test/test", TagClassInt::TAG_CLASS_SCENARIO);
+
+        auto scenery = Parser::Scenery();
+        scenery.bounding_radius = 2.0F;
+        scenery.collision_model.path = "scenery\\rock\\rock";
+        scenery.collision_model.tag_class_int = TagClassInt::TAG_CLASS_MODEL_COLLISION_GEOMETRY;
+        save_tag(tags, scenery, "scenery/rock/rock", TagClassInt::TAG_CLASS_SCENERY);
+        save_tag(tags, Parser::ModelCollisionGeometry(), "scenery/rock/rock", TagClassInt::TAG_CLASS_MODEL_COLLISION_GEOMETRY);
+
+        auto biped = Parser::Biped();
+        biped.collision_radius = 0.5F;
+        biped.collision_model.path = "characters\\cyborg\\cyborg";
+        biped.collision_model.tag_class_int = TagClassInt::TAG_CLASS_MODEL_COLLISION_GEOMETRY;
+        save_tag(tags, biped, "characters/cyborg/cyborg", TagClassInt::TAG_CLASS_BIPED);
+        save_tag(tags, Parser::ModelCollisionGeometry(), "characters/cyborg/cyborg", TagClassInt::TAG_CLASS_MODEL_COLLISION_GEOMETRY);
+
+        // Everything else the map needs
+        auto globals = Parser::Globals();
+        globals.sounds.resize(1);
+        globals.camera.resize(1);
+        globals.player_control.resize(1);
+        globals.difficulty.resize(1);
+        globals.grenades.resize(2);
+        globals.rasterizer_data.resize(1);
+        globals.interface_bitmaps.resize(1);
+        globals.first_person_interface.resize(1);
+        globals.falling_damage.resize(1);
+        globals.materials.resize(32);
+        globals.multiplayer_information.resize(1);
+        auto &player_information = globals.player_information.emplace_back();
+        player_information.unit.path = "characters\\cyborg\\cyborg";
+        player_information.unit.tag_class_int = TagClassInt::TAG_CLASS_BIPED;
+        save_tag(tags, globals, "globals/globals", TagClassInt::TAG_CLASS_GLOBALS);
+
+        for(auto *path : { "ui/ui_tags_loaded_all_scenario_types", "ui/ui_tags_loaded_solo_scenario_type" }) {
+            save_tag(tags, Parser::TagCollection(), path, TagClassInt::TAG_CLASS_TAG_COLLECTION);
+        }
+        for(auto *path : { "sound/sfx/ui/cursor", "sound/sfx/ui/back", "sound/sfx/ui/flag_failure" }) {
+            save_tag(tags, Parser::Sound(), path, TagClassInt::TAG_CLASS_SOUND);
+        }
+        for(auto *path : { "ui/shell/main_menu/mp_map_list", "ui/shell/strings/loading" }) {
+            save_tag(tags, Parser::UnicodeStringList(), path, TagClassInt::TAG_CLASS_UNICODE_STRING_LIST);
+        }
+        for(auto *path : { "ui/shell/bitmaps/trouble_brewing", "ui/shell/bitmaps/background" }) {
+            save_tag(tags, Parser::Bitmap(), path, TagClassInt::TAG_CLASS_BITMAP);
+        }
+    }
+}
+
+#endif